@@ -0,0 +1,85 @@
+#include "Workload.hpp"
+
+#include <cstddef>
+
+// Compares evaluating the same predicate through a lambda per entry and
+// through col<N>() nodes over a column snapshot, and summing a part of
+// row-wise against column-wise storage.
+namespace {
+  using Bench::Params;
+  using Bench::Timer;
+
+  constexpr int repetitions = 20;
+
+  Bench::Register lambda{ "columns: lambda", Bench::Types<Point>{}, [](auto, Params const &params, Timer &timer) {
+    Bench::Filled<Point> filled{ params };
+    auto const half = Bench::keySpace(params) / 2;
+    std::size_t rows = 0;
+    timer.measure(repetitions, [&]() {
+      for (int i = 0; i < repetitions; ++i) {
+        filled.table.all() && filled.table.pred([half](Point const &p) {
+          return p.first >= half && p.second <= -200;
+        }) >>= [&](Point const &) {
+          ++rows;
+        };
+      }
+    });
+    timer.consume(rows);
+  } };
+
+  Bench::Register columns{ "columns: col<N>()", Bench::Types<Point>{}, [](auto, Params const &params, Timer &timer) {
+    using CQL::col;
+    Bench::Filled<Point> filled{ params };
+    auto const half = Bench::keySpace(params) / 2;
+    auto const snapshot = filled.table.columns<0, 1>();
+    std::size_t rows = 0;
+    timer.measure(repetitions, [&]() {
+      for (int i = 0; i < repetitions; ++i) {
+        rows += snapshot.where(col<0>() >= half && col<1>() <= -200).count();
+      }
+    });
+    timer.consume(rows);
+  } };
+
+  Bench::Register snapshot{ "columns: snapshot + col<N>()", Bench::Types<Point>{}, [](auto, Params const &params, Timer &timer) {
+    using CQL::col;
+    Bench::Filled<Point> filled{ params };
+    auto const half = Bench::keySpace(params) / 2;
+    std::size_t rows = 0;
+    timer.measure(repetitions, [&]() {
+      for (int i = 0; i < repetitions; ++i) {
+        rows += filled.table.columns<0, 1>().where(col<0>() >= half && col<1>() <= -200).count();
+      }
+    });
+    timer.consume(rows);
+  } };
+
+  Bench::Register rowSum{ "columns: Table sum", Bench::Types<SimpleUser>{}, [](auto, Params const &params, Timer &timer) {
+    Bench::Filled<SimpleUser> filled{ params };
+    long long sum = 0;
+    timer.measure(repetitions * params.rows, [&]() {
+      for (int i = 0; i < repetitions; ++i) {
+        filled.table.all() >>= [&](SimpleUser const &user) {
+          sum += user.age;
+        };
+      }
+    });
+    timer.consume(sum);
+  } };
+
+  Bench::Register columnSum{ "columns: ColumnTable sum", Bench::Types<SimpleUser>{}, [](auto, Params const &params, Timer &timer) {
+    CQL::ColumnTable<SimpleUser> table;
+    for (auto &user : Bench::entries<SimpleUser>(params)) {
+      table.emplace(std::move(user));
+    }
+    long long sum = 0;
+    timer.measure(repetitions * params.rows, [&]() {
+      for (int i = 0; i < repetitions; ++i) {
+        table.forEachValue<2>([&](int age) {
+          sum += age;
+        });
+      }
+    });
+    timer.consume(sum);
+  } };
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// A small benchmark runner. Benchmarks register themselves for a list of
+// entry types, and are run for every combination of row count and key
+// distribution asked for on the command line. Results are printed as JSON
+// (or as a table with --format=text), one record per combination.
+namespace Bench {
+  enum class Distribution {
+    Uniform,    // Keys drawn evenly from [0, rows)
+    Zipf,       // Keys from [0, rows), the k:th most common one 1/k as often as the first
+    Duplicates, // Keys drawn evenly from only a handful of values
+  };
+
+  inline char const *name(Distribution distribution) {
+    switch (distribution) {
+      case Distribution::Uniform: return "uniform";
+      case Distribution::Zipf: return "zipf";
+      case Distribution::Duplicates: return "duplicates";
+    }
+    return "";
+  }
+
+  // The workload a single run is asked for
+  struct Params {
+    std::size_t rows;
+    Distribution distribution;
+    std::uint64_t seed;
+  };
+
+  // Measures the timed part of a run, leaving setup and teardown out
+  struct Timer {
+    template<typename F>
+    void measure(std::size_t ops, F &&f) {
+      auto const start = std::chrono::steady_clock::now();
+      std::forward<F>(f)();
+      elapsed += std::chrono::steady_clock::now() - start;
+      this->ops += ops;
+    }
+
+    // Folds a result into the checksum, so the work producing it can't be
+    // optimized away, and so runs can be compared for doing the same work
+    template<typename T>
+    void consume(T const &value) {
+      checksum = checksum * 31 + static_cast<std::uint64_t>(value);
+    }
+
+    std::chrono::steady_clock::duration elapsed{};
+    std::size_t ops = 0;
+    std::uint64_t checksum = 0;
+  };
+
+  template<typename T>
+  struct Type { using type = T; };
+
+  template<typename T>
+  struct TypeName;
+
+  template<typename ...Ts>
+  struct Types { };
+
+  struct Benchmark {
+    std::string name, type;
+    std::function<void(Params const &, Timer &)> run;
+  };
+
+  inline std::vector<Benchmark> &registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+  }
+
+  // Registers run for every type in Types. run is called as
+  // run(Type<Entry>{}, params, timer).
+  struct Register {
+    template<typename ...Entries, typename F>
+    Register(char const *name, Types<Entries...>, F run) {
+      (registry().push_back({ name, TypeName<Entries>{}(), [run](Params const &params, Timer &timer) {
+        run(Type<Entries>{}, params, timer);
+      } }), ...);
+    }
+  };
+
+  namespace Detail {
+    struct Result {
+      Benchmark const *benchmark;
+      Params params;
+      std::size_t ops;
+      double minNs, medianNs;
+      std::uint64_t checksum;
+    };
+
+    inline std::vector<std::string> split(std::string const &list) {
+      std::vector<std::string> ret;
+      std::size_t start = 0;
+      for (std::size_t end; (end = list.find(',', start)) != std::string::npos; start = end + 1) {
+        ret.emplace_back(list.substr(start, end - start));
+      }
+      ret.emplace_back(list.substr(start));
+      return ret;
+    }
+
+    inline void printJson(std::vector<Result> const &results) {
+      std::cout << "{\n  \"benchmarks\": [";
+      for (std::size_t i = 0; i < results.size(); ++i) {
+        auto const &r = results[i];
+        std::cout << (i ? ",\n" : "\n")
+                  << "    {\"name\": \"" << r.benchmark->name << "\""
+                  << ", \"type\": \"" << r.benchmark->type << "\""
+                  << ", \"distribution\": \"" << name(r.params.distribution) << "\""
+                  << ", \"rows\": " << r.params.rows
+                  << ", \"ops\": " << r.ops
+                  << ", \"ns_per_op_min\": " << r.minNs
+                  << ", \"ns_per_op_median\": " << r.medianNs
+                  << ", \"checksum\": " << r.checksum << "}";
+      }
+      std::cout << "\n  ]\n}\n";
+    }
+
+    inline void printText(std::vector<Result> const &results) {
+      for (auto const &r : results) {
+        std::cout << r.benchmark->name << " [" << r.benchmark->type << ", " << name(r.params.distribution)
+                  << ", " << r.params.rows << " rows]: " << r.medianNs << " ns/op (min "
+                  << r.minNs << ", " << r.ops << " ops)\n";
+      }
+    }
+  }
+
+  // Usage: benchmarks [--rows=1024,65536] [--distributions=uniform,zipf,duplicates]
+  //                   [--filter=name] [--repetitions=5] [--seed=42] [--format=json|text]
+  inline int main(int argc, char **argv) {
+    std::vector<std::size_t> rows{ 1 << 10, 1 << 16 };
+    std::vector<Distribution> distributions{ Distribution::Uniform, Distribution::Zipf, Distribution::Duplicates };
+    std::string filter, format = "json";
+    int repetitions = 5;
+    std::uint64_t seed = 42;
+
+    for (int i = 1; i < argc; ++i) {
+      std::string const arg = argv[i];
+      auto const eq = arg.find('=');
+      auto const key = arg.substr(0, eq), value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+      if (key == "--rows") {
+        rows.clear();
+        for (auto &r : Detail::split(value)) {
+          rows.emplace_back(std::strtoull(r.c_str(), nullptr, 10));
+        }
+      }
+      else if (key == "--distributions") {
+        distributions.clear();
+        for (auto &d : Detail::split(value)) {
+          for (auto candidate : { Distribution::Uniform, Distribution::Zipf, Distribution::Duplicates }) {
+            if (d == name(candidate)) {
+              distributions.emplace_back(candidate);
+            }
+          }
+        }
+      }
+      else if (key == "--filter") {
+        filter = value;
+      }
+      else if (key == "--repetitions") {
+        repetitions = std::max(1, std::atoi(value.c_str()));
+      }
+      else if (key == "--seed") {
+        seed = std::strtoull(value.c_str(), nullptr, 10);
+      }
+      else if (key == "--format" && (value == "json" || value == "text")) {
+        format = value;
+      }
+      else {
+        std::cerr << "Unknown option " << arg << "\n";
+        return 1;
+      }
+    }
+
+    std::vector<Detail::Result> results;
+    for (auto const &benchmark : registry()) {
+      if ((benchmark.name + " " + benchmark.type).find(filter) == std::string::npos) {
+        continue;
+      }
+
+      for (auto r : rows) {
+        for (auto distribution : distributions) {
+          Params const params{ r, distribution, seed };
+          std::vector<double> ns;
+          Timer timer;
+          for (int i = 0; i < repetitions; ++i) {
+            timer = {};
+            benchmark.run(params, timer);
+            auto const elapsed = std::chrono::duration<double, std::nano>(timer.elapsed).count();
+            ns.emplace_back(elapsed / static_cast<double>(std::max<std::size_t>(timer.ops, 1)));
+          }
+
+          std::sort(ns.begin(), ns.end());
+          results.push_back({ &benchmark, params, timer.ops, ns.front(), ns[ns.size() / 2], timer.checksum });
+        }
+      }
+    }
+
+    if (format == "json") {
+      Detail::printJson(results);
+    }
+    else {
+      Detail::printText(results);
+    }
+    return 0;
+  }
+}
@@ -0,0 +1,5 @@
+#include "Harness.hpp"
+
+int main(int argc, char **argv) {
+  return Bench::main(argc, argv);
+}
@@ -0,0 +1,112 @@
+#include "Workload.hpp"
+
+#include <type_traits>
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include <tuple>
+#include <set>
+
+// Compares a conjunction of ranges and a predicate against the loop one
+// would write by hand over an ordered index of the same rows, and the
+// complement of a range against testing every row
+namespace {
+  using Bench::Params;
+  using Bench::Timer;
+  using AllTypes = Bench::Types<std::tuple<int>, Point, SimpleUser>;
+
+  constexpr std::size_t queries = 256;
+  constexpr int repetitions = 20;
+
+  template<typename Entry>
+  bool even(Entry const &entry) {
+    return std::get<Bench::Rows<Entry>::part>(entry) % 2 == 0;
+  }
+
+  // Orders rows by the queried part, the way an Ordered index does
+  template<typename Entry>
+  struct ByPart {
+    using is_transparent = void;
+    static constexpr auto part = Bench::Rows<Entry>::part;
+    using Key = std::decay_t<std::tuple_element_t<part, Entry>>;
+
+    bool operator()(Entry const *l, Entry const *r) const { return std::get<part>(*l) < std::get<part>(*r); }
+    bool operator()(Entry const *l, Key const &r) const { return std::get<part>(*l) < r; }
+    bool operator()(Key const &l, Entry const *r) const { return l < std::get<part>(*r); }
+  };
+
+  Bench::Register fused{ "conjunction: range && range && pred", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    Bench::Filled<Entry> filled{ params };
+    auto const w = std::max(1, Bench::keySpace(params) / 64);
+    auto const bounds = Bench::keys(params, queries, 1);
+    std::size_t rows = 0;
+    timer.measure(queries, [&]() {
+      auto &table = filled.table;
+      for (auto lo : bounds) {
+        table.template range<part>(lo, lo + 2 * w) && table.template range<part>(lo + w, lo + 3 * w)
+          && table.pred([](Entry const &entry) { return even(entry); }) >>= [&](Entry const &) {
+          ++rows;
+        };
+      }
+    });
+    timer.consume(rows);
+  } };
+
+  Bench::Register handWritten{ "conjunction: hand-written loop", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    using Key = std::decay_t<std::tuple_element_t<part, Entry>>;
+
+    Bench::Filled<Entry> filled{ params };
+    std::multiset<Entry const *, ByPart<Entry>> index(filled.rows.begin(), filled.rows.end());
+    auto const w = std::max(1, Bench::keySpace(params) / 64);
+    auto const bounds = Bench::keys(params, queries, 1);
+    std::size_t rows = 0;
+    timer.measure(queries, [&]() {
+      for (auto lo : bounds) {
+        for (auto it = index.lower_bound(Key(lo + w)), end = index.upper_bound(Key(lo + 2 * w)); it != end; ++it) {
+          rows += even(**it);
+        }
+      }
+    });
+    timer.consume(rows);
+  } };
+
+  // Half of the key space left out, read either side of it from the index
+  // or by testing every row
+  Bench::Register complement{ "negation: !range", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    Bench::Filled<Entry> filled{ params };
+    auto const half = Bench::keySpace(params) / 2;
+    std::size_t rows = 0;
+    timer.measure(repetitions, [&]() {
+      for (int i = 0; i < repetitions; ++i) {
+        !filled.table.template range<part>(half / 2, half / 2 + half) >>= [&](Entry const &) {
+          ++rows;
+        };
+      }
+    });
+    timer.consume(rows);
+  } };
+
+  Bench::Register complementScan{ "negation: scan", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    Bench::Filled<Entry> filled{ params };
+    auto const half = Bench::keySpace(params) / 2;
+    std::size_t rows = 0;
+    timer.measure(repetitions, [&]() {
+      for (int i = 0; i < repetitions; ++i) {
+        filled.table.all() && filled.table.pred([&](Entry const &entry) {
+          return std::get<part>(entry) < half / 2 || half / 2 + half < std::get<part>(entry);
+        }) >>= [&](Entry const &) {
+          ++rows;
+        };
+      }
+    });
+    timer.consume(rows);
+  } };
+}
@@ -0,0 +1,182 @@
+#include "Workload.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <cstddef>
+#include <random>
+#include <vector>
+#include <tuple>
+
+// The basic Table operations, each timed over a whole table of rows
+namespace {
+  using Bench::Params;
+  using Bench::Timer;
+  using AllTypes = Bench::Types<std::tuple<int>, Point, SimpleUser>;
+  using SerializableTypes = Bench::Types<std::tuple<int>, SimpleUser>;
+
+  // The number of queries the query benchmarks run
+  constexpr std::size_t queries = 256;
+
+  // Query bounds from the same distribution as the rows
+  std::vector<int> bounds(Params const &params) {
+    return Bench::keys(params, queries, 1);
+  }
+
+  int width(Params const &params) {
+    return std::max(1, Bench::keySpace(params) / 64);
+  }
+
+  template<typename Entry, typename Expr>
+  std::size_t count(Expr &&expr) {
+    std::size_t ret = 0;
+    std::forward<Expr>(expr) >>= [&](Entry const &) {
+      ++ret;
+    };
+    return ret;
+  }
+
+  Bench::Register emplace{ "emplace", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    auto entries = Bench::entries<Entry>(params);
+    CQL::Table<Entry> table;
+    timer.measure(entries.size(), [&]() {
+      for (auto &entry : entries) {
+        table.emplace(std::move(entry));
+      }
+    });
+    timer.consume(table.size());
+  } };
+
+  Bench::Register lookup{ "lookup", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    Bench::Filled<Entry> filled{ params };
+    auto const probes = Bench::keys(params, params.rows, 1);
+    std::size_t found = 0;
+    timer.measure(probes.size(), [&]() {
+      for (auto key : probes) {
+        found += filled.table.template lookup<part>(key) != nullptr;
+      }
+    });
+    timer.consume(found);
+  } };
+
+  Bench::Register range{ "range", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    Bench::Filled<Entry> filled{ params };
+    auto const w = width(params);
+    std::size_t rows = 0;
+    timer.measure(queries, [&]() {
+      for (auto lo : bounds(params)) {
+        rows += count<Entry>(filled.table.template range<part>(lo, lo + w));
+      }
+    });
+    timer.consume(rows);
+  } };
+
+  Bench::Register conjunction{ "range && range", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    Bench::Filled<Entry> filled{ params };
+    auto const w = width(params);
+    std::size_t rows = 0;
+    timer.measure(queries, [&]() {
+      for (auto lo : bounds(params)) {
+        auto &table = filled.table;
+        rows += count<Entry>(table.template range<part>(lo, lo + 2 * w) && table.template range<part>(lo + w, lo + 3 * w));
+      }
+    });
+    timer.consume(rows);
+  } };
+
+  Bench::Register disjunction{ "range || range", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    Bench::Filled<Entry> filled{ params };
+    auto const w = width(params);
+    std::size_t rows = 0;
+    timer.measure(queries, [&]() {
+      for (auto lo : bounds(params)) {
+        auto &table = filled.table;
+        rows += count<Entry>(table.template range<part>(lo, lo + w) || table.template range<part>(lo + 2 * w, lo + 3 * w));
+      }
+    });
+    timer.consume(rows);
+  } };
+
+  Bench::Register update{ "update", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    Bench::Filled<Entry> filled{ params };
+    auto const values = Bench::keys(params, filled.rows.size(), 1);
+    std::size_t updated = 0;
+    timer.measure(filled.rows.size(), [&]() {
+      for (std::size_t i = 0; i < filled.rows.size(); ++i) {
+        updated += filled.table.template update<part>(filled.rows[i], values[i]);
+      }
+    });
+    timer.consume(updated);
+  } };
+
+  Bench::Register erase{ "erase", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    Bench::Filled<Entry> filled{ params };
+    std::shuffle(filled.rows.begin(), filled.rows.end(), std::mt19937_64{ params.seed });
+    timer.measure(filled.rows.size(), [&]() {
+      for (auto row : filled.rows) {
+        filled.table.erase(row);
+      }
+    });
+    timer.consume(filled.table.size());
+  } };
+
+  Bench::Register extract{ "extract", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    Bench::Filled<Entry> filled{ params };
+    std::shuffle(filled.rows.begin(), filled.rows.end(), std::mt19937_64{ params.seed });
+    long long sum = 0;
+    timer.measure(filled.rows.size(), [&]() {
+      for (auto row : filled.rows) {
+        sum += std::get<part>(*filled.table.extract(row));
+      }
+    });
+    timer.consume(sum);
+  } };
+
+  Bench::Register iterate{ "vbegin iteration", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    Bench::Filled<Entry> filled{ params };
+    long long sum = 0;
+    timer.measure(filled.table.size(), [&]() {
+      auto &table = filled.table;
+      for (auto it = table.template vbegin<part>(); it != table.template vend<part>(); ++it) {
+        sum += std::get<part>(*it);
+      }
+    });
+    timer.consume(sum);
+  } };
+
+  Bench::Register serialize{ "serialize", SerializableTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    Bench::Filled<Entry> filled{ params };
+    std::ostringstream os;
+    timer.measure(filled.table.size(), [&]() {
+      CQL::serialize(os, filled.table);
+    });
+    timer.consume(os.str().size());
+  } };
+
+  Bench::Register deserialize{ "deserialize", SerializableTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    std::stringstream ss;
+    CQL::serialize(ss, Bench::Filled<Entry>{ params }.table);
+    std::size_t rows = 0;
+    timer.measure(params.rows, [&]() {
+      rows = CQL::deserialize<CQL::Table<Entry>>(ss).size();
+    });
+    timer.consume(rows);
+  } };
+}
@@ -0,0 +1,77 @@
+#include "Workload.hpp"
+
+#include <cstddef>
+#include <vector>
+#include <tuple>
+
+// Compares writing a batch of rows into a filled table one call at a time
+// and through a single transaction commit. The batch is a quarter of the
+// table.
+namespace {
+  using Bench::Params;
+  using Bench::Timer;
+  using AllTypes = Bench::Types<std::tuple<int>, Point, SimpleUser>;
+
+  // Rows for the batch, numbered after the ones in the table
+  template<typename Entry>
+  std::vector<Entry> batch(Params const &params) {
+    auto const rows = params.rows;
+    auto entries = Bench::entries<Entry>({ rows + rows / 4, params.distribution, params.seed }, 1);
+    entries.erase(entries.begin(), entries.begin() + static_cast<std::ptrdiff_t>(rows));
+    return entries;
+  }
+
+  Bench::Register emplace{ "batch emplace: individual", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    Bench::Filled<Entry> filled{ params };
+    auto entries = batch<Entry>(params);
+    timer.measure(entries.size(), [&]() {
+      for (auto &entry : entries) {
+        filled.table.emplace(std::move(entry));
+      }
+    });
+    timer.consume(filled.table.size());
+  } };
+
+  Bench::Register emplaceTx{ "batch emplace: transaction", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    Bench::Filled<Entry> filled{ params };
+    auto entries = batch<Entry>(params);
+    timer.measure(entries.size(), [&]() {
+      auto tx = filled.table.transaction();
+      for (auto &entry : entries) {
+        tx.emplace(std::move(entry));
+      }
+      tx.commit();
+    });
+    timer.consume(filled.table.size());
+  } };
+
+  Bench::Register update{ "batch update: individual", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    Bench::Filled<Entry> filled{ params };
+    auto const values = Bench::keys(params, filled.rows.size() / 4, 1);
+    timer.measure(values.size(), [&]() {
+      for (std::size_t i = 0; i < values.size(); ++i) {
+        filled.table.template update<part>(filled.rows[i], values[i]);
+      }
+    });
+    timer.consume(filled.table.size());
+  } };
+
+  Bench::Register updateTx{ "batch update: transaction", AllTypes{}, [](auto type, Params const &params, Timer &timer) {
+    using Entry = typename decltype(type)::type;
+    constexpr auto part = Bench::Rows<Entry>::part;
+    Bench::Filled<Entry> filled{ params };
+    auto const values = Bench::keys(params, filled.rows.size() / 4, 1);
+    timer.measure(values.size(), [&]() {
+      auto tx = filled.table.transaction();
+      for (std::size_t i = 0; i < values.size(); ++i) {
+        tx.template update<part>(filled.rows[i], values[i]);
+      }
+      tx.commit();
+    });
+    timer.consume(filled.table.size());
+  } };
+}
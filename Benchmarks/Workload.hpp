@@ -0,0 +1,124 @@
+#pragma once
+
+#include "SimpleUser.hpp"
+#include "Harness.hpp"
+#include "Point.h"
+
+#include "CQL.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+#include <tuple>
+
+// The rows benchmarks work on, generated the same way for every entry
+// type: each row gets a key from the distribution, stored in part
+// Rows<Entry>::part, which is the part that the benchmarks query.
+namespace Bench {
+  template<> struct TypeName<std::tuple<int>> { std::string operator()() const { return "tuple<int>"; } };
+  template<> struct TypeName<Point> { std::string operator()() const { return "Point"; } };
+  template<> struct TypeName<SimpleUser> { std::string operator()() const { return "SimpleUser"; } };
+
+  template<typename Entry>
+  struct Rows;
+
+  template<>
+  struct Rows<std::tuple<int>> {
+    static constexpr std::size_t part = 0;
+
+    static std::tuple<int> make(std::size_t, int key, std::mt19937_64 &) {
+      return std::tuple<int>{ key };
+    }
+  };
+
+  template<>
+  struct Rows<Point> {
+    static constexpr std::size_t part = 0;
+
+    static Point make(std::size_t, int key, std::mt19937_64 &rng) {
+      return Point{ key, std::uniform_int_distribution<int>{ -1000, 1000 }(rng) };
+    }
+  };
+
+  template<>
+  struct Rows<SimpleUser> {
+    static constexpr std::size_t part = 2;
+
+    static SimpleUser make(std::size_t row, int key, std::mt19937_64 &) {
+      return SimpleUser(static_cast<int>(row), "user" + std::to_string(key), key);
+    }
+  };
+
+  // Keys are drawn from [0, keySpace(params))
+  inline int keySpace(Params const &params) {
+    constexpr int duplicateKeys = 16;
+    if (params.distribution == Distribution::Duplicates) {
+      return duplicateKeys;
+    }
+    return static_cast<int>(std::max<std::size_t>(params.rows, 1));
+  }
+
+  // count keys following the distribution of params. Different streams
+  // give different keys from the same distribution.
+  inline std::vector<int> keys(Params const &params, std::size_t count, std::uint64_t stream = 0) {
+    std::mt19937_64 rng{ params.seed * 1000003 + stream };
+    auto const space = keySpace(params);
+    std::vector<int> ret;
+    ret.reserve(count);
+
+    if (params.distribution == Distribution::Zipf) {
+      // The most common keys are spread over the key space, so that they
+      // don't all end up next to each other in the indexes
+      std::vector<int> ranked(static_cast<std::size_t>(space));
+      std::iota(ranked.begin(), ranked.end(), 0);
+      std::shuffle(ranked.begin(), ranked.end(), std::mt19937_64{ params.seed });
+
+      std::vector<double> cdf(ranked.size());
+      double sum = 0;
+      for (std::size_t k = 0; k < cdf.size(); ++k) {
+        cdf[k] = sum += 1.0 / static_cast<double>(k + 1);
+      }
+
+      std::uniform_real_distribution<double> dist{ 0, sum };
+      for (std::size_t i = 0; i < count; ++i) {
+        auto const k = std::lower_bound(cdf.begin(), cdf.end(), dist(rng)) - cdf.begin();
+        ret.emplace_back(ranked[static_cast<std::size_t>(std::min<std::ptrdiff_t>(k, space - 1))]);
+      }
+    }
+    else {
+      std::uniform_int_distribution<int> dist{ 0, space - 1 };
+      for (std::size_t i = 0; i < count; ++i) {
+        ret.emplace_back(dist(rng));
+      }
+    }
+    return ret;
+  }
+
+  template<typename Entry>
+  std::vector<Entry> entries(Params const &params, std::uint64_t stream = 0) {
+    std::mt19937_64 rng{ params.seed + stream };
+    std::vector<Entry> ret;
+    ret.reserve(params.rows);
+    for (auto key : keys(params, params.rows, stream)) {
+      ret.emplace_back(Rows<Entry>::make(ret.size(), key, rng));
+    }
+    return ret;
+  }
+
+  // A table holding params.rows rows, and pointers to them in insertion order
+  template<typename Entry>
+  struct Filled {
+    explicit Filled(Params const &params) {
+      for (auto &entry : Bench::entries<Entry>(params)) {
+        rows.emplace_back(table.emplace(std::move(entry)));
+      }
+    }
+
+    CQL::Table<Entry> table;
+    std::vector<Entry const *> rows;
+  };
+}
@@ -1,18 +1,90 @@
 #pragma once
 
+#include "CQL/OrderStatisticSet.hpp"
+#include "CQL/SpatialIndex.hpp"
+#include "CQL/BitmapIndex.hpp"
+#include "CQL/ColumnTable.hpp"
+#include "CQL/BloomFilter.hpp"
+#include "CQL/FlatHashMap.hpp"
+#include "CQL/Dictionary.hpp"
+#include "CQL/Checkpoint.hpp"
 #include "CQL/Serialize.hpp"
+#include "CQL/Aggregate.hpp"
+#include "CQL/Generator.hpp"
+#include "CQL/Metrics.hpp"
+#include "CQL/Profile.hpp"
+#include "CQL/RadixSet.hpp"
+#include "CQL/Columnar.hpp"
+#include "CQL/Memory.hpp"
 #include "CQL/Custom.hpp"
+#include "CQL/View.hpp"
 
 #include <unordered_set>
+#include <string_view>
 #include <type_traits>
+#include <functional>
+#include <exception>
 #include <algorithm>
+#include <iterator>
+#include <optional>
 #include <cstddef>
 #include <utility>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <array>
 #include <tuple>
 #include <set>
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
 namespace CQL {
+  namespace Detail {
+    inline void prefetch(void const *addr) {
+#if defined(__GNUC__) || defined(__clang__)
+      __builtin_prefetch(addr);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+      _mm_prefetch(static_cast<char const *>(addr), _MM_HINT_T0);
+#else
+      (void)addr;
+#endif
+    }
+  }
+
+  namespace Detail {
+    // Stands in for the index of a part with Indexing::None
+    struct NoIndex {
+      std::size_t memoryUsage() const { return 0; }
+    };
+
+    template<typename Index, typename = void>
+    struct HasMemoryUsage : std::false_type { };
+
+    template<typename Index>
+    struct HasMemoryUsage<Index, std::void_t<decltype(std::declval<Index const &>().memoryUsage())>> : std::true_type { };
+
+    // The bytes an index holds. The std::sets count them in their allocator.
+    template<typename Index>
+    std::size_t memoryUsage(Index const &index) {
+      if constexpr(HasMemoryUsage<Index>::value) {
+        return index.memoryUsage();
+      }
+      else {
+        return index.get_allocator().allocated();
+      }
+    }
+
+    template<typename Index, typename = void>
+    struct HasEmplaceHint : std::false_type { };
+
+    template<typename Index>
+    struct HasEmplaceHint<Index, std::void_t<decltype(std::declval<Index &>().emplace_hint(
+      std::declval<Index &>().end(), std::declval<typename Index::value_type>()))>> : std::true_type { };
+  }
+
   template<typename T, bool Instantiate>
   struct ConditionalVar { T val; };
 
@@ -20,17 +92,65 @@ namespace CQL {
   struct ConditionalVar<T, false> { };
 
   template<typename T> // This exists in C++20, use std::remove_cvref ASAP.
-  struct remove_cvref { typedef std::remove_cv<std::remove_reference_t<T>> type; };
+  struct remove_cvref { typedef std::remove_cv_t<std::remove_reference_t<T>> type; };
 
   template<typename T>
   using remove_cvref_v = typename remove_cvref<T>::type;
 
+  enum class JoinStrategy {
+    Auto,
+    IndexNestedLoop,
+    Merge,
+    Hash,
+  };
+
   template<typename Entry>
   struct Table {
     Table() = default;
 
+    template<std::size_t N>
+    using Key = remove_cvref_v<std::tuple_element_t<N, Entry>>;
+
   private:
     struct AndOperation; struct OrOperation;
+
+    static constexpr auto spatialParts = Custom::SpatialLookup<Entry>{}();
+    static constexpr bool hasSpatial = spatialParts.first < std::tuple_size_v<Entry>;
+    using Spatial = SpatialIndex<Entry, spatialParts.first, spatialParts.second>;
+
+    template<std::size_t Idx>
+    static constexpr bool isFiltered =
+      !std::is_base_of_v<Custom::Unfiltered, Custom::IndexFilter<Entry, Idx>>;
+
+    template<std::size_t Idx>
+    static constexpr bool isNone = Custom::Index<Entry, Idx>{}() == Custom::Indexing::None;
+
+    template<std::size_t Idx>
+    static constexpr bool isLazy = Custom::Index<Entry, Idx>{}() == Custom::Indexing::Lazy;
+
+    // Whether index Idx holds every entry, so that it can answer queries
+    // about the whole table
+    template<std::size_t Idx>
+    static constexpr bool indexesAll = !isFiltered<Idx> && !isNone<Idx>;
+
+    // Whether index Idx holds every entry from the moment it is inserted
+    template<std::size_t Idx>
+    static constexpr bool alwaysIndexed = indexesAll<Idx> && !isLazy<Idx>;
+
+    static constexpr bool hasMetrics = Custom::Metrics<Entry>{}();
+
+    static constexpr std::size_t expiryPart = Custom::Expiry<Entry>{}();
+
+    template<std::size_t Idx>
+    static bool inIndex(Entry const &entry) {
+      if constexpr(isFiltered<Idx>) {
+        return Custom::IndexFilter<Entry, Idx>{}(entry);
+      }
+      else {
+        return true;
+      }
+    }
+
   public:
 #define ExprOperators                                                  \
     template<typename Expr>                                            \
@@ -53,21 +173,107 @@ namespace CQL {
     template<typename Expr>                                            \
     auto operator||(Expr &&other) & {                                  \
       return makeExpr<OrOperation>(*this, std::forward<Expr>(other));  \
+    }                                                                  \
+                                                                       \
+    template<typename Expr>                                            \
+    auto operator-(Expr &&other) {                                     \
+      return makeDifference(*this, std::forward<Expr>(other));         \
+    }                                                                  \
+                                                                       \
+    auto operator!() {                                                 \
+      return makeNegation(*this);                                      \
     }
 
 #define ForEachOperator                                                \
     template<typename F>                                               \
     auto operator>>=(F functor) { return forEach(functor); }
 
+#define GroupByOperator                                                \
+    template<std::size_t N, typename ...Aggs>                          \
+    auto groupBy(Aggs...) && {                                         \
+      return GroupBy<remove_cvref_v<decltype(*this)>, N, Aggs...>{     \
+        std::move(*this)                                               \
+      };                                                               \
+    }                                                                  \
+                                                                       \
+    template<std::size_t N, typename ...Aggs>                          \
+    auto groupBy(Aggs...) & {                                          \
+      return GroupBy<remove_cvref_v<decltype(*this)>, N, Aggs...>{     \
+        remove_cvref_v<decltype(*this)>{ *this }                       \
+      };                                                               \
+    }
+
+#define ProfiledLeaf(name)                                             \
+    template<typename F>                                               \
+    void profiledForEach(F functor, QueryProfile &profile) const {     \
+      profileLeaf(name, *this, functor, profile);                      \
+    }
+
     template<typename F>
     struct Predicate {
-      Predicate(F &&f) : f{ f } { }
+      Predicate(F &&f, Table const &table) : f{ f }, table{ table } { }
       bool operator()(Entry const &entry) { return f(entry); }
 
       ExprOperators
 
     private:
+      friend struct Table;
+
       F f;
+      Table const &table;
+    };
+
+    // An expression tested as the right hand side of &&. Unlike a lambda
+    // around it, its type tells runConjunction() what it is testing.
+    template<typename Expr>
+    struct Conjunct {
+      bool operator()(Entry const &entry) { return expr(entry); }
+
+      Expr expr;
+    };
+
+    // The entries Inner doesn't hold, for expressions that can only be
+    // negated by testing every entry of the table
+    template<typename Inner>
+    struct Negated {
+      Negated(Inner const &expr, Table const &table) : expr{ expr }, table{ table } { }
+
+      template<typename F>
+      void forEach(F functor) {
+        for (auto &entry : table.defaultLookup()) {
+          if (!expr(*entry)) {
+            functor(*entry);
+          }
+        }
+      }
+
+      template<typename F>
+      void profiledForEach(F functor, QueryProfile &profile) {
+        profile.node = "Negated";
+        Detail::Stopwatch watch{ profile };
+        for (auto &entry : table.defaultLookup()) {
+          ++profile.indexEntries;
+          ++profile.predicateCalls;
+          if (!expr(*entry)) {
+            watch.yield(functor, *entry);
+          }
+        }
+      }
+
+      bool operator()(Entry const &entry) { return !expr(entry); }
+
+      template<std::size_t N>
+      static constexpr bool canOrderBy = false;
+
+      ExprOperators
+      ForEachOperator
+      GroupByOperator
+
+    private:
+      friend struct Table;
+
+      Inner expr;
+      Table const &table;
     };
 
     template<typename RangeL, typename RangeR>
@@ -87,14 +293,39 @@ namespace CQL {
         });
       }
 
+      template<typename F>
+      void profiledForEach(F functor, QueryProfile &profile) {
+        profile.node = "RangeUnion";
+        profile.children.resize(2);
+        Detail::Stopwatch watch{ profile };
+        profileNode(rl, [&](Entry const &entry) {
+          ++profile.rowsIn;
+          watch.yield(functor, entry);
+        }, profile.children[0]);
+
+        profileNode(rr, [&](Entry const &entry) {
+          ++profile.rowsIn;
+          ++profile.predicateCalls;
+          if (!rl(entry)) {
+            watch.yield(functor, entry);
+          }
+        }, profile.children[1]);
+      }
+
       bool operator()(Entry const &other) const {
         return rl(other) || rr(other);
       }
 
+      template<std::size_t N>
+      static constexpr bool canOrderBy = false;
+
       ExprOperators
       ForEachOperator
+      GroupByOperator
 
     private:
+      friend struct Table;
+
       RangeL rl;
       RangeR rr;
     };
@@ -109,7 +340,27 @@ namespace CQL {
 
       template<typename F>
       void forEach(F functor) {
-        range.forEach([&](Entry const &entry) {
+        runConjunction(*this, functor);
+      }
+
+      // Profiled as the loop forEach() runs, with a child for every
+      // operand of the &&s
+      template<typename F>
+      void profiledForEach(F functor, QueryProfile &profile) {
+        profile.node = "FilteredRangeExpr";
+        Detail::Stopwatch watch{ profile };
+        auto out = [&](Entry const &entry) {
+          watch.yield(functor, entry);
+        };
+        runConjunction(*this, out, &profile);
+      }
+
+      template<std::size_t N>
+      static constexpr bool canOrderBy = Range::template canOrderBy<N>;
+
+      template<std::size_t N, typename F>
+      void forEachOrderedBy(F functor) {
+        range.template forEachOrderedBy<N>([&](Entry const &entry) {
           if (predicate(entry)) {
             functor(entry);
           }
@@ -118,8 +369,11 @@ namespace CQL {
 
       ExprOperators
       ForEachOperator
+      GroupByOperator
 
     private:
+      friend struct Table;
+
       Range range;
       Pred predicate;
     };
@@ -136,6 +390,31 @@ namespace CQL {
         return *this;
       }
 
+      // O(log n) on OrderStatistic indexes, linear otherwise
+      Iterator &operator+=(std::ptrdiff_t n) {
+        if constexpr(Detail::isOrderStatisticIterator<It>) {
+          setIt += n;
+        }
+        else {
+          std::advance(setIt, n);
+        }
+        return *this;
+      }
+
+      Iterator &operator-=(std::ptrdiff_t n) {
+        return *this += -n;
+      }
+
+      Iterator operator+(std::ptrdiff_t n) const {
+        auto ret = *this;
+        return ret += n;
+      }
+
+      Iterator operator-(std::ptrdiff_t n) const {
+        auto ret = *this;
+        return ret -= n;
+      }
+
       Entry const &operator*() const {
         return **setIt;
       }
@@ -165,310 +444,1968 @@ namespace CQL {
 
     template<std::size_t Ind, typename Lt, typename Ht, typename Tt>
     struct Range {
-      Range(Lt &&lo, Ht &&hi, Tt const &tbl):
-        lo{ std::forward<Lt>(lo) }, hi{ std::forward<Ht>(hi) }, tbl{tbl} { }
+      Range(Lt &&lo, Ht &&hi, Tt const &tbl, ConditionalVar<Detail::PartCounters *, hasMetrics> counters, Table const &table):
+        lo{ std::forward<Lt>(lo) }, hi{ std::forward<Ht>(hi) }, tbl{tbl}, counters{ counters }, table{ table } { }
 
       template<typename F>
       void forEach(F functor) const {
-        for (auto it = tbl.lower_bound(lo); it != tbl.upper_bound(hi); ++it) {
+        if (hi < lo) {
+          return;
+        }
+
+        [[maybe_unused]] auto const measured = measure(counters, &Detail::PartCounters::ranges);
+
+        for (auto it = tbl.lower_bound(lo), end = tbl.upper_bound(hi); it != end; ++it) {
           functor(**it);
         }
       }
 
       bool operator()(Entry const &other) const {
         return lo <= std::get<Ind>(other)
-                  && std::get<Ind>(other) <= hi;
+                  && std::get<Ind>(other) <= hi
+                  && inIndex<Ind>(other);
+      }
+
+      template<std::size_t N>
+      static constexpr bool canOrderBy = N == Ind;
+
+      template<std::size_t N, typename F>
+      void forEachOrderedBy(F functor) const {
+        static_assert(N == Ind);
+        forEach(functor);
       }
 
       ExprOperators
       ForEachOperator
+      ProfiledLeaf("Range<" + std::to_string(Ind) + ">")
+      GroupByOperator
+
+      static constexpr std::size_t part = Ind;
 
     private:
-      std::tuple_element_t<Ind, Entry> const lo, hi;
+      friend struct Table;
+
+      Key<Ind> const lo, hi;
       Tt &tbl;
+      ConditionalVar<Detail::PartCounters *, hasMetrics> counters;
+      Table const &table;
     };
 
+    // All entries of index Ind outside of [lo, hi], read as the two spans
+    // of the index on either side of the range
     template<std::size_t Ind, typename Tt>
-    struct EntireTable {
-      EntireTable(Tt const &tbl):
-        tbl{tbl} { }
+    struct Complement {
+      Complement(Key<Ind> const &lo, Key<Ind> const &hi, Tt const &tbl, ConditionalVar<Detail::PartCounters *, hasMetrics> counters,
+                 Table const &table):
+        lo{ lo }, hi{ hi }, tbl{ tbl }, counters{ counters }, table{ table } { }
 
       template<typename F>
       void forEach(F functor) const {
-        for (auto &v : tbl) {
-          functor(*v);
+        [[maybe_unused]] auto const measured = measure(counters, &Detail::PartCounters::ranges);
+
+        if (hi < lo) {
+          for (auto &v : tbl) {
+            functor(*v);
+          }
+          return;
+        }
+
+        for (auto it = tbl.begin(), end = tbl.lower_bound(lo); it != end; ++it) {
+          functor(**it);
+        }
+        for (auto it = tbl.upper_bound(hi); it != tbl.end(); ++it) {
+          functor(**it);
         }
       }
 
       bool operator()(Entry const &other) const {
-        return true;
+        return std::get<Ind>(other) < lo || hi < std::get<Ind>(other);
+      }
+
+      template<std::size_t N>
+      static constexpr bool canOrderBy = N == Ind;
+
+      template<std::size_t N, typename F>
+      void forEachOrderedBy(F functor) const {
+        static_assert(N == Ind);
+        forEach(functor);
       }
 
       ExprOperators
       ForEachOperator
+      ProfiledLeaf("Complement<" + std::to_string(Ind) + ">")
+      GroupByOperator
 
     private:
-      Tt const &tbl;
+      friend struct Table;
+
+      Key<Ind> const lo, hi;
+      Tt &tbl;
+      ConditionalVar<Detail::PartCounters *, hasMetrics> counters;
+      Table const &table;
     };
 
-#undef ForEachOperator
-#undef ExprOperators
+    // All entries where std::get<Ind>(entry) starts with prefix. Radix
+    // indexes find them with a single descent, other indexes scan forward
+    // from the prefix itself.
+    template<std::size_t Ind, typename Tt>
+    struct Prefix {
+      Prefix(std::string &&prefix, Tt const &tbl, Table const &table):
+        prefix{ std::move(prefix) }, tbl{ tbl }, table{ table } { }
 
-    Entry const *emplace(std::unique_ptr<Entry> &&e) {
-      if (shouldInsert<0>(e)) {
-        auto ret = e.get();
-        if constexpr(Custom::DefaultLookup<Entry>{}() == std::tuple_size_v<Entry>) {
-          updateAll<0>(e.get());
-          defaultLUT.val.emplace(std::forward<decltype(e)>(e));
+      template<typename F>
+      void forEach(F functor) const {
+        if constexpr(isRadix<Ind>) {
+          for (auto[it, end] = tbl.equal_prefix(prefix); it != end; ++it) {
+            functor(**it);
+          }
         }
         else {
-          updateAll<0>(std::forward<decltype(e)>(e));
+          for (auto it = tbl.lower_bound(std::string_view{ prefix }); it != tbl.end() && matches(**it); ++it) {
+            functor(**it);
+          }
         }
-        return ret;
       }
-      return nullptr;
-    }
-
-    template<typename ...Args>
-    Entry const *emplace(Args &&...args) {
-      auto ptr = std::make_unique<Entry>(std::forward<Args>(args)...);
-      return emplace(std::move(ptr));
-    }
 
-    void erase(Entry const *entry) {
-      eraseAll<0>(entry);
-      if constexpr(Custom::DefaultLookup<Entry>{}() == std::tuple_size_v<Entry>) {
-        defaultLUT.val.erase(defaultLUT.val.find(entry));
+      bool operator()(Entry const &other) const {
+        return matches(other);
       }
-    }
 
-    auto begin() const {
-      auto it = defaultLookup().begin();
-      return Iterator<std::tuple_size<Entry>::value, decltype(it)>(std::move(it));
-    }
+      template<std::size_t N>
+      static constexpr bool canOrderBy = N == Ind;
 
-    auto end() const {
-      auto it = defaultLookup().end();
-      return Iterator<std::tuple_size<Entry>::value, decltype(it)>(std::move(it));
-    }
+      template<std::size_t N, typename F>
+      void forEachOrderedBy(F functor) const {
+        static_assert(N == Ind);
+        forEach(functor);
+      }
 
-    template<std::size_t Ind>
-    auto vbegin() const {
-      auto it = std::get<Ind>(luts).begin();
-      return Iterator<Ind, decltype(it)>(std::move(it));
-    }
+      ExprOperators
+      ForEachOperator
+      ProfiledLeaf("Prefix<" + std::to_string(Ind) + ">")
+      GroupByOperator
 
-    template<std::size_t Ind>
-    auto rvbegin() const {
-      auto it = std::get<Ind>(luts).rbegin();
-      return Iterator<Ind, decltype(it)>(std::move(it));
-    }
+    private:
+      friend struct Table;
 
-    template<std::size_t Ind>
-    auto vend() const {
-      auto it = std::get<Ind>(luts).end();
-      return Iterator<Ind, decltype(it)>(std::move(it));
-    }
+      bool matches(Entry const &entry) const {
+        return std::string_view{ std::get<Ind>(entry) }.substr(0, prefix.size()) == prefix;
+      }
 
-    template<std::size_t Ind>
-    auto rvend() const {
-      auto it = std::get<Ind>(luts).rend();
-      return Iterator<Ind, decltype(it)>(std::move(it));
-    }
+      std::string prefix;
+      Tt const &tbl;
+      Table const &table;
+    };
 
-    template<std::size_t Ind, typename T>
-    auto erase(Iterator<Ind, T> &it) {
-      if constexpr(Ind == std::tuple_size<Entry>::value) {
-        eraseAll<0>(*(it.setIt));
-        return Iterator<Ind, T>(defaultLUT.val.erase(it.setIt));
+    // All entries where std::get<Ind>(entry) is one of keys, found in a
+    // single ordered pass over the index
+    template<std::size_t Ind, typename Tt>
+    struct InList {
+      InList(std::vector<Key<Ind>> &&keys, Tt const &tbl, Table const &table):
+        keys{ std::move(keys) }, tbl{ tbl }, table{ table } {
+        std::sort(this->keys.begin(), this->keys.end());
+        this->keys.erase(std::unique(this->keys.begin(), this->keys.end()), this->keys.end());
       }
-      else {
-        if constexpr(Custom::DefaultLookup<Entry>{}() == std::tuple_size_v<Entry>) {
-          defaultLUT.val.erase(*(it.setIt));
+
+      template<typename F>
+      void forEach(F functor) const {
+        auto it = tbl.begin();
+        for (auto &key : keys) {
+          it = seek<Ind>(tbl, it, key);
+          for (; it != tbl.end() && !Compare<Ind>{}(key, *it); ++it) {
+            functor(**it);
+          }
         }
-        return eraseIt<std::tuple_size<Entry>::value, Ind>(it);
       }
-    }
 
-    std::size_t size() const {
-      return defaultLookup().size();
-    }
+      bool operator()(Entry const &other) const {
+        return std::binary_search(keys.begin(), keys.end(), std::get<Ind>(other));
+      }
 
-    bool empty() const {
-      return defaultLookup().empty();
-    }
+      template<std::size_t N>
+      static constexpr bool canOrderBy = N == Ind;
 
-    void clear() {
-      clearAll<0>();
-      if constexpr(Custom::DefaultLookup<Entry>{}() == std::tuple_size_v<Entry>) {
-        defaultLUT.val.clear();
+      template<std::size_t N, typename F>
+      void forEachOrderedBy(F functor) const {
+        static_assert(N == Ind);
+        forEach(functor);
       }
-    }
 
-    std::unique_ptr<Entry> extract(Entry const *entry) {
-      auto ptr = std::move(defaultLookup().extract(defaultLookup().find(entry)).value());
-      eraseAll<0>(ptr.get());
-      return ptr;
-    }
+      ExprOperators
+      ForEachOperator
+      ProfiledLeaf("InList<" + std::to_string(Ind) + ">")
+      GroupByOperator
 
-    template<std::size_t N, typename T>
-    Entry const *lookup(T const &val) {
-      Entry const *ret = nullptr;
-      if (auto it = std::get<N>(luts).find(val); it != std::get<N>(luts).end()) {
-        if constexpr(CQL::Custom::DefaultLookup<Entry>{}() == N) {
-          ret = it->get();
-        }
-        else {
-          ret = *it;
-        }
+    private:
+      friend struct Table;
+
+      std::vector<Key<Ind>> keys;
+      Tt const &tbl;
+      Table const &table;
+    };
+
+    // All entries whose row id is in a bitmap, from queries on Bitmap
+    // indexes. Combining two of these with && or || intersects or unites
+    // the bitmaps instead of filtering one query with the other.
+    struct BitmapExpr {
+      BitmapExpr(Bitmap &&rows, RowIds<Entry> const &ids, Table const &table):
+        rows{ std::move(rows) }, ids{ ids }, table{ table } { }
+
+      template<typename F>
+      void forEach(F functor) const {
+        rows.forEach([&](std::uint32_t id) {
+          functor(*ids.row(id));
+        });
       }
 
-      return ret;
-    }
+      bool operator()(Entry const &entry) const {
+        auto const id = ids.id(&entry);
+        return id != RowIds<Entry>::none && rows.contains(id);
+      }
 
-    // Returns false if the value already exists in a table where enforced uniqueness exists
-    template<std::size_t N, typename T>
-    bool update(Entry const *entry, T &&newVal) {
-      if constexpr(Custom::Unique<Entry, N>{}() == Custom::Uniqueness::EnforceUnique) {
-        if (auto f = std::get<N>(luts).find(newVal); f != std::get<N>(luts).end() && &**f != entry) {
-          return false;
-        }
-        else if (&**f == entry) {
-          return true;
-        }
+      std::size_t count() const {
+        return rows.size();
       }
 
-      auto dbEntry = std::move(moveOutOfTable<N>(entry).value());
-      std::get<N>(*dbEntry) = std::forward<T>(newVal);
-      std::get<N>(luts).emplace(std::move(dbEntry));
-      return true;
-    }
+      template<std::size_t N>
+      static constexpr bool canOrderBy = false;
 
-    template<std::size_t N, std::size_t OtherN, typename T, typename ItT>
-    bool update(Iterator<OtherN, ItT> const &entry, T &&newVal) {
-      if constexpr(N == OtherN) {
+      ExprOperators
+      ForEachOperator
+      ProfiledLeaf("BitmapExpr")
+      GroupByOperator
+
+    private:
+      friend struct Table;
+
+      Bitmap rows;
+      RowIds<Entry> const &ids;
+      Table const &table;
+    };
+
+    // All entries inside a box on the parts named by Custom::SpatialLookup,
+    // walked off the spatial index instead of scanning a slab of one axis
+    template<typename S>
+    struct BoxExpr {
+      using X = typename S::XType;
+      using Y = typename S::YType;
+
+      BoxExpr(S const &index, X x0, Y y0, X x1, Y y1, Table const &table):
+        index{ index }, x0{ x0 }, y0{ y0 }, x1{ x1 }, y1{ y1 }, table{ table } { }
+
+      template<typename F>
+      void forEach(F functor) const {
+        index.forEachInBox(x0, y0, x1, y1, functor);
+      }
+
+      bool operator()(Entry const &entry) const {
+        auto const &x = std::get<spatialParts.first>(entry);
+        auto const &y = std::get<spatialParts.second>(entry);
+        return x0 <= x && x <= x1 && y0 <= y && y <= y1;
+      }
+
+      template<std::size_t N>
+      static constexpr bool canOrderBy = false;
+
+      ExprOperators
+      ForEachOperator
+      ProfiledLeaf("BoxExpr")
+      GroupByOperator
+
+    private:
+      friend struct Table;
+
+      S const &index;
+      X const x0;
+      Y const y0;
+      X const x1;
+      Y const y1;
+      Table const &table;
+    };
+
+    // The entries found by a nearest neighbour search, nearest first
+    struct NearestExpr {
+      NearestExpr(std::vector<Entry const *> &&rows, Table const &table): rows{ std::move(rows) }, table{ table } { }
+
+      template<typename F>
+      void forEach(F functor) const {
+        for (auto row : rows) {
+          functor(*row);
+        }
+      }
+
+      bool operator()(Entry const &entry) const {
+        return std::find(rows.begin(), rows.end(), &entry) != rows.end();
+      }
+
+      std::size_t count() const {
+        return rows.size();
+      }
+
+      template<std::size_t N>
+      static constexpr bool canOrderBy = false;
+
+      ExprOperators
+      ForEachOperator
+      ProfiledLeaf("NearestExpr")
+      GroupByOperator
+
+    private:
+      friend struct Table;
+
+      std::vector<Entry const *> rows;
+      Table const &table;
+    };
+
+    // All entries in index Ind, in its order. Only differs from all() on
+    // indexes with a Custom::IndexFilter, where these are the entries
+    // passing the filter.
+    template<std::size_t Ind, typename Tt>
+    struct IndexScan {
+      IndexScan(Tt const &tbl, Table const &table): tbl{ tbl }, table{ table } { }
+
+      template<typename F>
+      void forEach(F functor) const {
+        for (auto &v : tbl) {
+          functor(*v);
+        }
+      }
+
+      bool operator()(Entry const &other) const {
+        return inIndex<Ind>(other);
+      }
+
+      template<std::size_t N>
+      static constexpr bool canOrderBy = N == Ind;
+
+      template<std::size_t N, typename F>
+      void forEachOrderedBy(F functor) const {
+        static_assert(N == Ind);
+        forEach(functor);
+      }
+
+      ExprOperators
+      ForEachOperator
+      ProfiledLeaf("IndexScan<" + std::to_string(Ind) + ">")
+      GroupByOperator
+
+    private:
+      friend struct Table;
+
+      Tt const &tbl;
+      Table const &table;
+    };
+
+    template<std::size_t Ind, typename Tt>
+    struct EntireTable {
+      EntireTable(Tt const &tbl, Table const &table):
+        tbl{tbl}, table{table} { }
+
+      template<typename F>
+      void forEach(F functor) const {
+        for (auto &v : tbl) {
+          functor(*v);
+        }
+      }
+
+      bool operator()(Entry const &other) const {
+        return true;
+      }
+
+      template<std::size_t N>
+      static constexpr bool canOrderBy = N < std::tuple_size_v<Entry> && indexesAll<N>;
+
+      template<std::size_t N, typename F>
+      void forEachOrderedBy(F functor) const {
+        for (auto &v : table.template lut<N>()) {
+          functor(*v);
+        }
+      }
+
+      ExprOperators
+      ForEachOperator
+      ProfiledLeaf("EntireTable")
+      GroupByOperator
+
+    private:
+      friend struct Table;
+
+      Tt const &tbl;
+      Table const &table;
+    };
+
+    // Aggregates the entries of Expr per distinct value of column N and
+    // passes (key, results...) to the functor, one call per group.
+    // If Expr can be walked in the order of index N, groups are streamed
+    // straight off the index. Otherwise they are collected in a hash table,
+    // optionally split over several threads that each aggregate a part of
+    // the input before merging.
+    template<typename Expr, std::size_t N, typename ...Aggs>
+    struct GroupBy {
+      GroupBy(Expr &&expr) : expr{ std::forward<Expr>(expr) } { }
+
+      // Aggregate with up to this many threads when the input is large
+      GroupBy &parallel(std::size_t threads) {
+        this->threads = std::max<std::size_t>(threads, 1);
+        return *this;
+      }
+
+      template<typename F>
+      void forEach(F functor) {
+        if constexpr(Expr::template canOrderBy<N>) {
+          streamGroups(functor);
+        }
+        else {
+          hashGroups(functor);
+        }
+      }
+
+      ForEachOperator
+
+    private:
+      using Accumulators = std::tuple<typename Aggs::template Accumulator<Entry>...>;
+      using Groups = Detail::FlatHashMap<Key<N>, Accumulators>;
+
+      // Below this many rows per thread, spawning threads isn't worth it
+      static constexpr std::size_t minRowsPerThread = 1 << 14;
+
+      static void add(Accumulators &accs, Entry const &entry) {
+        std::apply([&](auto &...acc) { (acc.add(entry), ...); }, accs);
+      }
+
+      static void merge(Accumulators &accs, Accumulators const &other) {
+        mergeImpl(accs, other, std::index_sequence_for<Aggs...>{});
+      }
+
+      template<std::size_t ...Is>
+      static void mergeImpl(Accumulators &accs, Accumulators const &other, std::index_sequence<Is...>) {
+        (std::get<Is>(accs).merge(std::get<Is>(other)), ...);
+      }
+
+      template<typename F>
+      static void emit(F &functor, Key<N> const &key, Accumulators const &accs) {
+        std::apply([&](auto const &...acc) { functor(key, acc.result()...); }, accs);
+      }
+
+      template<typename F>
+      void streamGroups(F &functor) {
+        std::optional<Key<N>> current;
+        Accumulators accs;
+
+        expr.template forEachOrderedBy<N>([&](Entry const &entry) {
+          if (!current || *current < std::get<N>(entry)) {
+            if (current) {
+              emit(functor, *current, accs);
+            }
+            current = std::get<N>(entry);
+            accs = Accumulators{};
+          }
+          add(accs, entry);
+        });
+
+        if (current) {
+          emit(functor, *current, accs);
+        }
+      }
+
+      template<typename F>
+      void hashGroups(F &functor) {
+        Groups groups;
+
+        if (threads == 1) {
+          expr.forEach([&](Entry const &entry) {
+            add(groups[std::get<N>(entry)], entry);
+          });
+        }
+        else {
+          std::vector<Entry const *> rows;
+          expr.forEach([&](Entry const &entry) {
+            rows.emplace_back(&entry);
+          });
+
+          auto const parts = std::clamp<std::size_t>(rows.size() / minRowsPerThread, 1, threads);
+          auto const aggregate = [&](Groups &partial, std::size_t part) {
+            auto const begin = rows.size() * part / parts;
+            auto const end = rows.size() * (part + 1) / parts;
+            for (auto i = begin; i < end; ++i) {
+              add(partial[std::get<N>(*rows[i])], *rows[i]);
+            }
+          };
+
+          std::vector<Groups> partials(parts - 1);
+          std::vector<std::exception_ptr> errors(parts - 1);
+          {
+            // Joins the workers however this scope is left, as destroying
+            // a joinable thread terminates the program
+            struct Workers {
+              ~Workers() {
+                for (auto &worker : running) {
+                  worker.join();
+                }
+              }
+
+              std::vector<std::thread> running;
+            } workers;
+
+            for (std::size_t part = 1; part < parts; ++part) {
+              workers.running.emplace_back([&, part] {
+                try {
+                  aggregate(partials[part - 1], part);
+                }
+                catch (...) {
+                  errors[part - 1] = std::current_exception();
+                }
+              });
+            }
+            aggregate(groups, 0);
+          }
+
+          for (std::size_t part = 1; part < parts; ++part) {
+            if (errors[part - 1]) {
+              std::rethrow_exception(errors[part - 1]);
+            }
+            partials[part - 1].forEach([&](Key<N> const &key, Accumulators const &accs) {
+              merge(groups[key], accs);
+            });
+          }
+        }
+
+        groups.forEach([&](Key<N> const &key, Accumulators const &accs) {
+          emit(functor, key, accs);
+        });
+      }
+
+      Expr expr;
+      std::size_t threads = 1;
+    };
+
+    // Pairs every entry of LeftExpr with the entries of this table where
+    // std::get<LeftCol>(left) == std::get<RightCol>(right), see CQL::join.
+    template<std::size_t LeftCol, std::size_t RightCol, JoinStrategy Strategy, typename LeftExpr>
+    struct Join {
+      Join(LeftExpr &&left, Table const &right) : left{ std::forward<LeftExpr>(left) }, right{ right } { }
+
+      static constexpr JoinStrategy strategy =
+        Strategy != JoinStrategy::Auto ? Strategy
+        : !indexesAll<RightCol> ? JoinStrategy::Hash
+        : LeftExpr::template canOrderBy<LeftCol> ? JoinStrategy::Merge
+        : JoinStrategy::IndexNestedLoop;
+
+      static_assert(indexesAll<RightCol> || strategy == JoinStrategy::Hash,
+                    "Only hash joins can be done on a column with a filtered index");
+
+      template<typename F>
+      void forEach(F functor) {
+        if constexpr(strategy == JoinStrategy::Merge) {
+          mergeJoin(functor);
+        }
+        else if constexpr(strategy == JoinStrategy::IndexNestedLoop) {
+          indexNestedLoopJoin(functor);
+        }
+        else {
+          hashJoin(functor);
+        }
+      }
+
+      ForEachOperator
+
+    private:
+      template<typename F>
+      void indexNestedLoopJoin(F &functor) {
+        auto &idx = right.template lut<RightCol>();
+        left.forEach([&](auto const &l) {
+          auto[lo, hi] = idx.equal_range(std::get<LeftCol>(l));
+          for (; lo != hi; ++lo) {
+            functor(l, static_cast<Entry const &>(**lo));
+          }
+        });
+      }
+
+      template<typename F>
+      void mergeJoin(F &functor) {
+        auto &idx = right.template lut<RightCol>();
+        auto it = idx.begin();
+        left.template forEachOrderedBy<LeftCol>([&](auto const &l) {
+          auto const &key = std::get<LeftCol>(l);
+          it = seek<RightCol>(idx, it, key);
+
+          for (auto r = it; r != idx.end() && !(key < std::get<RightCol>(**r)); ++r) {
+            functor(l, static_cast<Entry const &>(**r));
+          }
+        });
+      }
+
+      template<typename F>
+      void hashJoin(F &functor) {
+        Detail::FlatHashMap<Key<RightCol>, std::vector<Entry const *>> rows(right.size());
+        for (auto &r : right.defaultLookup()) {
+          rows[std::get<RightCol>(*r)].emplace_back(&*r);
+        }
+
+        left.forEach([&](auto const &l) {
+          if (auto matches = rows.find(std::get<LeftCol>(l))) {
+            for (auto r : *matches) {
+              functor(l, *r);
+            }
+          }
+        });
+      }
+
+      LeftExpr left;
+      Table const &right;
+    };
+
+#undef ProfiledLeaf
+#undef GroupByOperator
+#undef ForEachOperator
+#undef ExprOperators
+
+    Entry const *emplace(std::unique_ptr<Entry> &&e) {
+      [[maybe_unused]] auto const measured = measure(counters, &Detail::Counters::emplaces);
+      if (shouldInsert<0>(e)) {
+        auto ret = e.get();
+        if constexpr(hasBitmaps) {
+          rowIds.val->assign(ret);
+        }
+        if constexpr(Custom::DefaultLookup<Entry>{}() == std::tuple_size_v<Entry>) {
+          updateAll<0>(e.get());
+          defaultLUT.val.emplace(std::forward<decltype(e)>(e));
+        }
+        else {
+          updateAll<0>(std::forward<decltype(e)>(e));
+        }
+        if constexpr(hasSpatial) {
+          spatial.val.insert(ret);
+        }
+        addToBlooms<0>(*ret);
+        countRows();
+        notify(Change::Insert, *ret);
+        return ret;
+      }
+      if constexpr(hasMetrics) {
+        Detail::add(counters.val->rejectedInserts);
+      }
+      return nullptr;
+    }
+
+    template<typename ...Args>
+    Entry const *emplace(Args &&...args) {
+      auto ptr = std::make_unique<Entry>(std::forward<Args>(args)...);
+      return emplace(std::move(ptr));
+    }
+
+    void erase(Entry const *entry) {
+      [[maybe_unused]] auto const measured = measure(counters, &Detail::Counters::erases);
+      notify(Change::Erase, *entry);
+      if constexpr(hasSpatial) {
+        spatial.val.erase(entry);
+      }
+      eraseAll<0>(entry);
+      if constexpr(Custom::DefaultLookup<Entry>{}() == std::tuple_size_v<Entry>) {
+        defaultLUT.val.erase(defaultLUT.val.find(entry));
+      }
+      if constexpr(hasBitmaps) {
+        rowIds.val->release(entry);
+      }
+      removeFromBlooms<0>();
+      countRows();
+    }
+
+    // Erases the entries whose Custom::Expiry part is at or before now,
+    // earliest first, and returns how many there were. The index on that
+    // part keeps the entries in deadline order, so only the expired ones
+    // are ever looked at.
+    template<typename T>
+    std::size_t expire(T const &now) {
+      static_assert(expiryPart < std::tuple_size_v<Entry>, "Expiring entries needs a Custom::Expiry");
+      static_assert(indexesAll<expiryPart>, "The expiry part needs an index over every entry");
+      auto &deadlines = lut<expiryPart>();
+      std::size_t ret = 0;
+      for (; !deadlines.empty() && !(now < std::get<expiryPart>(**deadlines.begin())); ++ret) {
+        erase(&**deadlines.begin());
+      }
+      return ret;
+    }
+
+    auto begin() const {
+      auto it = defaultLookup().begin();
+      return Iterator<std::tuple_size<Entry>::value, decltype(it)>(std::move(it));
+    }
+
+    auto end() const {
+      auto it = defaultLookup().end();
+      return Iterator<std::tuple_size<Entry>::value, decltype(it)>(std::move(it));
+    }
+
+    template<std::size_t Ind>
+    auto vbegin() const {
+      auto it = lut<Ind>().begin();
+      return Iterator<Ind, decltype(it)>(std::move(it));
+    }
+
+    template<std::size_t Ind>
+    auto rvbegin() const {
+      auto it = lut<Ind>().rbegin();
+      return Iterator<Ind, decltype(it)>(std::move(it));
+    }
+
+    template<std::size_t Ind>
+    auto vend() const {
+      auto it = lut<Ind>().end();
+      return Iterator<Ind, decltype(it)>(std::move(it));
+    }
+
+    template<std::size_t Ind>
+    auto rvend() const {
+      auto it = lut<Ind>().rend();
+      return Iterator<Ind, decltype(it)>(std::move(it));
+    }
+
+    // Erases the entry it points to like erase(Entry const *) does, and
+    // returns an iterator to the entry after it
+    template<std::size_t Ind, typename T>
+    auto erase(Iterator<Ind, T> &it) {
+      [[maybe_unused]] auto const measured = measure(counters, &Detail::Counters::erases);
+      auto const entry = &*it;
+      notify(Change::Erase, *entry);
+      if constexpr(hasSpatial) {
+        spatial.val.erase(entry);
+      }
+      auto next = eraseThrough<Ind>(it.setIt, entry);
+      if constexpr(hasBitmaps) {
+        rowIds.val->release(entry);
+      }
+      removeFromBlooms<0>();
+      countRows();
+      return Iterator<Ind, T>(std::move(next));
+    }
+
+    std::size_t size() const {
+      return defaultLookup().size();
+    }
+
+    bool empty() const {
+      return defaultLookup().empty();
+    }
+
+    // Builds a Lazy index on part N and rebuilds a stale bloom filter on
+    // it now. Const queries would otherwise do this on first use, so call
+    // it before sharing a const table between threads.
+    template<std::size_t N>
+    void buildIndex() {
+      static_assert(!isNone<N>, "Parts without an index can only be scanned");
+      lut<N>();
+      if constexpr(hasBloom<N>) {
+        refreshBloom<N>();
+      }
+    }
+
+    void clear() {
+      if (!listeners.empty()) {
+        for (auto &entry : defaultLookup()) {
+          notify(Change::Erase, *entry);
+        }
+      }
+      clearAll<0>();
+      if constexpr(Custom::DefaultLookup<Entry>{}() == std::tuple_size_v<Entry>) {
+        defaultLUT.val.clear();
+      }
+      if constexpr(hasBitmaps) {
+        rowIds.val->clear();
+      }
+      if constexpr(hasSpatial) {
+        spatial.val.clear();
+      }
+      clearBlooms<0>();
+      countRows();
+    }
+
+    std::unique_ptr<Entry> extract(Entry const *entry) {
+      [[maybe_unused]] auto const measured = measure(counters, &Detail::Counters::erases);
+      notify(Change::Erase, *entry);
+      auto ptr = std::move(defaultLookup().extract(defaultLookup().find(entry)).value());
+      if constexpr(hasSpatial) {
+        spatial.val.erase(ptr.get());
+      }
+      eraseAll<0>(ptr.get());
+      if constexpr(hasBitmaps) {
+        rowIds.val->release(ptr.get());
+      }
+      removeFromBlooms<0>();
+      countRows();
+      return ptr;
+    }
+
+    template<std::size_t N, typename T>
+    Entry const *lookup(T const &val) {
+      [[maybe_unused]] auto const measured = measure(partCounters<N>(), &Detail::PartCounters::lookups);
+      Entry const *ret = nullptr;
+      if constexpr(!indexesAll<N>) {
+        auto &entries = defaultLookup();
+        auto it = std::find_if(entries.begin(), entries.end(), [&](auto const &v) {
+          return !Compare<N>{}(v, val) && !Compare<N>{}(val, v);
+        });
+        return it == entries.end() ? ret : &**it;
+      }
+      else {
+        if (!mayContain<N>(val)) {
+          return ret;
+        }
+
+        auto &index = lut<N>();
+        if (auto it = index.find(val); it != index.end()) {
+          if constexpr(CQL::Custom::DefaultLookup<Entry>{}() == N) {
+            ret = it->get();
+          }
+          else {
+            ret = *it;
+          }
+        }
+
+        return ret;
+      }
+    }
+
+    // Looks up every key in keys at once, returning the matching entries
+    // (or nullptr) in the same order. The keys are sorted first, so the
+    // index is walked in a single pass instead of once per key.
+    template<std::size_t N, typename Container>
+    std::vector<Entry const *> lookupMany(Container const &keys) const {
+      static_assert(indexesAll<N>, "lookupMany needs an index over every entry");
+      std::vector<std::pair<decltype(&*std::begin(keys)), std::size_t>> probes;
+      probes.reserve(std::size(keys));
+      for (auto &key : keys) {
+        probes.emplace_back(&key, probes.size());
+      }
+
+      std::sort(probes.begin(), probes.end(), [](auto const &lhs, auto const &rhs) {
+        return *lhs.first < *rhs.first;
+      });
+
+      std::vector<Entry const *> ret(probes.size(), nullptr);
+      auto &index = lut<N>();
+      auto it = index.begin();
+      for (auto &[key, pos] : probes) {
+        it = seek<N>(index, it, *key);
+        if (it == index.end()) {
+          break;
+        }
+
+        if (!Compare<N>{}(*key, *it)) {
+          ret[pos] = &**it;
+        }
+
+        if (auto next = std::next(it); next != index.end()) {
+          Detail::prefetch(&**next);
+        }
+      }
+
+      return ret;
+    }
+
+    // Returns false if the value already exists in a table where enforced uniqueness exists
+    template<std::size_t N, typename T>
+    bool update(Entry const *entry, T &&newVal) {
+      [[maybe_unused]] auto const measured = measure(partCounters<N>(), &Detail::PartCounters::updates);
+      if constexpr(Custom::Unique<Entry, N>{}() == Custom::Uniqueness::EnforceUnique) {
+        if (auto f = std::get<N>(luts).find(newVal); f != std::get<N>(luts).end()) {
+          return &**f == entry;
+        }
+      }
+
+      changePart<N>(entry, [&](auto &part) {
+        part = std::forward<T>(newVal);
+      });
+      return true;
+    }
+
+    template<std::size_t N, std::size_t OtherN, typename T, typename ItT>
+    bool update(Iterator<OtherN, ItT> const &entry, T &&newVal) {
+      if constexpr(N == OtherN) {
         throw std::runtime_error {
           "You cannot update the value of an object when you are iterating over the value you want to change"
         };
       }
       else {
-        return update(*(entry.setIt));
+        return update(*(entry.setIt));
+      }
+    }
+
+    // Returns false if the value already exists in a table where enforced uniqueness exists
+    template<std::size_t N, typename T>
+    bool swap(Entry const *entry, T &newVal) {
+      [[maybe_unused]] auto const measured = measure(partCounters<N>(), &Detail::PartCounters::updates);
+      if constexpr(Custom::Unique<Entry, N>{}() == Custom::Uniqueness::EnforceUnique) {
+        if (std::get<N>(luts).find(newVal) != std::get<N>(luts).end())
+          return false;
+      }
+
+      changePart<N>(entry, [&](auto &part) {
+        std::swap(part, newVal);
+      });
+      return true;
+    }
+
+    // Replaces all parts of entry at once. Only the indexes of parts whose
+    // value changed are touched. Returns false, leaving the entry as it
+    // was, if any part would break an enforced uniqueness.
+    bool updateRow(Entry const *entry, Entry newValue) {
+      auto const changed = changedParts(*entry, newValue, std::make_index_sequence<std::tuple_size_v<Entry>>{});
+      if (!allowsRow<0>(entry, newValue, changed)) {
+        return false;
+      }
+
+      auto row = detachRow(entry, changed);
+      attachRow(row, std::move(newValue));
+      return true;
+    }
+
+    // Calls modifier with a copy of entry to change as it likes, then
+    // applies the result like updateRow
+    template<typename F>
+    bool modify(Entry const *entry, F &&modifier) {
+      Entry copy = *entry;
+      std::forward<F>(modifier)(copy);
+      return updateRow(entry, std::move(copy));
+    }
+
+    // Buffers emplace, erase and update calls to apply together. commit()
+    // checks every enforced uniqueness against the state the whole batch
+    // leaves the table in before changing anything, so it applies either
+    // all of the batch or none of it. An uncommitted batch is dropped.
+    struct Transaction {
+      explicit Transaction(Table &table) : table{ table } { }
+
+      template<typename ...Args>
+      void emplace(Args &&...args) {
+        inserted.emplace_back(std::make_unique<Entry>(std::forward<Args>(args)...));
+      }
+
+      // The entries erased and updated have to be in the table at commit().
+      // Writes to an entry after erasing it are ignored.
+      void erase(Entry const *entry) {
+        if (auto pos = touched.find(entry)) {
+          rows[*pos].second.reset();
+        }
+        else {
+          touched[entry] = rows.size();
+          rows.emplace_back(entry, std::nullopt);
+        }
+      }
+
+      template<std::size_t N, typename T>
+      void update(Entry const *entry, T &&newVal) {
+        if (auto &value = row(entry)) {
+          std::get<N>(*value) = std::forward<T>(newVal);
+        }
+      }
+
+      void updateRow(Entry const *entry, Entry newValue) {
+        if (auto &value = row(entry)) {
+          *value = std::move(newValue);
+        }
+      }
+
+      // Returns false, leaving the table as it was, if the batch would
+      // break an enforced uniqueness. The transaction is empty afterwards.
+      bool commit() {
+        auto const ret = table.apply(*this);
+        rollback();
+        return ret;
+      }
+
+      void rollback() {
+        rows.clear();
+        touched.clear();
+        inserted.clear();
+      }
+
+      // The number of rows written so far
+      std::size_t size() const {
+        return rows.size() + inserted.size();
+      }
+
+    private:
+      friend struct Table;
+
+      std::optional<Entry> &row(Entry const *entry) {
+        if (auto pos = touched.find(entry)) {
+          return rows[*pos].second;
+        }
+        touched[entry] = rows.size();
+        return rows.emplace_back(entry, *entry).second;
+      }
+
+      Table &table;
+      // The existing rows written, with their new value or nullopt if erased
+      std::vector<std::pair<Entry const *, std::optional<Entry>>> rows;
+      Detail::FlatHashMap<Entry const *, std::size_t> touched;
+      std::vector<std::unique_ptr<Entry>> inserted;
+    };
+
+    Transaction transaction() {
+      return Transaction{ *this };
+    }
+
+    // A snapshot of the counters and latency histograms of the table, which
+    // another thread may take while this one keeps writing to the table.
+    // Only for tables keeping metrics, see Custom::Metrics.
+    TableMetrics metrics() const {
+      static_assert(hasMetrics, "Metrics are off for this table, see Custom::Metrics");
+      return counters.val->snapshot();
+    }
+
+    // The bytes the table holds on the heap, by what holds them. O(n), as
+    // the memory owned by the parts of every entry is added up.
+    MemoryUsage memoryUsage() const {
+      MemoryUsage ret;
+      ret.rows = size() * sizeof(Entry);
+      for (auto &entry : defaultLookup()) {
+        ret.rows += Detail::heapBytes(*entry);
+      }
+      if constexpr(Custom::DefaultLookup<Entry>{}() == std::tuple_size_v<Entry>) {
+        ret.defaultLookup = Detail::memoryUsage(defaultLUT.val);
+      }
+      ret.parts = partMemory(std::make_index_sequence<std::tuple_size_v<Entry>>{});
+      if constexpr(hasSpatial) {
+        ret.spatial = spatial.val.memoryUsage();
+      }
+      if constexpr(hasBitmaps) {
+        ret.rowIds = rowIds.val->memoryUsage();
+      }
+      ret.other = listeners.capacity() * sizeof(listeners[0]);
+      if constexpr(hasMetrics) {
+        ret.other += sizeof(Detail::Counters) + counters.val->parts.capacity() * sizeof(Detail::PartCounters);
+      }
+      return ret;
+    }
+
+    // The k:th entry in the order of index N, nullptr if k >= size().
+    // O(log n) on OrderStatistic indexes, linear otherwise.
+    template<std::size_t N>
+    Entry const *nth(std::size_t k) const {
+      auto &index = lut<N>();
+      if (k >= index.size()) {
+        return nullptr;
+      }
+
+      if constexpr(isOrderStatistic<N>) {
+        return &**index.nth(k);
+      }
+      else {
+        return &**std::next(index.begin(), k);
+      }
+    }
+
+    // The number of entries with std::get<N>(entry) < val.
+    // O(log n) on OrderStatistic indexes, linear otherwise.
+    template<std::size_t N, typename T>
+    std::size_t rank(T const &val) const {
+      auto &index = lut<N>();
+      if constexpr(isOrderStatistic<N>) {
+        return index.rank(val);
+      }
+      else {
+        return static_cast<std::size_t>(std::distance(index.begin(), index.lower_bound(val)));
+      }
+    }
+
+    // The entry at quantile q (0 <= q <= 1) of index N, rounding down to the
+    // nearest rank. percentile<N>(0.5) is the lower median.
+    template<std::size_t N>
+    Entry const *percentile(double q) const {
+      auto const s = lut<N>().size();
+      if (!s) {
+        return nullptr;
+      }
+
+      q = std::clamp(q, 0.0, 1.0);
+      return nth<N>(static_cast<std::size_t>(q * static_cast<double>(s - 1)));
+    }
+
+    template<std::size_t N, typename T1, typename T2>
+    auto range(T1 &&lb, T2 &&ub) {
+      if constexpr(!indexesAll<N>) {
+        return scan([lb = Key<N>(std::forward<T1>(lb)), ub = Key<N>(std::forward<T2>(ub))](Entry const &entry) {
+          return lb <= std::get<N>(entry) && std::get<N>(entry) <= ub;
+        });
+      }
+      else if constexpr(isBitmap<N>) {
+        return BitmapExpr{ lut<N>().rows(lb, ub), *rowIds.val, *this };
+      }
+      else {
+        return makeRange<N>(std::forward<T1>(lb),
+                            std::forward<T2>(ub));
+      }
+    }
+
+    template<std::size_t N, typename T>
+    auto equal(T &&val) {
+      return range<N>(val, val);
+    }
+
+    // All entries where std::get<N>(entry) != val, read from the index on
+    // either side of val
+    template<std::size_t N, typename T>
+    auto notEqual(T &&val) {
+      return !equal<N>(std::forward<T>(val));
+    }
+
+    // All entries where std::get<N>(entry) starts with prefix
+    template<std::size_t N>
+    auto prefix(std::string_view prefix) const {
+      if constexpr(!indexesAll<N>) {
+        return scan([prefix = std::string{ prefix }](Entry const &entry) {
+          return std::string_view{ std::get<N>(entry) }.substr(0, prefix.size()) == prefix;
+        });
+      }
+      else {
+        return Prefix<N, remove_cvref_v<decltype(lut<N>())>>{ std::string{ prefix }, lut<N>(), *this };
+      }
+    }
+
+    // All entries where std::get<N>(entry) is any of the values, or any of
+    // the elements if passed a single container of keys
+    template<std::size_t N, typename ...Ts>
+    auto in(Ts &&...vals) const {
+      std::vector<Key<N>> keys;
+      if constexpr(sizeof...(Ts) == 1 && (... && (Detail::isContainer<remove_cvref_v<Ts>>
+                                               && !std::is_convertible_v<Ts, Key<N>>))) {
+        auto add = [&](auto &&container) {
+          keys.reserve(std::size(container));
+          for (auto &v : container) {
+            keys.emplace_back(v);
+          }
+        };
+        (add(vals), ...);
+      }
+      else {
+        keys.reserve(sizeof...(Ts));
+        (keys.emplace_back(std::forward<Ts>(vals)), ...);
+      }
+
+      if constexpr(!indexesAll<N>) {
+        std::sort(keys.begin(), keys.end());
+        return scan([keys = std::move(keys)](Entry const &entry) {
+          return std::binary_search(keys.begin(), keys.end(), std::get<N>(entry));
+        });
+      }
+      else if constexpr(isBitmap<N>) {
+        Bitmap rows;
+        for (auto &key : keys) {
+          rows |= lut<N>().rows(key, key);
+        }
+        return BitmapExpr{ std::move(rows), *rowIds.val, *this };
+      }
+      else {
+        return InList<N, remove_cvref_v<decltype(lut<N>())>>{ std::move(keys), lut<N>(), *this };
+      }
+    }
+
+    // All entries with x0 <= x <= x1 and y0 <= y <= y1, x and y being the
+    // parts named by Custom::SpatialLookup
+    template<typename S = Spatial>
+    auto box(typename S::XType x0, typename S::YType y0, typename S::XType x1, typename S::YType y1) const {
+      static_assert(hasSpatial, "Box queries need a Custom::SpatialLookup");
+      return BoxExpr<S>{ spatial.val, x0, y0, x1, y1, *this };
+    }
+
+    // The k entries closest to (x, y) on the parts named by
+    // Custom::SpatialLookup, nearest first
+    template<typename S = Spatial>
+    auto nearest(double x, double y, std::size_t k) const {
+      static_assert(hasSpatial, "Nearest neighbour queries need a Custom::SpatialLookup");
+      return NearestExpr{ spatial.val.nearest(x, y, k), *this };
+    }
+
+    using Listener = std::function<void(Change change, Entry const &entry, Entry const *before)>;
+
+    // Calls listener after every insertion and update, and before every
+    // erasure. On updates, before points to a copy of the entry from before
+    // the change if Entry can be copied. Returns an id for unsubscribe.
+    std::size_t subscribe(Listener listener) {
+      listeners.emplace_back(++lastListener, std::move(listener));
+      return lastListener;
+    }
+
+    // Listeners may subscribe and unsubscribe from inside a notification,
+    // which then only goes on to the listeners there when it started
+    void unsubscribe(std::size_t id) {
+      for (auto &listener : listeners) {
+        if (listener.first == id) {
+          // Only marked while notifying, as the listener may be running
+          listener.first = 0;
+        }
+      }
+      if (!notifying) {
+        dropUnsubscribed();
+      }
+    }
+
+    // The entries in index N, which for an index with a Custom::IndexFilter
+    // are only those passing the filter. range<N> and the like always mean
+    // the whole table and can't use such an index, so queries only about
+    // the filtered entries go through here instead.
+    template<std::size_t N>
+    auto partial() const {
+      return IndexScan<N, remove_cvref_v<decltype(lut<N>())>>{ lut<N>(), *this };
+    }
+
+    // The entries in index N with lb <= std::get<N>(entry) <= ub
+    template<std::size_t N, typename T1, typename T2>
+    auto partial(T1 &&lb, T2 &&ub) {
+      static_assert(!isBitmap<N>, "Use range<N> on Bitmap indexes");
+      return makeRange<N>(std::forward<T1>(lb), std::forward<T2>(ub));
+    }
+
+    auto all() const {
+      auto &tbl = defaultLookup();
+      return EntireTable<Custom::DefaultLookup<Entry>{}(), decltype(tbl)>{tbl, *this};
+    }
+
+    // A struct-of-arrays copy of parts Is... of every entry, for evaluating
+    // col<N>() predicates over whole columns at once
+    template<std::size_t ...Is>
+    auto columns() const {
+      return ColumnSnapshot<Entry, Is...>{ *this };
+    }
+
+    template<typename F>
+    auto pred(F &&predicate) const {
+      return Predicate<F>{ std::forward<F>(predicate), *this };
+    }
+
+    // Runs expr >>= functor, and returns what every node of expr did: the
+    // rows it took in and passed on, the index entries and predicate calls
+    // it needed and the time it took. Queries run without it aren't slowed
+    // down by any of this.
+    template<typename Expr, typename F>
+    static QueryProfile profile(Expr &&expr, F functor) {
+      QueryProfile ret;
+      profileNode(expr, functor, ret);
+      return ret;
+    }
+
+  private:
+    // The entries of the whole table passing predicate, for queries on
+    // parts without an index over every entry
+    template<typename F>
+    auto scan(F &&predicate) const {
+      return all() && pred(std::forward<F>(predicate));
+    }
+
+    template<typename Expr, typename = void>
+    struct IsProfiled : std::false_type { };
+
+    template<typename Expr>
+    struct IsProfiled<Expr, std::void_t<decltype(std::declval<Expr &>().profiledForEach(
+      std::declval<void (*)(Entry const &)>(), std::declval<QueryProfile &>()))>> : std::true_type { };
+
+    // Runs expr into functor, recording what it does in profile. Expressions
+    // that can't tell what their parts do are timed as a whole.
+    template<typename Expr, typename F>
+    static void profileNode(Expr &expr, F functor, QueryProfile &profile) {
+      if constexpr(IsProfiled<Expr>::value) {
+        expr.profiledForEach(functor, profile);
+      }
+      else {
+        profile.node = "Expression";
+        Detail::Stopwatch watch{ profile };
+        expr.forEach([&](auto const &...row) {
+          watch.yield(functor, row...);
+        });
+      }
+    }
+
+    // A node reading its rows straight out of an index
+    template<typename Expr, typename F>
+    static void profileLeaf(std::string node, Expr const &expr, F &functor, QueryProfile &profile) {
+      profile.node = std::move(node);
+      Detail::Stopwatch watch{ profile };
+      expr.forEach([&](Entry const &entry) {
+        ++profile.indexEntries;
+        watch.yield(functor, entry);
+      });
+    }
+
+    template<typename Expr>
+    struct IsConjunction : std::false_type { };
+
+    template<typename L, typename R>
+    struct IsConjunction<FilteredRangeExpr<L, R>> : std::true_type { };
+
+    template<typename Expr>
+    struct IsConjunct : std::false_type { };
+
+    template<typename Expr>
+    struct IsConjunct<Predicate<Conjunct<Expr>>> : std::true_type { };
+
+    template<typename Expr>
+    struct IsRange : std::false_type { };
+
+    template<std::size_t Ind, typename Lt, typename Ht, typename Tt>
+    struct IsRange<Range<Ind, Lt, Ht, Tt>> : std::true_type { };
+
+    template<typename L, typename R>
+    static constexpr bool sameRangePart() {
+      if constexpr(IsRange<L>::value && IsRange<R>::value) {
+        return L::part == R::part;
+      }
+      else {
+        return false;
       }
     }
 
-    // Returns false if the value already exists in a table where enforced uniqueness exists
-    template<std::size_t N, typename T>
-    bool swap(Entry const *entry, T &newVal) {
-      if constexpr(Custom::Unique<Entry, N>{}() == Custom::Uniqueness::EnforceUnique) {
-        if (std::get<N>(luts).find(newVal) != std::get<N>(luts).end())
+    // References to the leaves of a tree of &&, in the order they were written
+    template<typename Expr>
+    static auto conjuncts(Expr &expr) {
+      if constexpr(IsConjunction<Expr>::value) {
+        return std::tuple_cat(conjuncts(expr.range), conjuncts(expr.predicate));
+      }
+      else if constexpr(IsConjunct<Expr>::value) {
+        return conjuncts(expr.f.expr);
+      }
+      else {
+        return std::tuple<Expr &>{ expr };
+      }
+    }
+
+    // Runs a conjunction as a single loop over the rows of one of its
+    // leaves, testing the others inline on every row. That is the leftmost
+    // leaf, unless a range on a unique part asks for one value. Ranges on
+    // the part of a driving range narrow its bounds instead of being tested.
+    // Given a QueryProfile, what every leaf does is recorded in its children.
+    template<typename Expr, typename F, typename Profile = std::nullptr_t>
+    static void runConjunction(Expr &expr, F &functor, Profile profile = nullptr) {
+      auto leaves = conjuncts(expr);
+      if (!driveByEquality<1>(leaves, functor, profile)) {
+        drive<0>(leaves, functor, profile);
+      }
+    }
+
+    template<std::size_t I, typename Leaves, typename F, typename Profile>
+    static bool driveByEquality(Leaves &leaves, F &functor, Profile profile) {
+      if constexpr(I < std::tuple_size_v<Leaves>) {
+        using Leaf = remove_cvref_v<std::tuple_element_t<I, Leaves>>;
+        if constexpr(IsRange<Leaf>::value) {
+          if constexpr(Custom::Unique<Entry, Leaf::part>{}() != Custom::Uniqueness::NotUnique) {
+            auto const &leaf = std::get<I>(leaves);
+            if (!(leaf.lo < leaf.hi)) {
+              drive<I>(leaves, functor, profile);
+              return true;
+            }
+          }
+        }
+        return driveByEquality<I + 1>(leaves, functor, profile);
+      }
+      else {
+        return false;
+      }
+    }
+
+    template<std::size_t D, typename Leaves, typename F, typename Profile>
+    static void drive(Leaves &leaves, F &functor, Profile profile) {
+      drive<D>(leaves, functor, profile, std::make_index_sequence<std::tuple_size_v<Leaves>>{});
+    }
+
+    template<std::size_t D, typename Leaves, typename F, typename Profile, std::size_t ...Is>
+    static void drive(Leaves &leaves, F &functor, Profile profile, std::index_sequence<Is...>) {
+      constexpr bool profiled = !std::is_same_v<Profile, std::nullptr_t>;
+      using Driver = remove_cvref_v<std::tuple_element_t<D, Leaves>>;
+      auto &driver = std::get<D>(leaves);
+      if constexpr(profiled) {
+        profile->children.resize(sizeof...(Is));
+        ((profile->children[Is].node = leafName<remove_cvref_v<std::tuple_element_t<Is, Leaves>>>()), ...);
+      }
+
+      // Bounds are cheaper than predicates, so they go first
+      auto const passes = [&](Entry const &entry) {
+        return (testLeaf<D, Is, true>(leaves, entry, profile) && ...)
+            && (testLeaf<D, Is, false>(leaves, entry, profile) && ...);
+      };
+      auto visit = [&](Entry const &entry) {
+        if constexpr(profiled) {
+          ++profile->rowsIn;
+        }
+        if (passes(entry)) {
+          functor(entry);
+        }
+      };
+
+      if constexpr(IsRange<Driver>::value) {
+        auto const *lo = &driver.lo, *hi = &driver.hi;
+        (narrow<Driver>(std::get<Is>(leaves), lo, hi), ...);
+        if (*hi < *lo) {
+          return;
+        }
+
+        [[maybe_unused]] auto const measured = measure(driver.counters, &Detail::PartCounters::ranges);
+
+        if constexpr(profiled) {
+          auto &node = profile->children[D];
+          Detail::Stopwatch watch{ node };
+          for (auto it = driver.tbl.lower_bound(*lo), end = driver.tbl.upper_bound(*hi); it != end; ++it) {
+            ++node.indexEntries;
+            watch.yield(visit, **it);
+          }
+        }
+        else {
+          for (auto it = driver.tbl.lower_bound(*lo), end = driver.tbl.upper_bound(*hi); it != end; ++it) {
+            visit(**it);
+          }
+        }
+      }
+      else if constexpr(profiled) {
+        profileNode(driver, visit, profile->children[D]);
+      }
+      else {
+        driver.forEach(visit);
+      }
+    }
+
+    template<typename Leaf>
+    static std::string leafName() {
+      if constexpr(IsRange<Leaf>::value) {
+        return "Range<" + std::to_string(Leaf::part) + ">";
+      }
+      else {
+        return "Predicate";
+      }
+    }
+
+    template<typename Driver, typename Leaf, typename K>
+    static void narrow(Leaf const &leaf, K const *&lo, K const *&hi) {
+      if constexpr(sameRangePart<Leaf, Driver>()) {
+        if (*lo < leaf.lo) {
+          lo = &leaf.lo;
+        }
+        if (leaf.hi < *hi) {
+          hi = &leaf.hi;
+        }
+      }
+    }
+
+    // Whether entry passes leaf I, true for the leaves the loop driven by
+    // leaf D already keeps to, and for those tested in the other pass
+    template<std::size_t D, std::size_t I, bool Bounds, typename Leaves, typename Profile>
+    static bool testLeaf(Leaves &leaves, Entry const &entry, Profile profile) {
+      using Leaf = remove_cvref_v<std::tuple_element_t<I, Leaves>>;
+      using Driver = remove_cvref_v<std::tuple_element_t<D, Leaves>>;
+      if constexpr(I == D || IsRange<Leaf>::value != Bounds || sameRangePart<Leaf, Driver>()) {
+        return true;
+      }
+      else if constexpr(!std::is_same_v<Profile, std::nullptr_t>) {
+        return Detail::test(profile->children[I], std::get<I>(leaves), entry);
+      }
+      else {
+        return std::get<I>(leaves)(entry);
+      }
+    }
+
+    template<typename Expr>
+    using Lead = remove_cvref_v<std::tuple_element_t<0, decltype(conjuncts(std::declval<Expr &>()))>>;
+
+    // Whether a cursor over Expr walks the index of its leading range,
+    // which it can resume in when the part is unique
+    template<typename Expr>
+    static constexpr bool cursorInRange() {
+      if constexpr(IsRange<Lead<Expr>>::value) {
+        return Custom::Unique<Entry, Lead<Expr>::part>{}() == Custom::Uniqueness::EnforceUnique;
+      }
+      else {
+        return false;
+      }
+    }
+
+    template<typename Expr>
+    static constexpr std::size_t cursorPart() {
+      if constexpr(cursorInRange<Expr>()) {
+        return Lead<Expr>::part;
+      }
+      else {
+        return Custom::DefaultLookup<Entry>{}();
+      }
+    }
+
+  public:
+    // A query run a few rows at a time, see cursor(). The table may change
+    // between calls to next(), but not during one: the cursor keeps the key
+    // of the last row it looked at rather than an iterator, and goes on
+    // from the next key in the index. Rows emplaced behind it are missed.
+    template<typename Expr>
+    struct Cursor {
+      Cursor(Table const &table, Expr &&expr) : table{ table }, expr{ std::move(expr) } { }
+
+      // Looks at up to n more rows, passing those in the query to functor.
+      // False once there are no more rows to look at.
+      template<typename F>
+      bool next(std::size_t n, F functor) {
+        if (done) {
           return false;
+        }
+
+        auto &index = table.template cursorIndex<part>();
+        auto it = last ? index.upper_bound(*last) : first(index);
+        Entry const *seen = nullptr;
+        for (; n && it != index.end() && !pastEnd(**it); --n, ++it) {
+          seen = &**it;
+          if (expr(*seen)) {
+            functor(*seen);
+          }
+        }
+
+        if (seen) {
+          last.emplace(key(*seen));
+        }
+        // Ran out of rows before running out of n
+        done = n > 0;
+        return !done;
       }
 
-      auto dbEntry = std::move(moveOutOfTable<N>(entry).value());
-      std::swap(std::get<N>(*dbEntry), newVal);
-      std::get<N>(luts).emplace(std::move(dbEntry));
-      return true;
+      bool finished() const { return done; }
+
+    private:
+      static constexpr bool inRange = cursorInRange<Expr>();
+      static constexpr std::size_t part = cursorPart<Expr>();
+
+      // Without a Custom::DefaultLookup, the default lookup orders entries
+      // by their address
+      static decltype(auto) key(Entry const &entry) {
+        if constexpr(part == std::tuple_size_v<Entry>) {
+          return &entry;
+        }
+        else {
+          return std::get<part>(entry);
+        }
+      }
+
+      template<typename Index>
+      auto first(Index &index) {
+        if constexpr(!inRange) {
+          return index.begin();
+        }
+        else {
+          return index.lower_bound(lead().lo);
+        }
+      }
+
+      bool pastEnd(Entry const &entry) {
+        if constexpr(!inRange) {
+          return false;
+        }
+        else {
+          return lead().hi < std::get<part>(entry);
+        }
+      }
+
+      auto &lead() {
+        return std::get<0>(conjuncts(expr));
+      }
+
+      Table const &table;
+      Expr expr;
+      std::optional<remove_cvref_v<decltype(key(std::declval<Entry const &>()))>> last;
+      bool done = false;
+    };
+
+    // Runs expr in steps of cursor.next(n, functor), so that a long scan
+    // can let other work in between. A leading range over a unique part
+    // is walked in its own index, other queries walk the whole table.
+    template<typename Expr>
+    Cursor<remove_cvref_v<Expr>> cursor(Expr &&expr) const {
+      return Cursor<remove_cvref_v<Expr>>{ *this, remove_cvref_v<Expr>(std::forward<Expr>(expr)) };
+    }
+
+#ifdef CQL_COROUTINES
+    // The rows of expr in batches, looking at n rows for each and leaving
+    // out the batches where none of them matched. The rows of a batch can
+    // be used until the table changes, and the table may change while the
+    // generator is suspended, as with cursor().
+    template<typename Expr>
+    Generator<std::vector<Entry const *>> batches(Expr expr, std::size_t n) const {
+      auto rows = cursor(std::move(expr));
+      std::vector<Entry const *> batch;
+      for (bool more = true; more;) {
+        batch.clear();
+        more = rows.next(n, [&](Entry const &entry) {
+          batch.emplace_back(&entry);
+        });
+        if (!batch.empty()) {
+          co_yield batch;
+        }
+      }
+    }
+#endif
+
+  private:
+    template<std::size_t N>
+    auto &cursorIndex() const {
+      if constexpr(N == std::tuple_size_v<Entry>) {
+        return defaultLookup();
+      }
+      else {
+        return lut<N>();
+      }
+    }
+
+    template<typename Operator, typename LE, typename RE>
+    struct makeExprImpl {
+      auto operator()(LE &&le, RE &&re) {
+        if constexpr(std::is_same_v<Operator, AndOperation>) {
+          auto const &table = tableOf(le);
+          return makeExpr<AndOperation>(std::forward<LE>(le), table.pred(Conjunct<remove_cvref_v<RE>>{ std::forward<RE>(re) }));
+        }
+        else {
+          return RangeUnion<LE, RE>{ std::forward<LE>(le), std::forward<RE>(re) };
+        }
+      }
+    };
+
+    template<typename LE, typename T>
+    struct makeExprImpl<AndOperation, LE, Predicate<T>> {
+      auto operator()(LE &&expr, Predicate<T> &&pred) {
+        return FilteredRangeExpr<LE, Predicate<T>>{ std::forward<LE>(expr), std::forward<Predicate<T>>(pred) };
+      }
+    };
+
+    template<typename Operator, typename LE, typename RE>
+    static auto makeExpr(LE &&le, RE &&re) {
+      if constexpr(std::is_same_v<remove_cvref_v<LE>, BitmapExpr> && std::is_same_v<remove_cvref_v<RE>, BitmapExpr>) {
+        if constexpr(std::is_same_v<Operator, AndOperation>) {
+          return BitmapExpr{ le.rows & re.rows, le.ids, le.table };
+        }
+        else {
+          return BitmapExpr{ le.rows | re.rows, le.ids, le.table };
+        }
+      }
+      else {
+        return makeExprImpl<Operator, LE, RE>{}(std::forward<LE>(le), std::forward<RE>(re));
+      }
+    }
+
+    // The table an expression is over
+    template<typename Expr>
+    static Table const &tableOf(Expr const &expr) {
+      return expr.table;
+    }
+
+    template<typename RangeL, typename RangeR>
+    static Table const &tableOf(RangeUnion<RangeL, RangeR> const &expr) {
+      return tableOf(expr.rl);
+    }
+
+    template<typename Range, typename Pred>
+    static Table const &tableOf(FilteredRangeExpr<Range, Pred> const &expr) {
+      return tableOf(expr.range);
+    }
+
+    // !expr. The complement of a range over an index of every entry is
+    // read from the index, that of a bitmap query is a bitmap, and negating
+    // twice gives back the expression. Anything else walks the table and
+    // tests every entry, unless it is the right hand side of && or -.
+    template<std::size_t Ind, typename Lt, typename Ht, typename Tt>
+    static auto makeNegation(Range<Ind, Lt, Ht, Tt> const &range) {
+      if constexpr(indexesAll<Ind>) {
+        return Complement<Ind, Tt>{ range.lo, range.hi, range.tbl, range.counters, range.table };
+      }
+      else {
+        // From partial<N>(lb, ub), over an index missing the entries its
+        // filter leaves out
+        return Negated<Range<Ind, Lt, Ht, Tt>>{ range, range.table };
+      }
+    }
+
+    template<std::size_t Ind, typename Tt>
+    static auto makeNegation(Complement<Ind, Tt> const &complement) {
+      return Range<Ind, Key<Ind>, Key<Ind>, Tt>{ Key<Ind>(complement.lo), Key<Ind>(complement.hi),
+                                                 complement.tbl, complement.counters, complement.table };
+    }
+
+    static BitmapExpr makeNegation(BitmapExpr const &bitmap) {
+      return BitmapExpr{ bitmap.ids.all() - bitmap.rows, bitmap.ids, bitmap.table };
+    }
+
+    template<typename Expr>
+    static Expr makeNegation(Negated<Expr> const &negated) {
+      return negated.expr;
+    }
+
+    template<typename Expr>
+    static auto makeNegation(Expr const &expr) {
+      return Negated<Expr>{ expr, tableOf(expr) };
+    }
+
+    // le - re, the entries of le not in re. Found by walking le and testing
+    // re on each entry, except between bitmap queries.
+    template<typename LE, typename RE>
+    static auto makeDifference(LE &&le, RE &&re) {
+      if constexpr(std::is_same_v<remove_cvref_v<LE>, BitmapExpr> && std::is_same_v<remove_cvref_v<RE>, BitmapExpr>) {
+        return BitmapExpr{ le.rows - re.rows, le.ids, le.table };
+      }
+      else {
+        return makeExpr<AndOperation>(std::forward<LE>(le), makeNegation(re));
+      }
+    }
+
+    template<std::size_t N, typename Lt, typename Ht>
+    auto makeRange(Lt &&itl, Ht &&itr) {
+      return Range<N, Lt, Ht, decltype(std::get<N>(std::declval<decltype(luts)>()))>
+        { std::forward<Lt>(itl), std::forward<Ht>(itr), lut<N>(), partCounters<N>(), *this };
+    }
+
+    // Index N, which a Lazy index is first built for by the query asking,
+    // even a const one, as luts is mutable. See buildIndex<N>()
+    template<std::size_t N>
+    auto &lut() const {
+      static_assert(!isNone<N>, "Parts without an index can only be scanned");
+      auto &index = std::get<N>(luts);
+      if constexpr(isLazy<N>) {
+        if (!std::get<N>(built).val) {
+          for (auto &entry : defaultLookup()) {
+            if (inIndex<N>(*entry)) {
+              index.emplace(&*entry);
+            }
+          }
+          std::get<N>(built).val = true;
+        }
+      }
+      return index;
+    }
+
+    // Whether entry is in index Idx right now
+    template<std::size_t Idx>
+    bool inLut(Entry const &entry) const {
+      if constexpr(isNone<Idx>) {
+        return false;
+      }
+      else if constexpr(isLazy<Idx>) {
+        return std::get<Idx>(built).val && inIndex<Idx>(entry);
+      }
+      else {
+        return inIndex<Idx>(entry);
+      }
+    }
+
+    template<std::size_t N>
+    struct Compare {
+      // The value an index orders by, taken by reference from the entry so
+      // that comparing doesn't copy it
+      template<typename T>
+      static decltype(auto) key(T const &v) {
+        if constexpr(N == std::tuple_size_v<Entry>) {
+          if constexpr(std::is_same<T, std::unique_ptr<Entry>>::value) {
+            return v.get();
+          }
+          else {
+            return (v);
+          }
+        }
+        else if constexpr(std::is_same<T, Entry *>::value
+                       || std::is_same<T, Entry const *>::value
+                       || std::is_same<T, std::unique_ptr<Entry>>::value) {
+          return std::get<N>(*v);
+        }
+        else {
+          return (v);
+        }
+      }
+
+      template<typename T1, typename T2>
+      bool operator()(T1 const &lhs, T2 const &rhs) const {
+        if constexpr(hasMetrics) {
+          ++Detail::comparisons();
+        }
+        return key(lhs) < key(rhs);
+      }
+
+      using is_transparent = void;
+    };
+
+    template<std::size_t Idx>
+    static constexpr bool isOrderStatistic =
+      Custom::Index<Entry, Idx>{}() == Custom::Indexing::OrderStatistic;
+
+    template<std::size_t Idx>
+    static constexpr bool isRadix =
+      Custom::Index<Entry, Idx>{}() == Custom::Indexing::Radix;
+
+    template<std::size_t Idx, typename T, bool Multi>
+    using IndexSet = std::conditional_t<isOrderStatistic<Idx>,
+      OrderStatisticSet<T, Compare<Idx>, Multi>,
+      std::conditional_t<isRadix<Idx>,
+        RadixSet<T, Compare<Idx>, Multi>,
+        std::conditional_t<Multi, std::multiset<T, Compare<Idx>, Detail::CountingAllocator<T>>,
+                                  std::set<T, Compare<Idx>, Detail::CountingAllocator<T>>>>>;
+
+    template<std::size_t Idx>
+    static constexpr bool isBitmap =
+      Custom::Index<Entry, Idx>{}() == Custom::Indexing::Bitmap;
+
+    template<std::size_t ...Is>
+    static constexpr bool anyBitmap(std::index_sequence<Is...>) {
+      return (false || ... || isBitmap<Is>);
+    }
+
+    static constexpr bool hasBitmaps = anyBitmap(std::make_index_sequence<std::tuple_size_v<Entry>>{});
+
+    template<std::size_t Idx>
+    static decltype(auto) makeSet(RowIds<Entry> const *rowIds) {
+      static_assert(!isRadix<Idx> || std::is_convertible_v<Key<Idx> const &, std::string_view>,
+                    "Radix indexes need a part that is convertible to std::string_view");
+      static_assert(!isFiltered<Idx> || (Custom::DefaultLookup<Entry>{}() != Idx
+                                      && Custom::Unique<Entry, Idx>{}() == Custom::Uniqueness::NotUnique
+                                      && !Custom::Bloom<Entry, Idx>{}()),
+                    "Filtered indexes can't be unique, bloom filtered or the default lookup");
+      static_assert(alwaysIndexed<Idx> || isFiltered<Idx>
+                 || (Custom::DefaultLookup<Entry>{}() != Idx
+                  && Custom::Unique<Entry, Idx>{}() != Custom::Uniqueness::EnforceUnique
+                  && !Custom::Bloom<Entry, Idx>{}()),
+                    "Lazy and missing indexes can't enforce uniqueness, be bloom filtered or be the default lookup");
+      if constexpr(isNone<Idx>) {
+        return Detail::NoIndex{};
+      }
+      else if constexpr(isBitmap<Idx>) {
+        static_assert(Custom::DefaultLookup<Entry>{}() != Idx
+                   && Custom::Unique<Entry, Idx>{}() == Custom::Uniqueness::NotUnique,
+                      "Bitmap indexes are for parts that repeat, they can't be unique or the default lookup");
+        return BitmapIndex<Entry, Compare<Idx>>{ rowIds };
+      }
+      else if constexpr(Custom::DefaultLookup<Entry>{}() == Idx) {
+        return IndexSet<Idx, std::unique_ptr<Entry>, false>{};
+      }
+      else if constexpr(Custom::Unique<Entry, Idx>{}() == Custom::Uniqueness::NotUnique) {
+        return IndexSet<Idx, Entry *, true>{};
+      }
+      else {
+        return IndexSet<Idx, Entry *, false>{};
+      }
+    }
+
+    template<std::size_t ...Is>
+    static decltype(auto) makeSets(RowIds<Entry> const *rowIds, std::index_sequence<Is...>) {
+      return std::make_tuple(makeSet<Is>(rowIds)...);
     }
 
-    template<std::size_t N, typename T1, typename T2>
-    auto range(T1 &&lb, T2 &&ub) {
-      return makeRange<N>(std::forward<T1>(lb),
-                          std::forward<T2>(ub));
+    using Sets = decltype(makeSets(nullptr, std::make_index_sequence<std::tuple_size<Entry>::value>{}));
+
+    static auto makeRowIds() {
+      ConditionalVar<std::unique_ptr<RowIds<Entry>>, hasBitmaps> ret;
+      if constexpr(hasBitmaps) {
+        ret.val = std::make_unique<RowIds<Entry>>();
+      }
+      return ret;
+    }
+
+    RowIds<Entry> const *rowIdsPtr() const {
+      if constexpr(hasBitmaps) {
+        return rowIds.val.get();
+      }
+      else {
+        return nullptr;
+      }
+    }
+
+    template<std::size_t Idx>
+    static constexpr bool hasBloom = Custom::Bloom<Entry, Idx>{}();
+
+    template<std::size_t ...Is>
+    static auto makeBlooms(std::index_sequence<Is...>) {
+      return std::tuple<ConditionalVar<BloomFilter, hasBloom<Is>>...>{};
+    }
+
+    using Blooms = decltype(makeBlooms(std::make_index_sequence<std::tuple_size_v<Entry>>{}));
+
+    template<std::size_t ...Is>
+    static auto makeBuilt(std::index_sequence<Is...>) {
+      return std::tuple<ConditionalVar<bool, isLazy<Is>>...>{};
     }
 
-    auto all() const {
-      auto &tbl = defaultLookup();
-      return EntireTable<Custom::DefaultLookup<Entry>{}(), decltype(tbl)>{tbl};
+    using Built = decltype(makeBuilt(std::make_index_sequence<std::tuple_size_v<Entry>>{}));
+
+    template<std::size_t Idx>
+    static constexpr bool isSpatial = hasSpatial && (Idx == spatialParts.first || Idx == spatialParts.second);
+
+    // Only tables with Bitmap indexes number their entries. Kept on the heap
+    // so the indexes referring to it survive moving the table.
+    ConditionalVar<std::unique_ptr<RowIds<Entry>>, hasBitmaps> rowIds = makeRowIds();
+
+    static auto makeCounters() {
+      ConditionalVar<std::unique_ptr<Detail::Counters>, hasMetrics> ret;
+      if constexpr(hasMetrics) {
+        ret.val = std::make_unique<Detail::Counters>(std::tuple_size_v<Entry>);
+      }
+      return ret;
     }
 
-    template<typename F>
-    static auto pred(F &&predicate) {
-      return Predicate<F>{std::forward<F>(predicate)};
+    // On the heap, as atomics can't be moved along with the table
+    ConditionalVar<std::unique_ptr<Detail::Counters>, hasMetrics> counters = makeCounters();
+
+    template<std::size_t N>
+    ConditionalVar<Detail::PartCounters *, hasMetrics> partCounters() const {
+      ConditionalVar<Detail::PartCounters *, hasMetrics> ret;
+      if constexpr(hasMetrics) {
+        ret.val = &counters.val->parts[N];
+      }
+      return ret;
     }
 
-  private:
-    template<typename Operator, typename LE, typename RE>
-    struct makeExprImpl {
-      auto operator()(LE &&le, RE &&re) {
-        if constexpr(std::is_same_v<Operator, AndOperation>) {
-          return makeExpr<AndOperation>(std::forward<LE>(le), pred([r = std::forward<RE>(re)](auto val) { return r(val); }));
+    // Times the enclosing scope as operation op of the table or of a part,
+    // counting the comparisons the part makes meanwhile. Nothing at all
+    // for tables without metrics.
+    template<typename Counters, typename Op>
+    static auto measure([[maybe_unused]] Counters const &counters, [[maybe_unused]] Op op) {
+      if constexpr(hasMetrics) {
+        auto &c = *counters.val;
+        if constexpr(std::is_same_v<remove_cvref_v<decltype(c)>, Detail::PartCounters>) {
+          return Detail::Measure{ c.*op, &c, op == &Detail::PartCounters::lookups };
         }
         else {
-          return RangeUnion<LE, RE>{ std::forward<LE>(le), std::forward<RE>(re) };
+          return Detail::Measure{ c.*op };
         }
       }
-    };
-
-    template<typename LE, typename T>
-    struct makeExprImpl<AndOperation, LE, Predicate<T>> {
-      auto operator()(LE &&expr, Predicate<T> &&pred) {
-        return FilteredRangeExpr<LE, Predicate<T>>{ std::forward<LE>(expr), std::forward<Predicate<T>>(pred) };
+      else {
+        return Detail::NoMeasure{};
       }
-    };
-
-    template<typename Operator, typename LE, typename RE>
-    static auto makeExpr(LE &&le, RE &&re) {
-      return makeExprImpl<Operator, LE, RE>{}(std::forward<LE>(le), std::forward<RE>(re));
     }
 
-    template<std::size_t N, typename Lt, typename Ht>
-    auto makeRange(Lt &&itl, Ht &&itr) {
-      return Range<N, Lt, Ht, decltype(std::get<N>(std::declval<decltype(luts)>()))>
-        { std::forward<Lt>(itl), std::forward<Ht>(itr), std::get<N>(luts) };
+    template<std::size_t ...Is>
+    std::vector<PartMemory> partMemory(std::index_sequence<Is...>) const {
+      return { PartMemory{ Detail::memoryUsage(std::get<Is>(luts)), bloomMemory<Is>() }... };
     }
 
     template<std::size_t N>
-    struct Compare {
-      template<typename T1, typename T2>
-      bool operator()(T1 const &lhs, T2 const &rhs) const {
-        auto val = [](auto const &v) {
-          if constexpr(N == std::tuple_size_v<Entry>) {
-            if constexpr(std::is_same<decltype(v), std::unique_ptr<Entry> const &>::value) {
-              return v.get();
-            }
-            else {
-              return v;
-            }
-          }
-          else if constexpr(std::is_same<decltype(v), Entry *const &>::value
-                         || std::is_same<decltype(v), Entry const *const &>::value
-                         || std::is_same<decltype(v), std::unique_ptr<Entry> const &>::value) {
-            return std::get<N>(*v);
-          }
-          else {
-            return v;
-          }
-        };
-
-        return val(lhs) < val(rhs);
-      }
-
-      using is_transparent = void;
-    };
-
-    template<std::size_t Idx>
-    static decltype(auto) makeSet() {
-      if constexpr(Custom::DefaultLookup<Entry>{}() == Idx) {
-        return std::set<std::unique_ptr<Entry>, Compare<Idx>>{};
-      }
-      else if constexpr(Custom::Unique<Entry, Idx>{}() == Custom::Uniqueness::NotUnique) {
-        return std::multiset<Entry *, Compare<Idx>>{};
+    std::size_t bloomMemory() const {
+      if constexpr(hasBloom<N>) {
+        return std::get<N>(blooms).val.memoryUsage();
       }
       else {
-        return std::set<Entry *, Compare<Idx>>{};
+        return 0;
       }
     }
 
-    template<std::size_t ...Is>
-    static decltype(auto) makeSets(std::index_sequence<Is...>) {
-      return std::make_tuple(makeSet<Is>()...);
+    void countRows() {
+      if constexpr(hasMetrics) {
+        counters.val->rows.store(size(), std::memory_order_relaxed);
+      }
     }
 
-    using Sets = decltype(makeSets(std::make_index_sequence<std::tuple_size<Entry>::value>{}));
+    // Lazy indexes are built by the first query that needs them
+    mutable Sets luts = makeSets(rowIdsPtr(), std::make_index_sequence<std::tuple_size<Entry>::value>{});
+
+    mutable Built built;
+
+    // Rebuilt from the index by the first probe that finds them stale
+    mutable Blooms blooms;
 
-    Sets luts{};
+    ConditionalVar<Spatial, hasSpatial> spatial;
 
-    ConditionalVar<std::set<std::unique_ptr<Entry>, Compare<std::tuple_size<Entry>::value>>,
+    std::vector<std::pair<std::size_t, Listener>> listeners;
+    std::size_t lastListener = 0;
+    // Depth of the notifications running, as listeners may change the table
+    std::size_t notifying = 0;
+
+    ConditionalVar<std::set<std::unique_ptr<Entry>, Compare<std::tuple_size<Entry>::value>,
+                            Detail::CountingAllocator<std::unique_ptr<Entry>>>,
                    std::tuple_size_v<Entry> == CQL::Custom::DefaultLookup<Entry>{}()> defaultLUT;
 
     auto constexpr &defaultLookup() const {
@@ -501,51 +2438,90 @@ namespace CQL {
           std::get<N>(luts).emplace(std::forward<T>(entry));
         }
         else if constexpr(std::is_same<T, std::unique_ptr<Entry>>::value) {
-          std::get<N>(luts).emplace(entry.get());
+          if constexpr(!isNone<N>) {
+            if (inLut<N>(*entry)) {
+              std::get<N>(luts).emplace(entry.get());
+            }
+          }
           updateAll<N + 1>(std::forward<T>(entry));
         }
         else {
-          std::get<N>(luts).emplace(entry);
+          if constexpr(!isNone<N>) {
+            if (inLut<N>(*entry)) {
+              std::get<N>(luts).emplace(entry);
+            }
+          }
           updateAll<N + 1>(entry);
         }
       }
     }
 
-    template<std::size_t N, typename T>
+    template<std::size_t N, std::size_t Skip = std::tuple_size_v<Entry>, typename T>
     void eraseAll(T const &entry) {
       if constexpr(N < std::tuple_size<Entry>::value) {
-        if (auto it = findInLut<N>(entry); it != std::get<N>(luts).end()) {
-          std::get<N>(luts).erase(it);
+        if constexpr(N == Custom::DefaultLookup<Entry>{}()) {
+          // This index owns the entry, so it has to be the last one to let go
+          eraseAll<N + 1, Skip>(entry);
+        }
+        if constexpr(!isNone<N> && N != Skip) {
+          if (auto it = findInLut<N>(entry); it != std::get<N>(luts).end()) {
+            std::get<N>(luts).erase(it);
+          }
+        }
+        if constexpr(N != Custom::DefaultLookup<Entry>{}()) {
+          eraseAll<N + 1, Skip>(entry);
         }
-        eraseAll<N + 1>(entry);
       }
     }
 
     template<std::size_t N>
     void clearAll() {
       if constexpr(N < std::tuple_size<Entry>::value) {
-        std::get<N>(luts).clear();
+        if constexpr(!isNone<N>) {
+          std::get<N>(luts).clear();
+        }
         clearAll<N + 1>();
       }
     }
 
-    template<std::size_t N, std::size_t Er, typename T>
-    auto eraseIt(T const &it) {
-      if constexpr(N < std::tuple_size<Entry>::value) {
-        if constexpr(N == Er) {
-          eraseIt<N + 1, Er>(it);
-          return std::get<N>(luts).erase(it);
+    // Removes entry from every index, from index Ind through setIt, and
+    // returns the iterator after it in that index
+    template<std::size_t Ind, typename It>
+    auto eraseThrough(It const &setIt, Entry const *entry) {
+      constexpr auto owner = Custom::DefaultLookup<Entry>{}();
+      if constexpr(Ind == owner || Ind == std::tuple_size_v<Entry>) {
+        eraseAll<0, owner>(entry);
+        return defaultLookup().erase(setIt);
+      }
+      else {
+        auto next = std::get<Ind>(luts).erase(setIt);
+        eraseAll<0, Ind>(entry);
+        if constexpr(owner == std::tuple_size_v<Entry>) {
+          defaultLUT.val.erase(defaultLUT.val.find(entry));
         }
-        else {
-          std::get<N>(luts).erase(findInLut<N>(*(it.setIt)));
-          return eraseIt<N + 1, Er>(it);
+        return next;
+      }
+    }
+
+    // Moves it forward to the first element in lut not less than key, in a
+    // few steps if it is close, otherwise through a fresh descent
+    template<std::size_t N, typename Lut, typename It, typename K>
+    static It seek(Lut const &lut, It it, K const &key) {
+      constexpr int seekAfter = 8;
+      for (int steps = 0; it != lut.end() && Compare<N>{}(*it, key); ++it) {
+        if (++steps == seekAfter) {
+          return lut.lower_bound(key);
         }
       }
+      return it;
     }
 
     template<std::size_t N, typename T>
     auto findInLut(T const &val) const {
-      if constexpr(Custom::Unique<Entry, N>{}() == Custom::Uniqueness::NotUnique) {
+      if constexpr(isBitmap<N>) {
+        return std::get<N>(luts).findRow(&*val);
+      }
+      else if constexpr(Custom::Unique<Entry, N>{}() == Custom::Uniqueness::NotUnique) {
         auto[low, hi] = std::get<N>(luts).equal_range(val);
         if (auto f = std::find_if(low, hi, [&](auto v) {
           return &*v == &*val;
@@ -558,6 +2534,465 @@ namespace CQL {
       return std::get<N>(luts).end();
     }
 
+    // The bloom filter on part N, rebuilt from the index first if stale
+    template<std::size_t N>
+    auto &refreshBloom() const {
+      auto &filter = std::get<N>(blooms).val;
+      if (filter.needsRebuild()) {
+        filter.reset(std::get<N>(luts).size() * 2);
+        for (auto &v : std::get<N>(luts)) {
+          filter.add(std::hash<Key<N>>{}(std::get<N>(*v)));
+        }
+      }
+      return filter;
+    }
+
+    // False if the bloom filter on part N, if any, rules out val
+    template<std::size_t N, typename T>
+    bool mayContain(T const &val) const {
+      if constexpr(hasBloom<N>) {
+        auto &filter = refreshBloom<N>();
+        auto const &key = Compare<N>::key(val);
+        using K = remove_cvref_v<decltype(key)>;
+        if constexpr(std::is_same_v<K, Key<N>>) {
+          return filter.mayContain(std::hash<Key<N>>{}(key));
+        }
+        else if constexpr(std::is_same_v<Key<N>, std::string> && std::is_convertible_v<K const &, std::string_view>) {
+          // Hashes the same as the std::string would, without making one
+          return filter.mayContain(std::hash<std::string_view>{}(key));
+        }
+        else if constexpr(std::is_arithmetic_v<Key<N>> && std::is_arithmetic_v<K>) {
+          return filter.mayContain(std::hash<Key<N>>{}(static_cast<Key<N>>(key)));
+        }
+      }
+      return true;
+    }
+
+    template<std::size_t N>
+    void addToBlooms(Entry const &entry) {
+      if constexpr(N < std::tuple_size_v<Entry>) {
+        if constexpr(hasBloom<N>) {
+          std::get<N>(blooms).val.add(std::hash<Key<N>>{}(std::get<N>(entry)));
+        }
+        addToBlooms<N + 1>(entry);
+      }
+    }
+
+    template<std::size_t N>
+    void removeFromBlooms() {
+      if constexpr(N < std::tuple_size_v<Entry>) {
+        if constexpr(hasBloom<N>) {
+          std::get<N>(blooms).val.remove();
+        }
+        removeFromBlooms<N + 1>();
+      }
+    }
+
+    template<std::size_t N>
+    void clearBlooms() {
+      if constexpr(N < std::tuple_size_v<Entry>) {
+        if constexpr(hasBloom<N>) {
+          std::get<N>(blooms).val.reset(0);
+        }
+        clearBlooms<N + 1>();
+      }
+    }
+
+    template<std::size_t N>
+    void replaceInBloom(Entry const &entry) {
+      if constexpr(hasBloom<N>) {
+        std::get<N>(blooms).val.remove();
+        std::get<N>(blooms).val.add(std::hash<Key<N>>{}(std::get<N>(entry)));
+      }
+    }
+
+    template<std::size_t ...Is>
+    static auto changedParts(Entry const &entry, Entry const &newValue, std::index_sequence<Is...>) {
+      return std::array<bool, sizeof...(Is)>{
+        (Compare<Is>{}(std::get<Is>(entry), std::get<Is>(newValue))
+         || Compare<Is>{}(std::get<Is>(newValue), std::get<Is>(entry)))...
+      };
+    }
+
+    // Whether changing entry to newValue keeps every enforced uniqueness
+    template<std::size_t N, typename Changed>
+    bool allowsRow(Entry const *entry, Entry const &newValue, Changed const &changed) const {
+      if constexpr(N < std::tuple_size_v<Entry>) {
+        if constexpr(Custom::Unique<Entry, N>{}() == Custom::Uniqueness::EnforceUnique) {
+          auto const &key = std::get<N>(newValue);
+          if (changed[N] && mayContain<N>(key) && std::get<N>(luts).find(key) != std::get<N>(luts).end()) {
+            return false;
+          }
+        }
+        return allowsRow<N + 1>(entry, newValue, changed);
+      }
+      else {
+        return true;
+      }
+    }
+
+    using Parts = std::array<bool, std::tuple_size_v<Entry>>;
+
+    // An entry taken out of the indexes of its changed parts, waiting for
+    // its new value
+    struct DetachedRow {
+      Entry *owned;
+      std::unique_ptr<Entry> owner; // Set if the default lookup let go of it
+      Parts changed, inIndexes;
+      std::optional<Entry> before;
+    };
+
+    // Takes the row out of the indexes of its changed parts, other than
+    // the default lookup, picking up the entry as the table owns it on
+    // the way
+    template<std::size_t N>
+    void unindexParts(Entry const *entry, DetachedRow &row) {
+      if constexpr(N < std::tuple_size_v<Entry>) {
+        if constexpr(N != Custom::DefaultLookup<Entry>{}() && !isNone<N>) {
+          if (row.changed[N] && row.inIndexes[N]) {
+            auto const it = findInLut<N>(entry);
+            row.owned = *it;
+            std::get<N>(luts).erase(it);
+            row.inIndexes[N] = false;
+          }
+        }
+        unindexParts<N + 1>(entry, row);
+      }
+    }
+
+    // Puts entry back into the indexes of the changed parts once it holds
+    // its new value
+    template<std::size_t N, typename Changed>
+    void reindexParts(Entry *entry, Changed const &changed) {
+      if constexpr(N < std::tuple_size_v<Entry>) {
+        if constexpr(N != Custom::DefaultLookup<Entry>{}() && alwaysIndexed<N>) {
+          if (changed[N]) {
+            std::get<N>(luts).emplace(entry);
+          }
+        }
+        if constexpr(hasBloom<N>) {
+          if (changed[N]) {
+            replaceInBloom<N>(*entry);
+          }
+        }
+        reindexParts<N + 1>(entry, changed);
+      }
+    }
+
+    DetachedRow detachRow(Entry const *entry, Parts const &changed) {
+      DetachedRow row{ nullptr, nullptr, changed,
+                       indexStates(*entry, std::make_index_sequence<std::tuple_size_v<Entry>>{}),
+                       snapshot(*entry) };
+      if constexpr(hasSpatial) {
+        if (changed[spatialParts.first] || changed[spatialParts.second]) {
+          spatial.val.erase(entry);
+        }
+      }
+
+      constexpr auto defaultPart = Custom::DefaultLookup<Entry>{}();
+      if constexpr(defaultPart < std::tuple_size_v<Entry>) {
+        if (changed[defaultPart]) {
+          // The default lookup owns the entry, so it is moved out and back in
+          row.owner = std::move(defaultLookup().extract(defaultLookup().find(entry)).value());
+          row.owned = row.owner.get();
+        }
+      }
+
+      unindexParts<0>(entry, row);
+      if (!row.owned) {
+        row.owned = ownedEntry(entry);
+      }
+      return row;
+    }
+
+    void attachRow(DetachedRow &row, Entry &&newValue) {
+      placeRow(row, std::move(newValue));
+      reindexParts<0>(row.owned, row.changed);
+      finishRow(row);
+    }
+
+    // Gives the row its new value and the default lookup its entry back
+    void placeRow(DetachedRow &row, Entry &&newValue) {
+      *row.owned = std::move(newValue);
+      if (row.owner) {
+        defaultLookup().emplace(std::move(row.owner));
+      }
+    }
+
+    void finishRow(DetachedRow const &row) {
+      auto const entry = row.owned;
+      refilter<0>(entry, row.inIndexes);
+      if constexpr(hasSpatial) {
+        if (row.changed[spatialParts.first] || row.changed[spatialParts.second]) {
+          spatial.val.insert(entry);
+        }
+      }
+      notify(Change::Update, *entry, row.before ? &*row.before : nullptr);
+    }
+
+    // Whether the table would keep every enforced uniqueness after tx
+    template<std::size_t N>
+    bool allowsBatch(Transaction const &tx) const {
+      if constexpr(N < std::tuple_size_v<Entry>) {
+        if constexpr(Custom::Unique<Entry, N>{}() == Custom::Uniqueness::EnforceUnique) {
+          // The values the rows written by tx end up with, which may only
+          // clash with rows that tx also writes or erases
+          std::vector<Entry const *> rows;
+          for (auto &[entry, value] : tx.rows) {
+            if (value) {
+              rows.emplace_back(&*value);
+            }
+          }
+          for (auto &entry : tx.inserted) {
+            rows.emplace_back(entry.get());
+          }
+
+          std::sort(rows.begin(), rows.end(), Compare<N>{});
+          if (std::adjacent_find(rows.begin(), rows.end(), [](auto lhs, auto rhs) {
+            return !Compare<N>{}(lhs, rhs);
+          }) != rows.end()) {
+            return false;
+          }
+
+          auto &index = std::get<N>(luts);
+          auto it = index.begin();
+          for (auto row : rows) {
+            it = seek<N>(index, it, row);
+            if (it == index.end()) {
+              break;
+            }
+            if (!Compare<N>{}(row, *it) && !tx.touched.find(&**it)) {
+              return false;
+            }
+          }
+        }
+        return allowsBatch<N + 1>(tx);
+      }
+      else {
+        return true;
+      }
+    }
+
+    bool apply(Transaction &tx) {
+      if (!allowsBatch<0>(tx)) {
+        return false;
+      }
+
+      // Erasing first frees the unique values of the erased rows
+      for (auto &[entry, value] : tx.rows) {
+        if (!value) {
+          erase(entry);
+        }
+      }
+
+      // Every updated row lets go of its old values before any row takes
+      // its new ones, so rows may trade unique values
+      std::vector<std::pair<DetachedRow, Entry *>> updated;
+      for (auto &[entry, value] : tx.rows) {
+        if (value) {
+          auto const changed = changedParts(*entry, *value, std::make_index_sequence<std::tuple_size_v<Entry>>{});
+          if (std::find(changed.begin(), changed.end(), true) != changed.end()) {
+            updated.emplace_back(detachRow(entry, changed), &*value);
+          }
+        }
+      }
+      for (auto &[row, value] : updated) {
+        placeRow(row, std::move(*value));
+      }
+      reindexBatch<0>(updated);
+      for (auto &[row, value] : updated) {
+        finishRow(row);
+      }
+
+      insertBatch(tx.inserted);
+      return true;
+    }
+
+    // Inserts entries, which are known to keep every enforced uniqueness,
+    // one index at a time in the order of that index
+    void insertBatch(std::vector<std::unique_ptr<Entry>> &entries) {
+      std::vector<Entry *> rows;
+      rows.reserve(entries.size());
+      for (auto &entry : entries) {
+        rows.emplace_back(entry.get());
+        if constexpr(hasBitmaps) {
+          rowIds.val->assign(entry.get());
+        }
+      }
+
+      indexBatch<0>(rows);
+      constexpr auto defaultPart = Custom::DefaultLookup<Entry>{}();
+      std::stable_sort(entries.begin(), entries.end(), Compare<defaultPart>{});
+      insertSorted<defaultPart>(defaultLookup(), entries);
+      entries.clear();
+      countRows();
+
+      for (auto entry : rows) {
+        if constexpr(hasSpatial) {
+          spatial.val.insert(entry);
+        }
+        addToBlooms<0>(*entry);
+      }
+      for (auto entry : rows) {
+        notify(Change::Insert, *entry);
+      }
+    }
+
+    // Does reindexParts for every row, one index at a time in the order of
+    // that index
+    template<std::size_t N, typename Rows>
+    void reindexBatch(Rows const &rows) {
+      if constexpr(N < std::tuple_size_v<Entry>) {
+        if constexpr(N != Custom::DefaultLookup<Entry>{}() && alwaysIndexed<N>) {
+          std::vector<Entry *> sorted;
+          for (auto &[row, value] : rows) {
+            if (row.changed[N]) {
+              sorted.emplace_back(row.owned);
+            }
+          }
+          std::stable_sort(sorted.begin(), sorted.end(), Compare<N>{});
+          insertSorted<N>(std::get<N>(luts), sorted);
+        }
+        if constexpr(hasBloom<N>) {
+          for (auto &[row, value] : rows) {
+            if (row.changed[N]) {
+              replaceInBloom<N>(*row.owned);
+            }
+          }
+        }
+        reindexBatch<N + 1>(rows);
+      }
+    }
+
+    template<std::size_t N>
+    void indexBatch(std::vector<Entry *> const &rows) {
+      if constexpr(N < std::tuple_size_v<Entry>) {
+        if constexpr(N != Custom::DefaultLookup<Entry>{}() && !isNone<N>) {
+          std::vector<Entry *> sorted;
+          sorted.reserve(rows.size());
+          std::copy_if(rows.begin(), rows.end(), std::back_inserter(sorted), [&](Entry *entry) {
+            return inLut<N>(*entry);
+          });
+          std::stable_sort(sorted.begin(), sorted.end(), Compare<N>{});
+          insertSorted<N>(std::get<N>(luts), sorted);
+        }
+        indexBatch<N + 1>(rows);
+      }
+    }
+
+    // Inserts values, sorted in the order of index N. Where the index takes
+    // hints, each one is placed starting from where the one before it went,
+    // so runs of values between the same two neighbours skip the descent.
+    template<std::size_t N, typename Index, typename Values>
+    static void insertSorted(Index &index, Values &values) {
+      if constexpr(Detail::HasEmplaceHint<Index>::value) {
+        auto hint = index.begin();
+        for (auto &value : values) {
+          hint = std::next(index.emplace_hint(seek<N>(index, hint, value), std::move(value)));
+        }
+      }
+      else {
+        for (auto &value : values) {
+          index.emplace(std::move(value));
+        }
+      }
+    }
+
+    // Applies change to part N of entry and moves it within the indexes
+    // ordered by that part. Filtered indexes are checked again as well, as
+    // their filters may look at any part.
+    template<std::size_t N, typename F>
+    void changePart(Entry const *entry, F &&change) {
+      auto const before = snapshot(*entry);
+      auto inIndexes = indexStates(*entry, std::make_index_sequence<std::tuple_size_v<Entry>>{});
+      if constexpr(isSpatial<N>) {
+        spatial.val.erase(entry);
+      }
+      if constexpr(!alwaysIndexed<N>) {
+        if constexpr(!isNone<N>) {
+          if (inIndexes[N]) {
+            std::get<N>(luts).erase(findInLut<N>(entry));
+            inIndexes[N] = false;
+          }
+        }
+        change(std::get<N>(*ownedEntry(entry)));
+      }
+      else {
+        auto dbEntry = std::move(moveOutOfTable<N>(entry).value());
+        change(std::get<N>(*dbEntry));
+        std::get<N>(luts).emplace(std::move(dbEntry));
+      }
+      refilter<0>(entry, inIndexes);
+      if constexpr(isSpatial<N>) {
+        spatial.val.insert(entry);
+      }
+      replaceInBloom<N>(*entry);
+      notify(Change::Update, *entry, before ? &*before : nullptr);
+    }
+
+    // A copy of entry for the listeners to compare with after an update
+    std::optional<Entry> snapshot(Entry const &entry) const {
+      if constexpr(std::is_copy_constructible_v<Entry>) {
+        if (!listeners.empty()) {
+          return entry;
+        }
+      }
+      return std::nullopt;
+    }
+
+    void notify(Change change, Entry const &entry, Entry const *before = nullptr) {
+      struct Guard {
+        ~Guard() {
+          if (!--table.notifying) {
+            table.dropUnsubscribed();
+          }
+        }
+
+        Table &table;
+      } guard{ (++notifying, *this) };
+
+      // By index, as listeners subscribing may move the others
+      for (std::size_t i = 0, n = listeners.size(); i < n; ++i) {
+        if (listeners[i].first) {
+          listeners[i].second(change, entry, before);
+        }
+      }
+    }
+
+    void dropUnsubscribed() {
+      listeners.erase(std::remove_if(listeners.begin(), listeners.end(), [](auto const &listener) {
+        return listener.first == 0;
+      }), listeners.end());
+    }
+
+    template<std::size_t ...Is>
+    auto indexStates(Entry const &entry, std::index_sequence<Is...>) const {
+      return std::array<bool, sizeof...(Is)>{ inLut<Is>(entry)... };
+    }
+
+    // Adds entry to or removes it from the indexes it has moved
+    // into or out of since inIndexes was taken
+    template<std::size_t N, typename States>
+    void refilter(Entry const *entry, States const &inIndexes) {
+      if constexpr(N < std::tuple_size_v<Entry>) {
+        if constexpr(!alwaysIndexed<N> && !isNone<N>) {
+          auto const now = inLut<N>(*entry);
+          if (inIndexes[N] && !now) {
+            std::get<N>(luts).erase(findInLut<N>(entry));
+          }
+          else if (!inIndexes[N] && now) {
+            std::get<N>(luts).emplace(ownedEntry(entry));
+          }
+        }
+        refilter<N + 1>(entry, inIndexes);
+      }
+    }
+
+    // The entry as the table owns it, for indexes that aren't holding it
+    Entry *ownedEntry(Entry const *entry) {
+      return &**defaultLookup().find(entry);
+    }
+
     template<std::size_t N, typename T>
     auto moveOutOfTable(T const &val) {
       return std::get<N>(luts).extract(findInLut<N>(val));
@@ -567,7 +3002,8 @@ namespace CQL {
     auto shouldInsert(T const &val) const {
       if constexpr(N < std::tuple_size<Entry>::value) {
         if constexpr(Custom::Unique<Entry, N>{}() == Custom::Uniqueness::EnforceUnique) {
-          return (std::get<N>(luts).find(val) == std::get<N>(luts).end()) && shouldInsert<N + 1>(val);
+          return (!mayContain<N>(val) || std::get<N>(luts).find(val) == std::get<N>(luts).end())
+              && shouldInsert<N + 1>(val);
         }
         else {
           return shouldInsert<N + 1>(val);
@@ -579,11 +3015,25 @@ namespace CQL {
     }
   };
 
+  // Joins the entries of a query on another table with the entries of right
+  // where std::get<LeftCol>(left) == std::get<RightCol>(right), passing
+  // (left, right) pairs to the functor. By default this is a merge join if
+  // the query can be walked in the order of LeftCol, and otherwise an index
+  // nested loop join over the RightCol index of right.
+  template<std::size_t LeftCol, std::size_t RightCol, JoinStrategy Strategy = JoinStrategy::Auto,
+           typename LeftExpr, typename Right>
+  auto join(LeftExpr &&left, Table<Right> const &right) {
+    return typename Table<Right>::template Join<LeftCol, RightCol, Strategy, remove_cvref_v<LeftExpr>>{
+      remove_cvref_v<LeftExpr>{ std::forward<LeftExpr>(left) }, right
+    };
+  }
+
   template<typename T>
   struct Detail::Serialize<Table<T>> {
     void operator()(std::ostream &os, Table<T> const &table) const {
       uint64_t const s = table.size();
       serialize(os, s);
+      Detail::DictionaryScopes<T> dictionaries;
       for (auto &entry : table) {
         serialize(os, entry);
       }
@@ -595,6 +3045,7 @@ namespace CQL {
     Table<T> operator()(std::istream &is) const {
       Table<T> table;
       auto const s = static_cast<std::size_t>(deserialize<uint64_t>(is));
+      Detail::DictionaryScopes<T> dictionaries;
 
       for(std::size_t i = 0; i < s; ++ i) {
         table.emplace(deserialize<T>(is));
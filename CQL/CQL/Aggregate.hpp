@@ -0,0 +1,129 @@
+#pragma once
+
+#include <type_traits>
+#include <cstddef>
+#include <tuple>
+
+namespace CQL {
+  namespace Detail {
+    // Part N of entry, through a get<N> next to the entry's type if there
+    // is one, such as for the rows of a ColumnTable
+    template<std::size_t N, typename Entry>
+    decltype(auto) part(Entry const &entry) {
+      using std::get;
+      return get<N>(entry);
+    }
+  }
+
+  // Aggregates for groupBy. Each aggregate describes an Accumulator for a
+  // given Entry type that can add entries, merge partial results from
+  // another accumulator and produce the final result. Those that can also
+  // remove entries again can be used in views, see View.hpp.
+
+  struct Count {
+    template<typename Entry>
+    struct Accumulator {
+      void add(Entry const &) { ++count; }
+      void remove(Entry const &) { --count; }
+      void merge(Accumulator const &other) { count += other.count; }
+      std::size_t result() const { return count; }
+
+      std::size_t count = 0;
+    };
+  };
+
+  template<std::size_t Ind>
+  struct Sum {
+    template<typename Entry>
+    struct Accumulator {
+      using value_type = std::decay_t<std::tuple_element_t<Ind, Entry>>;
+
+      void add(Entry const &entry) { sum += Detail::part<Ind>(entry); }
+      void remove(Entry const &entry) { sum -= Detail::part<Ind>(entry); }
+      void merge(Accumulator const &other) { sum += other.sum; }
+      value_type result() const { return sum; }
+
+      value_type sum{};
+    };
+  };
+
+  template<std::size_t Ind>
+  struct Min {
+    template<typename Entry>
+    struct Accumulator {
+      using value_type = std::decay_t<std::tuple_element_t<Ind, Entry>>;
+
+      void add(Entry const &entry) {
+        if (!seen || Detail::part<Ind>(entry) < min) {
+          min = Detail::part<Ind>(entry);
+          seen = true;
+        }
+      }
+
+      void merge(Accumulator const &other) {
+        if (other.seen && (!seen || other.min < min)) {
+          min = other.min;
+          seen = true;
+        }
+      }
+
+      value_type result() const { return min; }
+
+      value_type min{};
+      bool seen = false;
+    };
+  };
+
+  template<std::size_t Ind>
+  struct Max {
+    template<typename Entry>
+    struct Accumulator {
+      using value_type = std::decay_t<std::tuple_element_t<Ind, Entry>>;
+
+      void add(Entry const &entry) {
+        if (!seen || max < Detail::part<Ind>(entry)) {
+          max = Detail::part<Ind>(entry);
+          seen = true;
+        }
+      }
+
+      void merge(Accumulator const &other) {
+        if (other.seen && (!seen || max < other.max)) {
+          max = other.max;
+          seen = true;
+        }
+      }
+
+      value_type result() const { return max; }
+
+      value_type max{};
+      bool seen = false;
+    };
+  };
+
+  template<std::size_t Ind>
+  struct Avg {
+    template<typename Entry>
+    struct Accumulator {
+      void add(Entry const &entry) {
+        sum += static_cast<double>(Detail::part<Ind>(entry));
+        ++count;
+      }
+
+      void remove(Entry const &entry) {
+        sum -= static_cast<double>(Detail::part<Ind>(entry));
+        --count;
+      }
+
+      void merge(Accumulator const &other) {
+        sum += other.sum;
+        count += other.count;
+      }
+
+      double result() const { return count ? sum / static_cast<double>(count) : 0.0; }
+
+      double sum = 0.0;
+      std::size_t count = 0;
+    };
+  };
+}
@@ -0,0 +1,455 @@
+#pragma once
+
+#include "Bits.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace CQL {
+  // A compressed set of 32-bit integers in the style of roaring bitmaps.
+  // Values are grouped by their high 16 bits into containers. A container
+  // keeps the low 16 bits as a sorted array while it holds few values, and
+  // as a plain 65536 bit bitmap once the array would be larger than that.
+  struct Bitmap {
+    // Returned by next() and prev() when there is no such value
+    static constexpr std::uint64_t npos = std::uint64_t{ 1 } << 32;
+
+    std::size_t size() const {
+      std::size_t ret = 0;
+      for (auto &c : containers) {
+        ret += c.count;
+      }
+      return ret;
+    }
+
+    bool empty() const {
+      return containers.empty();
+    }
+
+    void clear() {
+      containers.clear();
+    }
+
+    bool contains(std::uint32_t val) const {
+      auto c = find(high(val));
+      return c != containers.end() && c->contains(low(val));
+    }
+
+    // Returns false if val was already in the set
+    bool add(std::uint32_t val) {
+      auto c = lowerBound(high(val));
+      if (c == containers.end() || c->high != high(val)) {
+        c = containers.insert(c, Container{ high(val) });
+      }
+      return c->add(low(val));
+    }
+
+    // Returns false if val wasn't in the set
+    bool remove(std::uint32_t val) {
+      auto c = lowerBound(high(val));
+      if (c == containers.end() || c->high != high(val) || !c->remove(low(val))) {
+        return false;
+      }
+      if (!c->count) {
+        containers.erase(c);
+      }
+      return true;
+    }
+
+    // The smallest value >= from, npos if there is none
+    std::uint64_t next(std::uint64_t from) const {
+      if (from >= npos) {
+        return npos;
+      }
+
+      for (auto c = lowerBound(high(static_cast<std::uint32_t>(from))); c != containers.end(); ++c) {
+        auto const start = c->high == high(static_cast<std::uint32_t>(from)) ? low(static_cast<std::uint32_t>(from)) : 0u;
+        if (auto l = c->next(start); l <= 0xffff) {
+          return (std::uint64_t{ c->high } << 16) | l;
+        }
+      }
+      return npos;
+    }
+
+    // The largest value <= from, npos if there is none
+    std::uint64_t prev(std::uint64_t from) const {
+      from = std::min<std::uint64_t>(from, 0xffffffff);
+      auto const h = high(static_cast<std::uint32_t>(from));
+      for (auto c = std::make_reverse_iterator(upperBound(h)); c != containers.rend(); ++c) {
+        auto const start = c->high == h ? static_cast<int>(low(static_cast<std::uint32_t>(from))) : 0xffff;
+        if (auto l = c->prev(start); l >= 0) {
+          return (std::uint64_t{ c->high } << 16) | static_cast<std::uint32_t>(l);
+        }
+      }
+      return npos;
+    }
+
+    std::uint64_t first() const {
+      return next(0);
+    }
+
+    std::uint64_t last() const {
+      return prev(0xffffffff);
+    }
+
+    // Calls functor with every value, in increasing order
+    template<typename F>
+    void forEach(F &&functor) const {
+      for (auto &c : containers) {
+        auto const base = std::uint32_t{ c.high } << 16;
+        if (c.dense()) {
+          for (std::size_t w = 0; w < c.bits.size(); ++w) {
+            for (auto word = c.bits[w]; word; word &= word - 1) {
+              functor(base | static_cast<std::uint32_t>(w * 64 + Detail::countTrailingZeros(word)));
+            }
+          }
+        }
+        else {
+          for (auto l : c.array) {
+            functor(base | l);
+          }
+        }
+      }
+    }
+
+    Bitmap &operator&=(Bitmap const &other) {
+      std::vector<Container> ret;
+      auto o = other.containers.begin();
+      for (auto &c : containers) {
+        while (o != other.containers.end() && o->high < c.high) ++o;
+        if (o == other.containers.end()) {
+          break;
+        }
+        if (o->high == c.high) {
+          if (auto both = intersect(c, *o); both.count) {
+            ret.emplace_back(std::move(both));
+          }
+        }
+      }
+      containers = std::move(ret);
+      return *this;
+    }
+
+    Bitmap &operator|=(Bitmap const &other) {
+      std::vector<Container> ret;
+      ret.reserve(std::max(containers.size(), other.containers.size()));
+      auto l = containers.begin();
+      auto r = other.containers.begin();
+      while (l != containers.end() || r != other.containers.end()) {
+        if (r == other.containers.end() || (l != containers.end() && l->high < r->high)) {
+          ret.emplace_back(std::move(*l++));
+        }
+        else if (l == containers.end() || r->high < l->high) {
+          ret.emplace_back(*r++);
+        }
+        else {
+          ret.emplace_back(unite(std::move(*l++), *r++));
+        }
+      }
+      containers = std::move(ret);
+      return *this;
+    }
+
+    // Removes the values in other
+    Bitmap &operator-=(Bitmap const &other) {
+      std::vector<Container> ret;
+      ret.reserve(containers.size());
+      auto o = other.containers.begin();
+      for (auto &c : containers) {
+        while (o != other.containers.end() && o->high < c.high) ++o;
+        if (o == other.containers.end() || o->high != c.high) {
+          ret.emplace_back(std::move(c));
+        }
+        else if (auto rest = subtract(std::move(c), *o); rest.count) {
+          ret.emplace_back(std::move(rest));
+        }
+      }
+      containers = std::move(ret);
+      return *this;
+    }
+
+    friend Bitmap operator&(Bitmap lhs, Bitmap const &rhs) {
+      return lhs &= rhs;
+    }
+
+    friend Bitmap operator|(Bitmap lhs, Bitmap const &rhs) {
+      return lhs |= rhs;
+    }
+
+    friend Bitmap operator-(Bitmap lhs, Bitmap const &rhs) {
+      return lhs -= rhs;
+    }
+
+    friend bool operator==(Bitmap const &lhs, Bitmap const &rhs) {
+      return lhs.containers == rhs.containers;
+    }
+
+    friend bool operator!=(Bitmap const &lhs, Bitmap const &rhs) {
+      return !(lhs == rhs);
+    }
+
+    std::size_t memoryUsage() const {
+      auto ret = containers.capacity() * sizeof(Container);
+      for (auto &c : containers) {
+        ret += c.array.capacity() * sizeof(std::uint16_t) + c.bits.capacity() * sizeof(std::uint64_t);
+      }
+      return ret;
+    }
+
+  private:
+    // Above this many values a container is cheaper as a bitmap
+    static constexpr std::uint32_t maxArray = 4096;
+    static constexpr std::size_t words = 65536 / 64;
+
+    struct Container {
+      Container(std::uint16_t high) : high{ high } { }
+
+      bool dense() const {
+        return !bits.empty();
+      }
+
+      bool contains(std::uint16_t l) const {
+        if (dense()) {
+          return (bits[l / 64] >> (l % 64)) & 1;
+        }
+        return std::binary_search(array.begin(), array.end(), l);
+      }
+
+      bool add(std::uint16_t l) {
+        if (dense()) {
+          auto &word = bits[l / 64];
+          auto const bit = std::uint64_t{ 1 } << (l % 64);
+          if (word & bit) {
+            return false;
+          }
+          word |= bit;
+        }
+        else {
+          auto it = std::lower_bound(array.begin(), array.end(), l);
+          if (it != array.end() && *it == l) {
+            return false;
+          }
+          array.insert(it, l);
+        }
+
+        if (++count > maxArray && !dense()) {
+          toBits();
+        }
+        return true;
+      }
+
+      bool remove(std::uint16_t l) {
+        if (dense()) {
+          auto &word = bits[l / 64];
+          auto const bit = std::uint64_t{ 1 } << (l % 64);
+          if (!(word & bit)) {
+            return false;
+          }
+          word &= ~bit;
+        }
+        else {
+          auto it = std::lower_bound(array.begin(), array.end(), l);
+          if (it == array.end() || *it != l) {
+            return false;
+          }
+          array.erase(it);
+        }
+
+        if (--count <= maxArray && dense()) {
+          toArray();
+        }
+        return true;
+      }
+
+      // The smallest low value >= from, above 0xffff if there is none
+      std::uint32_t next(std::uint32_t from) const {
+        if (dense()) {
+          for (auto w = from / 64; w < words; ++w) {
+            auto word = bits[w];
+            if (w == from / 64) {
+              word &= ~std::uint64_t{ 0 } << (from % 64);
+            }
+            if (word) {
+              return static_cast<std::uint32_t>(w * 64 + Detail::countTrailingZeros(word));
+            }
+          }
+          return 0x10000;
+        }
+
+        auto it = std::lower_bound(array.begin(), array.end(), from);
+        return it == array.end() ? 0x10000 : *it;
+      }
+
+      // The largest low value <= from, negative if there is none
+      int prev(int from) const {
+        if (dense()) {
+          for (auto w = from / 64; w >= 0; --w) {
+            auto word = bits[static_cast<std::size_t>(w)];
+            if (w == from / 64 && from % 64 != 63) {
+              word &= (std::uint64_t{ 1 } << (from % 64 + 1)) - 1;
+            }
+            if (word) {
+              return static_cast<int>(w * 64 + 63 - static_cast<int>(Detail::countLeadingZeros(word)));
+            }
+          }
+          return -1;
+        }
+
+        auto it = std::upper_bound(array.begin(), array.end(), from);
+        return it == array.begin() ? -1 : *std::prev(it);
+      }
+
+      void toBits() {
+        bits.assign(words, 0);
+        for (auto l : array) {
+          bits[l / 64] |= std::uint64_t{ 1 } << (l % 64);
+        }
+        array = {};
+      }
+
+      void toArray() {
+        array.clear();
+        array.reserve(count);
+        for (std::size_t w = 0; w < words; ++w) {
+          for (auto word = bits[w]; word; word &= word - 1) {
+            array.emplace_back(static_cast<std::uint16_t>(w * 64 + Detail::countTrailingZeros(word)));
+          }
+        }
+        bits = {};
+      }
+
+      // Picks the cheaper representation after a bulk operation
+      void normalize() {
+        if (dense()) {
+          count = 0;
+          for (auto w : bits) {
+            count += static_cast<std::uint32_t>(Detail::popcount(w));
+          }
+          if (count <= maxArray) {
+            toArray();
+          }
+        }
+        else {
+          count = static_cast<std::uint32_t>(array.size());
+          if (count > maxArray) {
+            toBits();
+          }
+        }
+      }
+
+      friend bool operator==(Container const &lhs, Container const &rhs) {
+        return lhs.high == rhs.high && lhs.array == rhs.array && lhs.bits == rhs.bits;
+      }
+
+      std::uint16_t high;
+      std::uint32_t count = 0;
+      std::vector<std::uint16_t> array;
+      std::vector<std::uint64_t> bits;
+    };
+
+    static Container intersect(Container const &lhs, Container const &rhs) {
+      Container ret{ lhs.high };
+      if (lhs.dense() && rhs.dense()) {
+        ret.bits.resize(words);
+        for (std::size_t w = 0; w < words; ++w) {
+          ret.bits[w] = lhs.bits[w] & rhs.bits[w];
+        }
+      }
+      else if (lhs.dense() || rhs.dense()) {
+        auto &sparse = lhs.dense() ? rhs : lhs;
+        auto &dense = lhs.dense() ? lhs : rhs;
+        std::copy_if(sparse.array.begin(), sparse.array.end(), std::back_inserter(ret.array),
+                     [&](std::uint16_t l) { return dense.contains(l); });
+      }
+      else {
+        std::set_intersection(lhs.array.begin(), lhs.array.end(), rhs.array.begin(), rhs.array.end(),
+                              std::back_inserter(ret.array));
+      }
+      ret.normalize();
+      return ret;
+    }
+
+    static Container unite(Container &&lhs, Container const &rhs) {
+      if (!lhs.dense() && !rhs.dense() && lhs.count + rhs.count <= maxArray) {
+        Container ret{ lhs.high };
+        ret.array.reserve(lhs.count + rhs.count);
+        std::set_union(lhs.array.begin(), lhs.array.end(), rhs.array.begin(), rhs.array.end(),
+                       std::back_inserter(ret.array));
+        ret.normalize();
+        return ret;
+      }
+
+      if (!lhs.dense()) {
+        lhs.toBits();
+      }
+      if (rhs.dense()) {
+        for (std::size_t w = 0; w < words; ++w) {
+          lhs.bits[w] |= rhs.bits[w];
+        }
+      }
+      else {
+        for (auto l : rhs.array) {
+          lhs.bits[l / 64] |= std::uint64_t{ 1 } << (l % 64);
+        }
+      }
+      lhs.normalize();
+      return std::move(lhs);
+    }
+
+    static Container subtract(Container &&lhs, Container const &rhs) {
+      if (lhs.dense()) {
+        if (rhs.dense()) {
+          for (std::size_t w = 0; w < words; ++w) {
+            lhs.bits[w] &= ~rhs.bits[w];
+          }
+        }
+        else {
+          for (auto l : rhs.array) {
+            lhs.bits[l / 64] &= ~(std::uint64_t{ 1 } << (l % 64));
+          }
+        }
+      }
+      else {
+        lhs.array.erase(std::remove_if(lhs.array.begin(), lhs.array.end(),
+                                       [&](std::uint16_t l) { return rhs.contains(l); }),
+                        lhs.array.end());
+      }
+      lhs.normalize();
+      return std::move(lhs);
+    }
+
+    static std::uint16_t high(std::uint32_t val) {
+      return static_cast<std::uint16_t>(val >> 16);
+    }
+
+    static std::uint16_t low(std::uint32_t val) {
+      return static_cast<std::uint16_t>(val & 0xffff);
+    }
+
+    std::vector<Container>::const_iterator lowerBound(std::uint16_t h) const {
+      return std::lower_bound(containers.begin(), containers.end(), h,
+                              [](Container const &c, std::uint16_t h) { return c.high < h; });
+    }
+
+    std::vector<Container>::iterator lowerBound(std::uint16_t h) {
+      return std::lower_bound(containers.begin(), containers.end(), h,
+                              [](Container const &c, std::uint16_t h) { return c.high < h; });
+    }
+
+    std::vector<Container>::const_iterator upperBound(std::uint16_t h) const {
+      return std::upper_bound(containers.begin(), containers.end(), h,
+                              [](std::uint16_t h, Container const &c) { return h < c.high; });
+    }
+
+    std::vector<Container>::const_iterator find(std::uint16_t h) const {
+      auto c = lowerBound(h);
+      return c != containers.end() && c->high == h ? c : containers.end();
+    }
+
+    std::vector<Container> containers;
+  };
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+#include "FlatHashMap.hpp"
+#include "Memory.hpp"
+#include "Bitmap.hpp"
+
+#include <type_traits>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <map>
+
+namespace CQL {
+  // Dense ids for the entries of a table, handed out in insertion order
+  // and reused once their entry is gone, so bitmaps over them stay small
+  template<typename Entry>
+  struct RowIds {
+    static constexpr std::uint32_t none = ~std::uint32_t{ 0 };
+
+    std::uint32_t assign(Entry *entry) {
+      std::uint32_t id;
+      if (free.empty()) {
+        id = static_cast<std::uint32_t>(rows.size());
+        rows.emplace_back(entry);
+      }
+      else {
+        id = free.back();
+        free.pop_back();
+        rows[id] = entry;
+      }
+      ids[entry] = id;
+      return id;
+    }
+
+    void release(Entry const *entry) {
+      if (auto id = ids.find(entry)) {
+        rows[*id] = nullptr;
+        free.emplace_back(*id);
+        ids.erase(entry);
+      }
+    }
+
+    // The id of entry, none if it isn't in the table
+    std::uint32_t id(Entry const *entry) const {
+      auto id = ids.find(entry);
+      return id ? *id : none;
+    }
+
+    Entry *const &row(std::uint32_t id) const {
+      return rows[id];
+    }
+
+    // The ids of every row
+    Bitmap all() const {
+      Bitmap ret;
+      for (std::uint32_t id = 0; id < rows.size(); ++id) {
+        if (rows[id]) {
+          ret.add(id);
+        }
+      }
+      return ret;
+    }
+
+    void clear() {
+      rows.clear();
+      free.clear();
+      ids.clear();
+    }
+
+    std::size_t memoryUsage() const {
+      return rows.capacity() * sizeof(Entry *) + free.capacity() * sizeof(std::uint32_t) + ids.memoryUsage();
+    }
+
+  private:
+    std::vector<Entry *> rows;
+    std::vector<std::uint32_t> free;
+    Detail::FlatHashMap<Entry const *, std::uint32_t> ids;
+  };
+
+  // An index holding one Bitmap of row ids per distinct value. It costs a
+  // few bits per entry instead of a tree node, and queries on it can be
+  // combined with bitmap operations. Iterates like a std::multiset<Entry *>
+  // ordered by value, and by row id between equal values.
+  template<typename Entry, typename Compare>
+  struct BitmapIndex {
+    using value_type = Entry *;
+    using key_type = std::remove_cv_t<std::remove_reference_t<
+      decltype(Compare::key(std::declval<Entry *const &>()))>>;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+
+  private:
+    using Map = std::map<key_type, Bitmap, Compare, Detail::CountingAllocator<std::pair<key_type const, Bitmap>>>;
+
+  public:
+    struct iterator {
+      using iterator_category = std::bidirectional_iterator_tag;
+      using value_type = Entry *;
+      using difference_type = std::ptrdiff_t;
+      using pointer = Entry *const *;
+      using reference = Entry *const &;
+
+      iterator() = default;
+
+      reference operator*() const { return index->rowIds->row(static_cast<std::uint32_t>(row)); }
+      pointer operator->() const { return &**this; }
+
+      iterator &operator++() {
+        row = group->second.next(row + 1);
+        if (row == Bitmap::npos && ++group != index->groups.end()) {
+          row = group->second.first();
+        }
+        return *this;
+      }
+
+      iterator operator++(int) {
+        auto ret = *this;
+        ++*this;
+        return ret;
+      }
+
+      iterator &operator--() {
+        if (group == index->groups.end() || !row || (row = group->second.prev(row - 1)) == Bitmap::npos) {
+          --group;
+          row = group->second.last();
+        }
+        return *this;
+      }
+
+      iterator operator--(int) {
+        auto ret = *this;
+        --*this;
+        return ret;
+      }
+
+      bool operator==(iterator const &other) const { return group == other.group && row == other.row; }
+      bool operator!=(iterator const &other) const { return !(*this == other); }
+
+    private:
+      friend struct BitmapIndex;
+
+      iterator(typename Map::const_iterator group, std::uint64_t row, BitmapIndex const *index) :
+        group{ group }, row{ row }, index{ index } { }
+
+      typename Map::const_iterator group;
+      std::uint64_t row = Bitmap::npos;
+      BitmapIndex const *index = nullptr;
+    };
+
+    using const_iterator = iterator;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = reverse_iterator;
+
+    struct node_type {
+      Entry *&value() { return val; }
+
+    private:
+      friend struct BitmapIndex;
+      explicit node_type(Entry *val) : val{ val } { }
+      Entry *val;
+    };
+
+    explicit BitmapIndex(RowIds<Entry> const *rowIds) : rowIds{ rowIds } { }
+
+    iterator begin() const { return at(groups.begin()); }
+    iterator end() const { return { groups.end(), Bitmap::npos, this }; }
+    reverse_iterator rbegin() const { return reverse_iterator{ end() }; }
+    reverse_iterator rend() const { return reverse_iterator{ begin() }; }
+
+    std::size_t size() const { return entries; }
+    bool empty() const { return !entries; }
+
+    void clear() {
+      groups.clear();
+      entries = 0;
+    }
+
+    iterator emplace(Entry *entry) {
+      auto const id = rowIds->id(entry);
+      auto group = groups.try_emplace(Compare::key(entry)).first;
+      group->second.add(id);
+      ++entries;
+      return { group, id, this };
+    }
+
+    iterator erase(iterator it) {
+      auto next = std::next(it);
+      remove(it);
+      return next;
+    }
+
+    node_type extract(iterator it) {
+      node_type ret{ *it };
+      remove(it);
+      return ret;
+    }
+
+    // The position of entry itself, without scanning its equal values
+    iterator findRow(Entry const *entry) const {
+      auto group = groups.find(Compare::key(entry));
+      auto const id = rowIds->id(entry);
+      if (group == groups.end() || !group->second.contains(id)) {
+        return end();
+      }
+      return { group, id, this };
+    }
+
+    template<typename K>
+    iterator find(K const &key) const {
+      auto group = groups.find(key);
+      return group == groups.end() ? end() : at(group);
+    }
+
+    template<typename K>
+    std::size_t count(K const &key) const {
+      auto group = groups.find(key);
+      return group == groups.end() ? 0 : group->second.size();
+    }
+
+    template<typename K>
+    iterator lower_bound(K const &key) const {
+      return at(groups.lower_bound(key));
+    }
+
+    template<typename K>
+    iterator upper_bound(K const &key) const {
+      return at(groups.upper_bound(key));
+    }
+
+    template<typename K>
+    std::pair<iterator, iterator> equal_range(K const &key) const {
+      return { lower_bound(key), upper_bound(key) };
+    }
+
+    // The ids of all rows with lo <= value <= hi
+    template<typename Lt, typename Ht>
+    Bitmap rows(Lt const &lo, Ht const &hi) const {
+      Bitmap ret;
+      if (Compare{}(hi, lo)) {
+        return ret;
+      }
+
+      for (auto group = groups.lower_bound(lo), end = groups.upper_bound(hi); group != end; ++group) {
+        ret |= group->second;
+      }
+      return ret;
+    }
+
+    // The bytes of the groups and of the bitmaps in them
+    std::size_t memoryUsage() const {
+      auto ret = groups.get_allocator().allocated();
+      for (auto &[key, group] : groups) {
+        ret += Custom::HeapBytes<key_type>{}(key) + group.memoryUsage();
+      }
+      return ret;
+    }
+
+  private:
+    iterator at(typename Map::const_iterator group) const {
+      return { group, group == groups.end() ? Bitmap::npos : group->second.first(), this };
+    }
+
+    void remove(iterator it) {
+      auto group = groups.find(it.group->first);
+      group->second.remove(static_cast<std::uint32_t>(it.row));
+      if (group->second.empty()) {
+        groups.erase(group);
+      }
+      --entries;
+    }
+
+    Map groups;
+    std::size_t entries = 0;
+    RowIds<Entry> const *rowIds;
+  };
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace CQL::Detail {
+  inline std::size_t popcount(std::uint64_t w) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<std::size_t>(__builtin_popcountll(w));
+#else
+    std::size_t ret = 0;
+    for (; w; w &= w - 1) ++ret;
+    return ret;
+#endif
+  }
+
+  // w must not be 0
+  inline std::size_t countTrailingZeros(std::uint64_t w) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<std::size_t>(__builtin_ctzll(w));
+#else
+    std::size_t ret = 0;
+    for (; !(w & 1); w >>= 1) ++ret;
+    return ret;
+#endif
+  }
+
+  // w must not be 0
+  inline std::size_t countLeadingZeros(std::uint64_t w) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<std::size_t>(__builtin_clzll(w));
+#else
+    std::size_t ret = 0;
+    for (; !(w >> 63); w <<= 1) ++ret;
+    return ret;
+#endif
+  }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace CQL {
+  // A bloom filter over hashes of keys. mayContain is false only for
+  // hashes that were never added, so a negative answer lets a lookup skip
+  // the index entirely. Keys can't be taken out again: removals are only
+  // counted, and the owner is expected to rebuild the filter from scratch
+  // once needsRebuild() says too many of its bits are stale or it has grown
+  // past the size it was made for.
+  struct BloomFilter {
+    // About 1% false positives at capacity
+    static constexpr std::size_t bitsPerKey = 10;
+    static constexpr std::size_t hashes = 7;
+
+    BloomFilter() {
+      reset(0);
+    }
+
+    void reset(std::size_t expected) {
+      capacity = std::max<std::size_t>(expected, 64);
+      std::size_t size = 64;
+      while (size < capacity * bitsPerKey) {
+        size *= 2;
+      }
+      bits.assign(size / 64, 0);
+      added = removed = 0;
+    }
+
+    void add(std::size_t hash) {
+      forEachBit(hash, [&](std::size_t bit) {
+        bits[bit / 64] |= std::uint64_t{ 1 } << (bit % 64);
+        return true;
+      });
+      ++added;
+    }
+
+    void remove() {
+      ++removed;
+    }
+
+    bool mayContain(std::size_t hash) const {
+      return forEachBit(hash, [&](std::size_t bit) {
+        return ((bits[bit / 64] >> (bit % 64)) & 1) != 0;
+      });
+    }
+
+    bool needsRebuild() const {
+      return added > capacity || removed * 2 > added;
+    }
+
+    std::size_t memoryUsage() const {
+      return bits.capacity() * sizeof(std::uint64_t);
+    }
+
+  private:
+    // Double hashing on a remixed hash, as std::hash is often the identity
+    template<typename F>
+    bool forEachBit(std::size_t hash, F &&f) const {
+      auto h = static_cast<std::uint64_t>(hash);
+      h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+      h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+      h ^= h >> 31;
+      auto const step = (h >> 32) | 1;
+      auto const mask = bits.size() * 64 - 1;
+      for (std::size_t i = 0; i < hashes; ++i) {
+        if (!f(static_cast<std::size_t>((h + i * step) & mask))) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    std::vector<std::uint64_t> bits;
+    std::size_t capacity = 0, added = 0, removed = 0;
+  };
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "Dictionary.hpp"
+#include "Serialize.hpp"
+#include "Custom.hpp"
+#include "View.hpp"
+
+#include <unordered_set>
+#include <type_traits>
+#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <tuple>
+#include <set>
+
+namespace CQL {
+  namespace Detail {
+    // Entries are told apart between checkpoints by the unique part their
+    // table's default lookup orders by
+    template<typename Entry>
+    constexpr std::size_t checkpointPart = Custom::DefaultLookup<Entry>{}();
+
+    template<typename Entry>
+    using CheckpointKey = std::decay_t<std::tuple_element_t<checkpointPart<Entry>, Entry>>;
+  }
+
+  // Keeps track of the entries of a table changed since the last
+  // checkpoint, so that a checkpoint only has to write those. A delta
+  // holds the keys of the entries erased, then the entries emplaced or
+  // updated, and is applied on top of the checkpoint before it with
+  // applyDelta(). Entries are told apart by the part named by
+  // Custom::DefaultLookup. Like a view, it can't be moved, and neither can
+  // its table while it is alive.
+  template<typename Entry>
+  struct Checkpointer {
+    static_assert(Detail::checkpointPart<Entry> < std::tuple_size_v<Entry>,
+                  "Checkpoints tell entries apart by the part named by Custom::DefaultLookup");
+    static_assert(std::is_copy_constructible_v<Entry>,
+                  "Checkpoints need the entry from before an update, which needs Entry to be copyable");
+
+    using Key = Detail::CheckpointKey<Entry>;
+
+    explicit Checkpointer(Table<Entry> &table) :
+      table{ table },
+      subscription{ table, [this](Change change, Entry const &entry, Entry const *before) {
+        track(change, entry, before);
+      } } { }
+
+    // Writes the whole table, as serialize(os, table) does, to base the
+    // deltas after it on
+    void writeBase(std::ostream &os) {
+      serialize(os, table);
+      clear();
+    }
+
+    // Writes the changes since the last checkpoint
+    void writeDelta(std::ostream &os) {
+      Detail::DictionaryScopes<Entry> dictionaries;
+      serialize(os, static_cast<std::uint64_t>(erased.size()));
+      for (auto &key : erased) {
+        serialize(os, key);
+      }
+      serialize(os, static_cast<std::uint64_t>(dirty.size()));
+      for (auto entry : dirty) {
+        serialize(os, *entry);
+      }
+      clear();
+    }
+
+    // The entries emplaced or updated since the last checkpoint
+    std::size_t dirtyRows() const { return dirty.size(); }
+    // The keys erased since the last checkpoint, or moved away from by updates
+    std::size_t erasedRows() const { return erased.size(); }
+
+  private:
+    void track(Change change, Entry const &entry, Entry const *before) {
+      if (change == Change::Erase) {
+        dirty.erase(&entry);
+        erased.emplace(std::get<Detail::checkpointPart<Entry>>(entry));
+        return;
+      }
+
+      dirty.emplace(&entry);
+      if (before) {
+        auto const &was = std::get<Detail::checkpointPart<Entry>>(*before);
+        auto const &is = std::get<Detail::checkpointPart<Entry>>(entry);
+        if (was < is || is < was) {
+          erased.emplace(was);
+        }
+      }
+    }
+
+    void clear() {
+      dirty.clear();
+      erased.clear();
+    }
+
+    Table<Entry> &table;
+    std::unordered_set<Entry const *> dirty;
+    std::set<Key> erased;
+    Detail::Subscription<Entry> subscription;
+  };
+
+  // Applies a delta from Checkpointer::writeDelta() to the table holding
+  // the checkpoint before it, in one transaction. Returns false, leaving
+  // the table as it was, if it would break an enforced uniqueness.
+  template<typename Entry>
+  bool applyDelta(Table<Entry> &table, std::istream &is) {
+    constexpr auto part = Detail::checkpointPart<Entry>;
+    Detail::DictionaryScopes<Entry> dictionaries;
+    auto tx = table.transaction();
+
+    std::unordered_set<Entry const *> gone;
+    for (auto n = deserialize<std::uint64_t>(is); n--;) {
+      if (auto entry = table.template lookup<part>(deserialize<Detail::CheckpointKey<Entry>>(is))) {
+        tx.erase(entry);
+        gone.emplace(entry);
+      }
+    }
+
+    for (auto n = deserialize<std::uint64_t>(is); n--;) {
+      auto entry = deserialize<Entry>(is);
+      auto const old = table.template lookup<part>(std::get<part>(entry));
+      if (old && !gone.count(old)) {
+        tx.updateRow(old, std::move(entry));
+      }
+      else {
+        tx.emplace(std::move(entry));
+      }
+    }
+
+    return tx.commit();
+  }
+
+  // Merges a base from Checkpointer::writeBase() and the deltas written
+  // after it, oldest first, into a new base on out
+  template<typename Entry>
+  bool compact(std::istream &base, std::vector<std::istream *> const &deltas, std::ostream &out) {
+    auto table = deserialize<Table<Entry>>(base);
+    for (auto delta : deltas) {
+      if (!applyDelta(table, *delta)) {
+        return false;
+      }
+    }
+    serialize(out, table);
+    return true;
+  }
+}
@@ -0,0 +1,404 @@
+#pragma once
+
+#include "Aggregate.hpp"
+#include "Columnar.hpp"
+#include "Custom.hpp"
+
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <memory>
+#include <vector>
+#include <tuple>
+#include <set>
+
+namespace CQL {
+  namespace Detail {
+    template<typename Entry, std::size_t ...Is>
+    auto makeColumns(std::index_sequence<Is...>) {
+      return std::tuple<std::vector<std::decay_t<std::tuple_element_t<Is, Entry>>>...>{};
+    }
+
+    // One vector per part of Entry, indexed by row id
+    template<typename Entry>
+    using Columns = decltype(makeColumns<Entry>(std::make_index_sequence<std::tuple_size_v<Entry>>{}));
+  }
+
+  // An entry of a ColumnTable, reading its parts from the columns when
+  // asked for them. get<N>(row) and structured bindings work like they do
+  // on the entry itself, and row.entry() puts together a copy of it.
+  template<typename Entry>
+  struct ColumnRow {
+    ColumnRow(Detail::Columns<Entry> const &columns, std::uint32_t id) : columns{ &columns }, row{ id } { }
+
+    template<std::size_t N>
+    decltype(auto) get() const {
+      return std::get<N>(*columns)[row];
+    }
+
+    std::uint32_t id() const { return row; }
+
+    Entry entry() const {
+      return entry(std::make_index_sequence<std::tuple_size_v<Entry>>{});
+    }
+
+    template<std::size_t N>
+    friend decltype(auto) get(ColumnRow const &row) {
+      return row.template get<N>();
+    }
+
+  private:
+    template<std::size_t ...Is>
+    Entry entry(std::index_sequence<Is...>) const {
+      return Entry(std::decay_t<std::tuple_element_t<Is, Entry>>(get<Is>())...);
+    }
+
+    Detail::Columns<Entry> const *columns;
+    std::uint32_t row;
+  };
+
+  // A table keeping each part in a column of its own, addressed by row id,
+  // so that scanning or aggregating a part only reads the bytes of that
+  // part. Erased rows leave a tombstone until their id is handed out again.
+  // The indexes hold row ids, ordered by the value in their column.
+  // Custom::Unique and Indexing::None are followed, every other kind of
+  // index is an ordered one here.
+  template<typename Entry>
+  struct ColumnTable : Detail::ColumnSelect<ColumnTable<Entry>, Entry> {
+    using RowId = std::uint32_t;
+    using Row = ColumnRow<Entry>;
+
+    static constexpr RowId npos = ~RowId{ 0 };
+
+    template<std::size_t N>
+    using Key = std::decay_t<std::tuple_element_t<N, Entry>>;
+
+  private:
+    static constexpr std::size_t parts = std::tuple_size_v<Entry>;
+
+    template<std::size_t N>
+    static constexpr bool isIndexed = Custom::Index<Entry, N>{}() != Custom::Indexing::None;
+
+    template<std::size_t N>
+    static constexpr bool isUnique = Custom::Unique<Entry, N>{}() == Custom::Uniqueness::EnforceUnique;
+
+    // A value to look up in an index, which can't be mistaken for a row id
+    template<typename K>
+    struct Probe {
+      K const &key;
+    };
+
+    // Orders row ids by the value of part N, then by id. Probing with a
+    // value finds every id holding it.
+    template<std::size_t N>
+    struct ByValue {
+      using is_transparent = void;
+
+      bool operator()(RowId l, RowId r) const {
+        auto const &c = std::get<N>(*columns);
+        return c[l] < c[r] || (!(c[r] < c[l]) && l < r);
+      }
+
+      template<typename K>
+      bool operator()(RowId l, Probe<K> const &r) const {
+        return std::get<N>(*columns)[l] < r.key;
+      }
+
+      template<typename K>
+      bool operator()(Probe<K> const &l, RowId r) const {
+        return l.key < std::get<N>(*columns)[r];
+      }
+
+      Detail::Columns<Entry> const *columns;
+    };
+
+    // Stands in for the index of a part with Indexing::None
+    struct NoIndex { };
+
+    template<std::size_t N>
+    static auto makeIndex(Detail::Columns<Entry> const *columns) {
+      if constexpr(isIndexed<N>) {
+        return std::set<RowId, ByValue<N>>{ ByValue<N>{ columns } };
+      }
+      else {
+        return NoIndex{};
+      }
+    }
+
+    template<std::size_t ...Is>
+    static auto makeIndexes(Detail::Columns<Entry> const *columns, std::index_sequence<Is...>) {
+      return std::make_tuple(makeIndex<Is>(columns)...);
+    }
+
+    using Indexes = decltype(makeIndexes(nullptr, std::make_index_sequence<parts>{}));
+
+  public:
+    ColumnTable() = default;
+    ColumnTable(ColumnTable &&) = default;
+    ColumnTable &operator=(ColumnTable &&) = default;
+
+    // The id of the new row, npos if a unique part already holds its value
+    template<typename ...Args>
+    RowId emplace(Args &&...args) {
+      Entry entry(std::forward<Args>(args)...);
+      if (!allowed<0>(entry)) {
+        return npos;
+      }
+
+      RowId id;
+      if (free.empty()) {
+        id = static_cast<RowId>(columnLength());
+        append(std::move(entry), std::make_index_sequence<parts>{});
+        alive.resize(columnLength());
+      }
+      else {
+        id = free.back();
+        free.pop_back();
+        assign(id, std::move(entry), std::make_index_sequence<parts>{});
+      }
+
+      alive.set(id);
+      ++rows;
+      indexRow<0>(id);
+      return id;
+    }
+
+    bool erase(RowId id) {
+      if (!contains(id)) {
+        return false;
+      }
+
+      unindexRow<0>(id);
+      release(id, std::make_index_sequence<parts>{});
+      alive.set(id, false);
+      free.emplace_back(id);
+      --rows;
+      return true;
+    }
+
+    // Sets part N of row id, false if that would break its uniqueness or
+    // there is no such row
+    template<std::size_t N, typename T>
+    bool update(RowId id, T &&value) {
+      if (!contains(id)) {
+        return false;
+      }
+
+      if constexpr(isUnique<N>) {
+        auto const found = lookup<N>(value);
+        if (found != npos && found != id) {
+          return false;
+        }
+      }
+
+      if constexpr(isIndexed<N>) {
+        std::get<N>(indexes).erase(id);
+      }
+      std::get<N>(*columns)[id] = std::forward<T>(value);
+      if constexpr(isIndexed<N>) {
+        std::get<N>(indexes).emplace(id);
+      }
+      return true;
+    }
+
+    // The id of a row with part N equal to value, npos if there is none
+    template<std::size_t N, typename T>
+    RowId lookup(T const &value) const {
+      if constexpr(isIndexed<N>) {
+        auto &index = std::get<N>(indexes);
+        auto const it = index.find(Probe<T>{ value });
+        return it == index.end() ? npos : *it;
+      }
+      else {
+        auto const &c = column<N>();
+        for (std::size_t id = 0; id < c.size(); ++id) {
+          if (alive.test(id) && c[id] == value) {
+            return static_cast<RowId>(id);
+          }
+        }
+        return npos;
+      }
+    }
+
+    bool contains(RowId id) const {
+      return id < columnLength() && alive.test(id);
+    }
+
+    Row row(RowId id) const {
+      return Row{ *columns, id };
+    }
+
+    std::size_t size() const { return rows; }
+    bool empty() const { return !rows; }
+
+    void clear() {
+      *this = ColumnTable{};
+    }
+
+    // Part N of every row id, including those of erased rows
+    template<std::size_t N>
+    auto const &column() const {
+      return std::get<N>(*columns);
+    }
+
+    std::size_t columnLength() const {
+      return std::get<0>(*columns).size();
+    }
+
+    // Calls functor with part N of every row, reading nothing else
+    template<std::size_t N, typename F>
+    void forEachValue(F &&functor) const {
+      auto const &c = column<N>();
+      alive.forEach([&](std::size_t id) {
+        functor(c[id]);
+      });
+    }
+
+    // The results of Aggs over every row, as from groupBy. Each aggregate
+    // only reads the parts it is about.
+    template<typename ...Aggs>
+    auto aggregate(Aggs...) const {
+      std::tuple<typename Aggs::template Accumulator<Row>...> accs;
+      alive.forEach([&](std::size_t id) {
+        Row const row{ *columns, static_cast<RowId>(id) };
+        std::apply([&](auto &...acc) { (acc.add(row), ...); }, accs);
+      });
+      return std::apply([](auto const &...acc) { return std::make_tuple(acc.result()...); }, accs);
+    }
+
+    // Queries pass a Row to the functor for every row they find
+    struct Query {
+      template<typename F>
+      void forEach(F functor) const {
+        selection.forEach([&](std::size_t id) {
+          functor(Row{ *table.columns, static_cast<RowId>(id) });
+        });
+      }
+
+      template<typename F>
+      auto operator>>=(F functor) const { return forEach(functor); }
+
+      std::size_t count() const { return selection.count(); }
+
+      ColumnTable const &table;
+      Selection selection;
+    };
+
+    // The rows in index N with lo <= value <= hi, in the order of the index
+    template<std::size_t N, typename K>
+    struct Range {
+      template<typename F>
+      void forEach(F functor) const {
+        if (hi < lo) {
+          return;
+        }
+
+        auto &index = std::get<N>(table.indexes);
+        for (auto it = index.lower_bound(Probe<K>{ lo }), end = index.upper_bound(Probe<K>{ hi }); it != end; ++it) {
+          functor(Row{ *table.columns, *it });
+        }
+      }
+
+      template<typename F>
+      auto operator>>=(F functor) const { return forEach(functor); }
+
+      ColumnTable const &table;
+      K lo, hi;
+    };
+
+    Query all() const {
+      return Query{ *this, alive };
+    }
+
+    // The rows selected by a col<N>() predicate, which is evaluated a
+    // column at a time
+    template<typename Pred>
+    Query where(Pred const &pred) const {
+      auto selection = this->select(pred);
+      return Query{ *this, selection &= alive };
+    }
+
+    template<std::size_t N, typename T1, typename T2>
+    auto range(T1 const &lo, T2 const &hi) const {
+      if constexpr(isIndexed<N>) {
+        return Range<N, Key<N>>{ *this, Key<N>(lo), Key<N>(hi) };
+      }
+      else {
+        auto selection = alive;
+        auto const &c = column<N>();
+        alive.forEach([&](std::size_t id) {
+          selection.set(id, !(c[id] < lo) && !(hi < c[id]));
+        });
+        return Query{ *this, std::move(selection) };
+      }
+    }
+
+  private:
+    template<std::size_t N>
+    bool allowed(Entry const &entry) const {
+      if constexpr(N < parts) {
+        if constexpr(isUnique<N>) {
+          if (lookup<N>(std::get<N>(entry)) != npos) {
+            return false;
+          }
+        }
+        return allowed<N + 1>(entry);
+      }
+      else {
+        return true;
+      }
+    }
+
+    template<std::size_t ...Is>
+    void append(Entry &&entry, std::index_sequence<Is...>) {
+      (std::get<Is>(*columns).emplace_back(std::move(std::get<Is>(entry))), ...);
+    }
+
+    template<std::size_t ...Is>
+    void assign(RowId id, Entry &&entry, std::index_sequence<Is...>) {
+      ((std::get<Is>(*columns)[id] = std::move(std::get<Is>(entry))), ...);
+    }
+
+    // Lets go of what the parts of an erased row own
+    template<std::size_t ...Is>
+    void release(RowId id, std::index_sequence<Is...>) {
+      ((std::get<Is>(*columns)[id] = Key<Is>{}), ...);
+    }
+
+    template<std::size_t N>
+    void indexRow(RowId id) {
+      if constexpr(N < parts) {
+        if constexpr(isIndexed<N>) {
+          std::get<N>(indexes).emplace(id);
+        }
+        indexRow<N + 1>(id);
+      }
+    }
+
+    template<std::size_t N>
+    void unindexRow(RowId id) {
+      if constexpr(N < parts) {
+        if constexpr(isIndexed<N>) {
+          std::get<N>(indexes).erase(id);
+        }
+        unindexRow<N + 1>(id);
+      }
+    }
+
+    // On the heap, so the indexes pointing at it survive moving the table
+    std::unique_ptr<Detail::Columns<Entry>> columns = std::make_unique<Detail::Columns<Entry>>();
+    Indexes indexes = makeIndexes(columns.get(), std::make_index_sequence<parts>{});
+    Selection alive;
+    std::vector<RowId> free;
+    std::size_t rows = 0;
+  };
+}
+
+template<typename Entry>
+struct std::tuple_size<CQL::ColumnRow<Entry>> : std::tuple_size<Entry> { };
+
+template<std::size_t N, typename Entry>
+struct std::tuple_element<N, CQL::ColumnRow<Entry>> {
+  using type = std::decay_t<std::tuple_element_t<N, Entry>>;
+};
@@ -0,0 +1,596 @@
+#pragma once
+
+#include "Bits.hpp"
+
+#include <type_traits>
+#include <functional>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <tuple>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CQL_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CQL_SSE2
+#endif
+
+namespace CQL {
+  // One bit per row of a ColumnSnapshot, set for the rows a predicate selected
+  struct Selection {
+    Selection() = default;
+
+    explicit Selection(std::size_t size) : words((size + 63) / 64, 0), bits{ size } { }
+
+    bool test(std::size_t i) const {
+      return (words[i / 64] >> (i % 64)) & 1;
+    }
+
+    void set(std::size_t i, bool value = true) {
+      auto const bit = std::uint64_t{ 1 } << (i % 64);
+      words[i / 64] = value ? words[i / 64] | bit : words[i / 64] & ~bit;
+    }
+
+    // New rows start out unselected
+    void resize(std::size_t size) {
+      words.resize((size + 63) / 64, 0);
+      bits = size;
+    }
+
+    std::size_t size() const { return bits; }
+
+    std::size_t count() const {
+      std::size_t ret = 0;
+      for (auto w : words) {
+        ret += Detail::popcount(w);
+      }
+      return ret;
+    }
+
+    // Calls functor with the index of every selected row, in order
+    template<typename F>
+    void forEach(F &&functor) const {
+      for (std::size_t w = 0; w < words.size(); ++w) {
+        for (auto word = words[w]; word; word &= word - 1) {
+          functor(w * 64 + Detail::countTrailingZeros(word));
+        }
+      }
+    }
+
+    Selection &operator&=(Selection const &other) {
+      for (std::size_t w = 0; w < words.size(); ++w) {
+        words[w] &= other.words[w];
+      }
+      return *this;
+    }
+
+    Selection &operator|=(Selection const &other) {
+      for (std::size_t w = 0; w < words.size(); ++w) {
+        words[w] |= other.words[w];
+      }
+      return *this;
+    }
+
+    Selection &flip() {
+      for (auto &w : words) {
+        w = ~w;
+      }
+      if (bits % 64) {
+        words.back() &= (std::uint64_t{ 1 } << (bits % 64)) - 1;
+      }
+      return *this;
+    }
+
+    std::uint64_t *data() { return words.data(); }
+
+  private:
+    std::vector<std::uint64_t> words;
+    std::size_t bits = 0;
+  };
+
+  // Nodes for predicates over the parts of an entry, built from col<N>():
+  //   col<2>() >= 18 && col<2>() < 30 || col<0>() == col<1>() * 2
+  // They can be evaluated per entry like any predicate, or a column at a
+  // time over a ColumnSnapshot.
+  template<std::size_t N>
+  struct Column {
+    template<typename Entry>
+    decltype(auto) value(Entry const &entry) const { return std::get<N>(entry); }
+  };
+
+  template<std::size_t N>
+  constexpr Column<N> col() { return {}; }
+
+  template<typename T>
+  struct Scalar {
+    template<typename Entry>
+    T const &value(Entry const &) const { return val; }
+
+    T val;
+  };
+
+  template<typename L, typename R, typename Op>
+  struct ColumnArith {
+    template<typename Entry>
+    auto value(Entry const &entry) const { return Op{}(l.value(entry), r.value(entry)); }
+
+    L l;
+    R r;
+  };
+
+  template<typename L, typename R, typename Op>
+  struct ColumnCompare {
+    template<typename Entry>
+    bool operator()(Entry const &entry) const { return Op{}(l.value(entry), r.value(entry)); }
+
+    L l;
+    R r;
+  };
+
+  template<typename L, typename R>
+  struct ColumnAnd {
+    template<typename Entry>
+    bool operator()(Entry const &entry) const { return l(entry) && r(entry); }
+
+    L l;
+    R r;
+  };
+
+  template<typename L, typename R>
+  struct ColumnOr {
+    template<typename Entry>
+    bool operator()(Entry const &entry) const { return l(entry) || r(entry); }
+
+    L l;
+    R r;
+  };
+
+  template<typename P>
+  struct ColumnNot {
+    template<typename Entry>
+    bool operator()(Entry const &entry) const { return !p(entry); }
+
+    P p;
+  };
+
+  namespace Detail {
+    template<typename T> struct isValueNode_ : std::false_type { };
+    template<std::size_t N> struct isValueNode_<Column<N>> : std::true_type { };
+    template<typename T> struct isValueNode_<Scalar<T>> : std::true_type { };
+    template<typename L, typename R, typename Op> struct isValueNode_<ColumnArith<L, R, Op>> : std::true_type { };
+
+    template<typename T>
+    constexpr bool isValueNode = isValueNode_<std::decay_t<T>>();
+
+    template<typename T> struct isPredicateNode_ : std::false_type { };
+    template<typename L, typename R, typename Op> struct isPredicateNode_<ColumnCompare<L, R, Op>> : std::true_type { };
+    template<typename L, typename R> struct isPredicateNode_<ColumnAnd<L, R>> : std::true_type { };
+    template<typename L, typename R> struct isPredicateNode_<ColumnOr<L, R>> : std::true_type { };
+    template<typename P> struct isPredicateNode_<ColumnNot<P>> : std::true_type { };
+
+    template<typename T>
+    constexpr bool isPredicateNode = isPredicateNode_<std::decay_t<T>>();
+
+    template<typename L, typename R>
+    constexpr bool isValueOperation =
+      (isValueNode<L> || isValueNode<R>)
+      && (isValueNode<L> || std::is_arithmetic_v<std::decay_t<L>>)
+      && (isValueNode<R> || std::is_arithmetic_v<std::decay_t<R>>);
+
+    template<typename T>
+    auto toValueNode(T const &val) {
+      if constexpr(isValueNode<T>) {
+        return val;
+      }
+      else {
+        return Scalar<T>{ val };
+      }
+    }
+
+    template<typename Op, typename L, typename R>
+    auto makeCompare(L const &l, R const &r) {
+      auto lv = toValueNode(l);
+      auto rv = toValueNode(r);
+      return ColumnCompare<decltype(lv), decltype(rv), Op>{ lv, rv };
+    }
+
+    template<typename Op, typename L, typename R>
+    auto makeArith(L const &l, R const &r) {
+      auto lv = toValueNode(l);
+      auto rv = toValueNode(r);
+      return ColumnArith<decltype(lv), decltype(rv), Op>{ lv, rv };
+    }
+  }
+
+#define CQL_COLUMN_OPERATOR(op, Make, Op)                                            \
+  template<typename L, typename R, std::enable_if_t<Detail::isValueOperation<L, R>, int> = 0> \
+  auto operator op(L const &l, R const &r) { return Detail::Make<Op>(l, r); }
+
+  CQL_COLUMN_OPERATOR(<,  makeCompare, std::less<>)
+  CQL_COLUMN_OPERATOR(<=, makeCompare, std::less_equal<>)
+  CQL_COLUMN_OPERATOR(>,  makeCompare, std::greater<>)
+  CQL_COLUMN_OPERATOR(>=, makeCompare, std::greater_equal<>)
+  CQL_COLUMN_OPERATOR(==, makeCompare, std::equal_to<>)
+  CQL_COLUMN_OPERATOR(!=, makeCompare, std::not_equal_to<>)
+  CQL_COLUMN_OPERATOR(+,  makeArith,   std::plus<>)
+  CQL_COLUMN_OPERATOR(-,  makeArith,   std::minus<>)
+  CQL_COLUMN_OPERATOR(*,  makeArith,   std::multiplies<>)
+
+#undef CQL_COLUMN_OPERATOR
+
+  template<typename L, typename R, std::enable_if_t<Detail::isPredicateNode<L> && Detail::isPredicateNode<R>, int> = 0>
+  auto operator&&(L const &l, R const &r) { return ColumnAnd<L, R>{ l, r }; }
+
+  template<typename L, typename R, std::enable_if_t<Detail::isPredicateNode<L> && Detail::isPredicateNode<R>, int> = 0>
+  auto operator||(L const &l, R const &r) { return ColumnOr<L, R>{ l, r }; }
+
+  template<typename P, std::enable_if_t<Detail::isPredicateNode<P>, int> = 0>
+  auto operator!(P const &p) { return ColumnNot<P>{ p }; }
+
+  namespace Detail {
+    // Comparison kernels writing one bit per element to out. Each kernel
+    // handles whole 64 element words and returns how many elements it did,
+    // compareScalarTail finishes the rest.
+    template<typename Op, bool ScalarB, typename A, typename B>
+    void compareScalarTail(A const *a, B const *b, std::size_t begin, std::size_t n, std::uint64_t *out) {
+      for (std::size_t w = begin / 64; w * 64 < n; ++w) {
+        std::uint64_t bits = 0;
+        for (std::size_t i = w * 64, j = 0; j < 64 && i < n; ++i, ++j) {
+          bits |= static_cast<std::uint64_t>(Op{}(a[i], ScalarB ? *b : b[i])) << j;
+        }
+        out[w] = bits;
+      }
+    }
+
+    template<typename Op, bool ScalarB, typename A, typename B>
+    std::size_t compareSimd(A const *, B const *, std::size_t, std::uint64_t *) {
+      return 0;
+    }
+
+#if defined(CQL_AVX2)
+    template<typename Op>
+    __m256i compareLanes(__m256i a, __m256i b) {
+      auto const ones = _mm256_set1_epi32(-1);
+      if constexpr(std::is_same_v<Op, std::less<>>)          return _mm256_cmpgt_epi32(b, a);
+      else if constexpr(std::is_same_v<Op, std::greater<>>)  return _mm256_cmpgt_epi32(a, b);
+      else if constexpr(std::is_same_v<Op, std::equal_to<>>) return _mm256_cmpeq_epi32(a, b);
+      else if constexpr(std::is_same_v<Op, std::not_equal_to<>>)  return _mm256_xor_si256(_mm256_cmpeq_epi32(a, b), ones);
+      else if constexpr(std::is_same_v<Op, std::less_equal<>>)    return _mm256_xor_si256(_mm256_cmpgt_epi32(a, b), ones);
+      else                                                        return _mm256_xor_si256(_mm256_cmpgt_epi32(b, a), ones);
+    }
+
+    template<typename Op>
+    __m256d compareLanes(__m256d a, __m256d b) {
+      if constexpr(std::is_same_v<Op, std::less<>>)               return _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+      else if constexpr(std::is_same_v<Op, std::greater<>>)       return _mm256_cmp_pd(a, b, _CMP_GT_OQ);
+      else if constexpr(std::is_same_v<Op, std::equal_to<>>)      return _mm256_cmp_pd(a, b, _CMP_EQ_OQ);
+      else if constexpr(std::is_same_v<Op, std::not_equal_to<>>)  return _mm256_cmp_pd(a, b, _CMP_NEQ_UQ);
+      else if constexpr(std::is_same_v<Op, std::less_equal<>>)    return _mm256_cmp_pd(a, b, _CMP_LE_OQ);
+      else                                                        return _mm256_cmp_pd(a, b, _CMP_GE_OQ);
+    }
+
+    template<typename Op, bool ScalarB>
+    std::size_t compareSimd(std::int32_t const *a, std::int32_t const *b, std::size_t n, std::uint64_t *out) {
+      if (n < 64) {
+        return 0;
+      }
+
+      auto const broadcast = _mm256_set1_epi32(*b);
+      for (std::size_t w = 0; w < n / 64; ++w) {
+        std::uint64_t bits = 0;
+        for (std::size_t k = 0; k < 8; ++k) {
+          auto const i = w * 64 + k * 8;
+          auto const va = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+          auto const vb = ScalarB ? broadcast : _mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i));
+          auto const mask = _mm256_movemask_ps(_mm256_castsi256_ps(compareLanes<Op>(va, vb)));
+          bits |= static_cast<std::uint64_t>(static_cast<unsigned>(mask)) << (k * 8);
+        }
+        out[w] = bits;
+      }
+      return n / 64 * 64;
+    }
+
+    template<typename Op, bool ScalarB>
+    std::size_t compareSimd(double const *a, double const *b, std::size_t n, std::uint64_t *out) {
+      if (n < 64) {
+        return 0;
+      }
+
+      auto const broadcast = _mm256_set1_pd(*b);
+      for (std::size_t w = 0; w < n / 64; ++w) {
+        std::uint64_t bits = 0;
+        for (std::size_t k = 0; k < 16; ++k) {
+          auto const i = w * 64 + k * 4;
+          auto const va = _mm256_loadu_pd(a + i);
+          auto const vb = ScalarB ? broadcast : _mm256_loadu_pd(b + i);
+          auto const mask = _mm256_movemask_pd(compareLanes<Op>(va, vb));
+          bits |= static_cast<std::uint64_t>(static_cast<unsigned>(mask)) << (k * 4);
+        }
+        out[w] = bits;
+      }
+      return n / 64 * 64;
+    }
+#elif defined(CQL_SSE2)
+    template<typename Op>
+    __m128i compareLanes(__m128i a, __m128i b) {
+      auto const ones = _mm_set1_epi32(-1);
+      if constexpr(std::is_same_v<Op, std::less<>>)          return _mm_cmplt_epi32(a, b);
+      else if constexpr(std::is_same_v<Op, std::greater<>>)  return _mm_cmpgt_epi32(a, b);
+      else if constexpr(std::is_same_v<Op, std::equal_to<>>) return _mm_cmpeq_epi32(a, b);
+      else if constexpr(std::is_same_v<Op, std::not_equal_to<>>)  return _mm_xor_si128(_mm_cmpeq_epi32(a, b), ones);
+      else if constexpr(std::is_same_v<Op, std::less_equal<>>)    return _mm_xor_si128(_mm_cmpgt_epi32(a, b), ones);
+      else                                                        return _mm_xor_si128(_mm_cmplt_epi32(a, b), ones);
+    }
+
+    template<typename Op>
+    __m128d compareLanes(__m128d a, __m128d b) {
+      if constexpr(std::is_same_v<Op, std::less<>>)               return _mm_cmplt_pd(a, b);
+      else if constexpr(std::is_same_v<Op, std::greater<>>)       return _mm_cmpgt_pd(a, b);
+      else if constexpr(std::is_same_v<Op, std::equal_to<>>)      return _mm_cmpeq_pd(a, b);
+      else if constexpr(std::is_same_v<Op, std::not_equal_to<>>)  return _mm_cmpneq_pd(a, b);
+      else if constexpr(std::is_same_v<Op, std::less_equal<>>)    return _mm_cmple_pd(a, b);
+      else                                                        return _mm_cmpge_pd(a, b);
+    }
+
+    template<typename Op, bool ScalarB>
+    std::size_t compareSimd(std::int32_t const *a, std::int32_t const *b, std::size_t n, std::uint64_t *out) {
+      if (n < 64) {
+        return 0;
+      }
+
+      auto const broadcast = _mm_set1_epi32(*b);
+      for (std::size_t w = 0; w < n / 64; ++w) {
+        std::uint64_t bits = 0;
+        for (std::size_t k = 0; k < 16; ++k) {
+          auto const i = w * 64 + k * 4;
+          auto const va = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + i));
+          auto const vb = ScalarB ? broadcast : _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + i));
+          auto const mask = _mm_movemask_ps(_mm_castsi128_ps(compareLanes<Op>(va, vb)));
+          bits |= static_cast<std::uint64_t>(static_cast<unsigned>(mask)) << (k * 4);
+        }
+        out[w] = bits;
+      }
+      return n / 64 * 64;
+    }
+
+    template<typename Op, bool ScalarB>
+    std::size_t compareSimd(double const *a, double const *b, std::size_t n, std::uint64_t *out) {
+      if (n < 64) {
+        return 0;
+      }
+
+      auto const broadcast = _mm_set1_pd(*b);
+      for (std::size_t w = 0; w < n / 64; ++w) {
+        std::uint64_t bits = 0;
+        for (std::size_t k = 0; k < 32; ++k) {
+          auto const i = w * 64 + k * 2;
+          auto const va = _mm_loadu_pd(a + i);
+          auto const vb = ScalarB ? broadcast : _mm_loadu_pd(b + i);
+          auto const mask = _mm_movemask_pd(compareLanes<Op>(va, vb));
+          bits |= static_cast<std::uint64_t>(static_cast<unsigned>(mask)) << (k * 2);
+        }
+        out[w] = bits;
+      }
+      return n / 64 * 64;
+    }
+#endif
+
+    // b points to a single value if ScalarB, otherwise to n values
+    template<typename Op, bool ScalarB, typename A, typename B>
+    void compare(A const *a, B const *b, std::size_t n, std::uint64_t *out) {
+      std::size_t done = 0;
+      if constexpr(std::is_same_v<A, B>) {
+        done = compareSimd<Op, ScalarB>(a, b, n, out);
+      }
+      compareScalarTail<Op, ScalarB>(a, b, done, n, out);
+    }
+
+    // Values of a value node for every row of a snapshot, either pointing
+    // straight into a column or computed into owned storage
+    template<typename T>
+    struct Values {
+      T const *data = nullptr;
+      std::vector<T> owned;
+    };
+
+    template<typename T>
+    struct flipCompare_ { using type = T; };
+    template<> struct flipCompare_<std::less<>> { using type = std::greater<>; };
+    template<> struct flipCompare_<std::greater<>> { using type = std::less<>; };
+    template<> struct flipCompare_<std::less_equal<>> { using type = std::greater_equal<>; };
+    template<> struct flipCompare_<std::greater_equal<>> { using type = std::less_equal<>; };
+
+    template<typename T>
+    using flipCompare = typename flipCompare_<T>::type;
+
+    template<typename T> struct isScalar_ : std::false_type { };
+    template<typename T> struct isScalar_<Scalar<T>> : std::true_type { };
+
+    template<typename T>
+    constexpr bool isScalar = isScalar_<T>();
+  }
+
+  namespace Detail {
+    // Evaluates col<N>() predicates a column at a time over Derived, which
+    // gives the values of part N of its rows with column<N>(), and their
+    // number with columnLength()
+    template<typename Derived, typename Entry>
+    struct ColumnSelect {
+      template<typename L, typename R, typename Op>
+      Selection select(ColumnCompare<L, R, Op> const &pred) const {
+        return selectCompare(pred);
+      }
+
+      template<typename L, typename R>
+      Selection select(ColumnAnd<L, R> const &pred) const {
+        auto ret = select(pred.l);
+        return ret &= select(pred.r);
+      }
+
+      template<typename L, typename R>
+      Selection select(ColumnOr<L, R> const &pred) const {
+        auto ret = select(pred.l);
+        return ret |= select(pred.r);
+      }
+
+      template<typename P>
+      Selection select(ColumnNot<P> const &pred) const {
+        return select(pred.p).flip();
+      }
+
+    private:
+      Derived const &self() const {
+        return static_cast<Derived const &>(*this);
+      }
+
+      std::size_t length() const {
+        return self().columnLength();
+      }
+
+      template<typename Node>
+      using ValueType = std::decay_t<decltype(std::declval<Node>().value(std::declval<Entry const &>()))>;
+
+      template<typename T, std::size_t N>
+      Values<T> values(Column<N> const &) const {
+        Values<T> ret;
+        auto const &c = self().template column<N>();
+        if constexpr(std::is_same_v<T, std::decay_t<decltype(c[0])>>) {
+          ret.data = c.data();
+        }
+        else {
+          ret.owned.assign(c.begin(), c.end());
+          ret.data = ret.owned.data();
+        }
+        return ret;
+      }
+
+      template<typename T, typename L, typename R, typename Op>
+      Values<T> values(ColumnArith<L, R, Op> const &node) const {
+        Values<T> ret;
+        ret.owned.resize(length());
+
+        if constexpr(isScalar<L>) {
+          auto const r = values<T>(node.r);
+          for (std::size_t i = 0; i < length(); ++i) ret.owned[i] = Op{}(static_cast<T>(node.l.val), r.data[i]);
+        }
+        else if constexpr(isScalar<R>) {
+          auto const l = values<T>(node.l);
+          for (std::size_t i = 0; i < length(); ++i) ret.owned[i] = Op{}(l.data[i], static_cast<T>(node.r.val));
+        }
+        else {
+          auto const l = values<T>(node.l);
+          auto const r = values<T>(node.r);
+          for (std::size_t i = 0; i < length(); ++i) ret.owned[i] = Op{}(l.data[i], r.data[i]);
+        }
+
+        ret.data = ret.owned.data();
+        return ret;
+      }
+
+      template<typename L, typename R, typename Op>
+      Selection selectCompare(ColumnCompare<L, R, Op> const &pred) const {
+        Selection ret(length());
+
+        if constexpr(isScalar<L> && isScalar<R>) {
+          if (Op{}(pred.l.val, pred.r.val)) {
+            ret.flip();
+          }
+        }
+        else if constexpr(isScalar<L>) {
+          return selectCompare(ColumnCompare<R, L, flipCompare<Op>>{ pred.r, pred.l });
+        }
+        else {
+          using LT = ValueType<L>;
+          using RT = ValueType<R>;
+          using T = std::conditional_t<std::is_arithmetic_v<LT> && std::is_arithmetic_v<RT>,
+                                       std::common_type_t<LT, RT>, LT>;
+
+          auto const l = values<T>(pred.l);
+          if constexpr(isScalar<R>) {
+            if constexpr(std::is_arithmetic_v<T>) {
+              auto const r = static_cast<T>(pred.r.val);
+              compare<Op, true>(l.data, &r, length(), ret.data());
+            }
+            else {
+              compare<Op, true>(l.data, &pred.r.val, length(), ret.data());
+            }
+          }
+          else {
+            auto const r = values<std::conditional_t<std::is_arithmetic_v<T>, T, RT>>(pred.r);
+            compare<Op, false>(l.data, r.data, length(), ret.data());
+          }
+        }
+
+        return ret;
+      }
+    };
+  }
+
+  // A struct-of-arrays copy of parts Is... of a set of entries, for
+  // evaluating col<N>() predicates a column at a time with SIMD kernels.
+  // The snapshot does not follow later changes to the table, rebuild it
+  // with Table::columns when needed.
+  template<typename Entry, std::size_t ...Is>
+  struct ColumnSnapshot : Detail::ColumnSelect<ColumnSnapshot<Entry, Is...>, Entry> {
+    template<typename Rows>
+    explicit ColumnSnapshot(Rows const &source) {
+      for (auto const &entry : source) {
+        rows.emplace_back(&entry);
+        (std::get<position<Is>()>(cols).emplace_back(std::get<Is>(entry)), ...);
+      }
+    }
+
+    std::size_t size() const { return rows.size(); }
+    std::size_t columnLength() const { return size(); }
+
+    Entry const &row(std::size_t i) const { return *rows[i]; }
+
+    template<std::size_t N>
+    auto const &column() const {
+      static_assert(position<N>() < sizeof...(Is), "The snapshot does not contain this column");
+      return std::get<position<N>()>(cols);
+    }
+
+    // The rows selected by pred, to be passed on to a functor with >>=
+    template<typename Pred>
+    auto where(Pred const &pred) const {
+      return Query{ *this, this->select(pred) };
+    }
+
+    struct Query {
+      template<typename F>
+      void forEach(F functor) const {
+        selection.forEach([&](std::size_t i) {
+          functor(snapshot.row(i));
+        });
+      }
+
+      template<typename F>
+      auto operator>>=(F functor) const { return forEach(functor); }
+
+      std::size_t count() const { return selection.count(); }
+
+      ColumnSnapshot const &snapshot;
+      Selection selection;
+    };
+
+  private:
+    template<std::size_t N>
+    static constexpr std::size_t position() {
+      constexpr std::size_t inds[] = { Is... };
+      for (std::size_t i = 0; i < sizeof...(Is); ++i) {
+        if (inds[i] == N) {
+          return i;
+        }
+      }
+      return sizeof...(Is);
+    }
+
+    std::vector<Entry const *> rows;
+    std::tuple<std::vector<std::decay_t<std::tuple_element_t<Is, Entry>>>...> cols;
+  };
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <utility>
 #include <tuple>
 
 namespace CQL::Custom {
@@ -10,6 +11,15 @@ namespace CQL::Custom {
     AssumeUnique,
   };
 
+  enum class Indexing {
+    Ordered,
+    OrderStatistic,
+    Radix,
+    Bitmap,
+    Lazy, // Ordered, but only built once it is first queried
+    None, // No index, queries on the part scan the table
+  };
+
   template<typename T, std::size_t Idx>
   struct Unique {
     constexpr Uniqueness operator()() const {
@@ -17,6 +27,76 @@ namespace CQL::Custom {
     }
   };
 
+  template<typename T, std::size_t Idx>
+  struct Index {
+    constexpr Indexing operator()() const {
+      return Indexing::Ordered;
+    }
+  };
+
+  // Keeps a bloom filter next to the index, so lookups of values that
+  // aren't in the table rarely have to search the index at all
+  template<typename T, std::size_t Idx>
+  struct Bloom {
+    constexpr bool operator()() const {
+      return false;
+    }
+  };
+
+  // Two numeric parts to keep a spatial index over, for box<>() and
+  // nearest<>() queries. None by default.
+  template<typename T>
+  struct SpatialLookup {
+    constexpr std::pair<std::size_t, std::size_t> operator()() const {
+      return { std::tuple_size_v<T>, std::tuple_size_v<T> };
+    }
+  };
+
+  // A part holding the time each entry expires at, for Table::expire().
+  // None by default.
+  template<typename T>
+  struct Expiry {
+    constexpr std::size_t operator()() const {
+      return std::tuple_size_v<T>;
+    }
+  };
+
+  // Base of the default IndexFilter, which lets every entry into the index
+  struct Unfiltered { };
+
+  // Only keeps the entries passing the filter in index Idx. Specializations
+  // provide a bool operator()(T const &) const, and don't derive from
+  // Unfiltered. The filter may look at any part of the entry.
+  template<typename T, std::size_t Idx>
+  struct IndexFilter : Unfiltered {
+    constexpr bool operator()(T const &) const {
+      return true;
+    }
+  };
+
+  // Keeps operation counters and latency histograms for the table, read
+  // with Table::metrics(). Off unless CQL_METRICS is defined.
+  template<typename T>
+  struct Metrics {
+    constexpr bool operator()() const {
+#ifdef CQL_METRICS
+      return true;
+#else
+      return false;
+#endif
+    }
+  };
+
+  // The bytes a part of type T owns on the heap, counted for every entry
+  // by Table::memoryUsage(). Strings and vectors are counted, specialize
+  // it for other part types owning memory.
+  template<typename T>
+  struct HeapBytes {
+    constexpr std::size_t operator()(T const &) const {
+      return 0;
+    }
+  };
+
   template<typename T>
   struct DefaultLookup {
     constexpr std::size_t operator()() const { return std::tuple_size_v<T>; }
@@ -0,0 +1,230 @@
+#pragma once
+
+#include "FlatHashMap.hpp"
+#include "Serialize.hpp"
+
+#include <type_traits>
+#include <string_view>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+#include <deque>
+#include <tuple>
+#include <map>
+
+namespace CQL {
+  // The strings of all DictString<Tag>s, each stored once. Every string gets
+  // a fixed code, and an order key that sorts like the string itself, so
+  // that comparing two DictStrings is comparing two integers. Order keys are
+  // spread out with gaps between them so new strings can usually be placed
+  // in between without touching the others.
+  // There is one dictionary per Tag for the whole process, shared by every
+  // table using that Tag, and it only grows: strings stay in it after the
+  // last entry holding them is gone. It is not thread safe, so tables
+  // sharing a Tag must not be used from different threads at the same time.
+  template<typename Tag>
+  struct Dictionary {
+    static Dictionary &instance() {
+      static Dictionary dictionary;
+      return dictionary;
+    }
+
+    std::uint32_t intern(std::string_view str) {
+      auto it = codes.lower_bound(str);
+      if (it != codes.end() && it->first == str) {
+        return it->second;
+      }
+
+      auto const code = static_cast<std::uint32_t>(strings.size());
+      strings.emplace_back(str);
+      orders.emplace_back();
+      it = codes.emplace_hint(it, strings.back(), code);
+
+      auto const lo = it == codes.begin() ? std::uint64_t{ 0 } : orders[std::prev(it)->second];
+      auto const hi = std::next(it) == codes.end() ? std::numeric_limits<std::uint64_t>::max()
+                                                   : orders[std::next(it)->second];
+      if (hi - lo < 2) {
+        relabel();
+      }
+      else {
+        orders[code] = lo + (hi - lo) / 2;
+      }
+
+      return code;
+    }
+
+    std::string const &str(std::uint32_t code) const {
+      return strings[code];
+    }
+
+    std::uint64_t order(std::uint32_t code) const {
+      return orders[code];
+    }
+
+    std::size_t size() const {
+      return strings.size();
+    }
+
+  private:
+    Dictionary() = default;
+
+    // Spreads all order keys out evenly again, keeping them in order
+    void relabel() {
+      auto const step = std::numeric_limits<std::uint64_t>::max() / (codes.size() + 1);
+      std::uint64_t next = 0;
+      for (auto &[str, code] : codes) {
+        orders[code] = next += step;
+      }
+    }
+
+    std::deque<std::string> strings;
+    std::vector<std::uint64_t> orders;
+    std::map<std::string_view, std::uint32_t> codes;
+  };
+
+  namespace Detail {
+    // While a table is being (de)serialized, each distinct string of a
+    // DictString<Tag> part is written once, the first time it is used, and
+    // referred to by its position in that order afterwards
+    template<typename Tag>
+    struct DictionaryCodec {
+      DictionaryCodec() : previous{ active } {
+        active = this;
+      }
+
+      DictionaryCodec(DictionaryCodec const &) = delete;
+      DictionaryCodec &operator=(DictionaryCodec const &) = delete;
+
+      ~DictionaryCodec() {
+        active = previous;
+      }
+
+      FlatHashMap<std::uint32_t, std::uint32_t> written; // Code to position
+      std::vector<std::uint32_t> read;                   // Position to code
+      DictionaryCodec *const previous;
+
+      inline static thread_local DictionaryCodec *active = nullptr;
+    };
+  }
+
+  // A string stored as a code into Dictionary<Tag>. Meant for parts that
+  // repeat a limited set of strings across many entries, like countries or
+  // statuses. Entries then only hold a small integer, and indexes compare
+  // order keys instead of strings while keeping the string order, so
+  // lookups and range<N> work as they would on std::string.
+  template<typename Tag>
+  struct DictString {
+  private:
+    // Plain strings are compared by their contents, so looking them up
+    // doesn't add them to the dictionary
+    template<typename T>
+    static constexpr bool isProbe = std::is_convertible_v<T const &, std::string_view>
+                                 && !std::is_same_v<T, DictString>;
+
+  public:
+    DictString() : DictString(std::string_view{}) { }
+    DictString(std::string_view str) : c{ Dictionary<Tag>::instance().intern(str) } { }
+    DictString(std::string const &str) : DictString(std::string_view{ str }) { }
+    DictString(char const *str) : DictString(std::string_view{ str }) { }
+
+    std::string const &str() const {
+      return Dictionary<Tag>::instance().str(c);
+    }
+
+    operator std::string_view() const {
+      return str();
+    }
+
+    std::uint32_t code() const {
+      return c;
+    }
+
+    void serialize(std::ostream &os) const {
+      if (auto codec = Detail::DictionaryCodec<Tag>::active) {
+        auto const next = static_cast<std::uint32_t>(codec->written.size());
+        if (auto pos = codec->written.find(c)) {
+          CQL::serialize(os, *pos);
+        }
+        else {
+          codec->written[c] = next;
+          CQL::serialize(os, next);
+          CQL::serialize(os, str());
+        }
+      }
+      else {
+        CQL::serialize(os, str());
+      }
+    }
+
+    static DictString deserialize(std::istream &is) {
+      if (auto codec = Detail::DictionaryCodec<Tag>::active) {
+        auto const pos = CQL::deserialize<std::uint32_t>(is);
+        if (pos == codec->read.size()) {
+          codec->read.emplace_back(DictString{ CQL::deserialize<std::string>(is) }.c);
+        }
+        return DictString{ codec->read.at(pos), 0 };
+      }
+      return DictString{ CQL::deserialize<std::string>(is) };
+    }
+
+#define CQL_DICT_OPERATOR(op)                                                          \
+    friend bool operator op(DictString const &lhs, DictString const &rhs) {           \
+      return lhs.order() op rhs.order();                                               \
+    }                                                                                  \
+                                                                                       \
+    template<typename T, typename = std::enable_if_t<isProbe<T>>>                      \
+    friend bool operator op(DictString const &lhs, T const &rhs) {                     \
+      return std::string_view{ lhs } op std::string_view{ rhs };                       \
+    }                                                                                  \
+                                                                                       \
+    template<typename T, typename = std::enable_if_t<isProbe<T>>>                      \
+    friend bool operator op(T const &lhs, DictString const &rhs) {                     \
+      return std::string_view{ lhs } op std::string_view{ rhs };                       \
+    }
+
+    CQL_DICT_OPERATOR(<)
+    CQL_DICT_OPERATOR(<=)
+    CQL_DICT_OPERATOR(>)
+    CQL_DICT_OPERATOR(>=)
+    CQL_DICT_OPERATOR(==)
+    CQL_DICT_OPERATOR(!=)
+
+#undef CQL_DICT_OPERATOR
+
+  private:
+    DictString(std::uint32_t code, int) : c{ code } { }
+
+    std::uint64_t order() const {
+      return Dictionary<Tag>::instance().order(c);
+    }
+
+    std::uint32_t c;
+  };
+
+  namespace Detail {
+    template<typename T>
+    struct DictionaryScope_ { };
+
+    template<typename Tag>
+    struct DictionaryScope_<DictString<Tag>> : DictionaryCodec<Tag> { };
+
+    template<typename Entry, typename = std::make_index_sequence<std::tuple_size_v<Entry>>>
+    struct DictionaryScopes;
+
+    // Encodes the dictionary parts of Entry for as long as it lives
+    template<typename Entry, std::size_t ...Is>
+    struct DictionaryScopes<Entry, std::index_sequence<Is...>> {
+      std::tuple<DictionaryScope_<std::decay_t<std::tuple_element_t<Is, Entry>>>...> scopes;
+    };
+  }
+}
+
+template<typename Tag>
+struct std::hash<CQL::DictString<Tag>> {
+  std::size_t operator()(CQL::DictString<Tag> const &str) const {
+    return std::hash<std::uint32_t>{}(str.code());
+  }
+};
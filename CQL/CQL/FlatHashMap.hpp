@@ -0,0 +1,189 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace CQL::Detail {
+  // Open addressing hash map with linear probing. A separate byte per slot
+  // holds a few hash bits, so probing mostly touches one small array.
+  template<typename K, typename V, typename Hash = std::hash<K>>
+  struct FlatHashMap {
+    FlatHashMap() = default;
+
+    explicit FlatHashMap(std::size_t expected) {
+      reserve(expected);
+    }
+
+    void reserve(std::size_t expected) {
+      std::size_t cap = 16;
+      while (cap * 3 < expected * 4) {
+        cap *= 2;
+      }
+      if (cap > tags.size()) {
+        rehash(cap);
+      }
+    }
+
+    template<typename Key>
+    V &operator[](Key const &key) {
+      if ((count + 1) * 4 > tags.size() * 3) {
+        rehash(tags.empty() ? 16 : tags.size() * 2);
+      }
+
+      auto const h = hash(key);
+      auto const tag = tagOf(h);
+      for (auto i = indexOf(h);; i = (i + 1) & mask()) {
+        if (!tags[i]) {
+          tags[i] = tag;
+          slots[i].emplace(K(key), V{});
+          ++count;
+          return slots[i]->second;
+        }
+        if (tags[i] == tag && slots[i]->first == key) {
+          return slots[i]->second;
+        }
+      }
+    }
+
+    template<typename Key>
+    V *find(Key const &key) {
+      auto const i = slotOf(key);
+      return i == npos ? nullptr : &slots[i]->second;
+    }
+
+    template<typename Key>
+    V const *find(Key const &key) const {
+      auto const i = slotOf(key);
+      return i == npos ? nullptr : &slots[i]->second;
+    }
+
+    // Removes key by shifting the entries probed past it back into place,
+    // so lookups never have to skip over tombstones
+    template<typename Key>
+    bool erase(Key const &key) {
+      auto i = slotOf(key);
+      if (i == npos) {
+        return false;
+      }
+
+      for (auto j = (i + 1) & mask(); tags[j]; j = (j + 1) & mask()) {
+        auto const home = indexOf(hash(slots[j]->first));
+        // Entries whose home lies cyclically in (i, j] are still reachable
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) {
+          continue;
+        }
+        tags[i] = tags[j];
+        slots[i] = std::move(slots[j]);
+        i = j;
+      }
+
+      tags[i] = 0;
+      slots[i].reset();
+      --count;
+      return true;
+    }
+
+    void clear() {
+      tags.assign(tags.size(), 0);
+      for (auto &slot : slots) {
+        slot.reset();
+      }
+      count = 0;
+    }
+
+    template<typename F>
+    void forEach(F &&functor) {
+      for (auto &slot : slots) {
+        if (slot) {
+          functor(slot->first, slot->second);
+        }
+      }
+    }
+
+    template<typename F>
+    void forEach(F &&functor) const {
+      for (auto &slot : slots) {
+        if (slot) {
+          functor(slot->first, slot->second);
+        }
+      }
+    }
+
+    std::size_t size() const { return count; }
+    bool empty() const { return !count; }
+
+    std::size_t memoryUsage() const {
+      return tags.capacity() * sizeof(std::uint8_t) + slots.capacity() * sizeof(slots[0]);
+    }
+
+  private:
+    static constexpr std::size_t npos = ~std::size_t{ 0 };
+
+    template<typename Key>
+    std::size_t slotOf(Key const &key) const {
+      if (tags.empty()) {
+        return npos;
+      }
+
+      auto const h = hash(key);
+      auto const tag = tagOf(h);
+      for (auto i = indexOf(h); tags[i]; i = (i + 1) & mask()) {
+        if (tags[i] == tag && slots[i]->first == key) {
+          return i;
+        }
+      }
+      return npos;
+    }
+
+    // Fibonacci hashing, std::hash is the identity for integers so we
+    // take the slot from the well mixed high bits and the tag right below
+    template<typename Key>
+    static std::uint64_t hash(Key const &key) {
+      return static_cast<std::uint64_t>(Hash{}(key)) * 0x9E3779B97F4A7C15ull;
+    }
+
+    std::size_t indexOf(std::uint64_t h) const {
+      return static_cast<std::size_t>(h >> shift);
+    }
+
+    std::uint8_t tagOf(std::uint64_t h) const {
+      return static_cast<std::uint8_t>(0x80 | ((h >> (shift - 7)) & 0x7f));
+    }
+
+    std::size_t mask() const {
+      return tags.size() - 1;
+    }
+
+    void rehash(std::size_t cap) {
+      auto oldSlots = std::exchange(slots, std::vector<std::optional<std::pair<K, V>>>(cap));
+      tags.assign(cap, 0);
+      count = 0;
+      shift = 64;
+      for (auto c = cap; c > 1; c /= 2) {
+        --shift;
+      }
+
+      for (auto &slot : oldSlots) {
+        if (slot) {
+          auto const h = hash(slot->first);
+          auto i = indexOf(h);
+          while (tags[i]) {
+            i = (i + 1) & mask();
+          }
+          tags[i] = tagOf(h);
+          slots[i] = std::move(slot);
+          ++count;
+        }
+      }
+    }
+
+    std::vector<std::uint8_t> tags;
+    std::vector<std::optional<std::pair<K, V>>> slots;
+    std::size_t count = 0;
+    unsigned shift = 64;
+  };
+}
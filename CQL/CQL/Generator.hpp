@@ -0,0 +1,99 @@
+#pragma once
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <cstddef>
+#include <utility>
+#define CQL_COROUTINES
+#endif
+
+#ifdef CQL_COROUTINES
+namespace CQL {
+  // A coroutine handing out what it co_yields one value at a time, for a
+  // range-for. Nothing runs until the first value is asked for, and the
+  // coroutine stays suspended between values.
+  template<typename T>
+  struct Generator {
+    struct promise_type {
+      Generator get_return_object() {
+        return Generator{ std::coroutine_handle<promise_type>::from_promise(*this) };
+      }
+
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      std::suspend_always final_suspend() noexcept { return {}; }
+
+      std::suspend_always yield_value(T const &v) {
+        value = &v;
+        return {};
+      }
+
+      void return_void() { }
+
+      void unhandled_exception() {
+        exception = std::current_exception();
+      }
+
+      T const *value = nullptr;
+      std::exception_ptr exception;
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct iterator {
+      using iterator_category = std::input_iterator_tag;
+      using value_type = T;
+      using difference_type = std::ptrdiff_t;
+      using pointer = T const *;
+      using reference = T const &;
+
+      iterator &operator++() {
+        resume(handle);
+        return *this;
+      }
+
+      void operator++(int) { ++*this; }
+
+      T const &operator*() const { return *handle.promise().value; }
+      T const *operator->() const { return handle.promise().value; }
+
+      bool operator==(std::default_sentinel_t) const { return handle.done(); }
+      bool operator!=(std::default_sentinel_t) const { return !handle.done(); }
+
+      Handle handle;
+    };
+
+    Generator(Generator &&other) noexcept : handle{ std::exchange(other.handle, nullptr) } { }
+    Generator &operator=(Generator &&other) noexcept {
+      std::swap(handle, other.handle);
+      return *this;
+    }
+
+    ~Generator() {
+      if (handle) {
+        handle.destroy();
+      }
+    }
+
+    iterator begin() {
+      resume(handle);
+      return iterator{ handle };
+    }
+
+    std::default_sentinel_t end() const { return {}; }
+
+  private:
+    explicit Generator(Handle handle) : handle{ handle } { }
+
+    static void resume(Handle handle) {
+      handle.resume();
+      if (auto e = std::exchange(handle.promise().exception, nullptr)) {
+        std::rethrow_exception(e);
+      }
+    }
+
+    Handle handle;
+  };
+}
+#endif
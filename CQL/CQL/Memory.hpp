@@ -0,0 +1,136 @@
+#pragma once
+
+#include "Custom.hpp"
+
+#include <type_traits>
+#include <functional>
+#include <cstddef>
+#include <utility>
+#include <memory>
+#include <string>
+#include <vector>
+#include <tuple>
+
+namespace CQL {
+  // The bytes a table holds on the heap, see Table::memoryUsage(). What
+  // the allocator adds on top of every allocation isn't counted.
+  struct PartMemory {
+    // 0 for parts without an index, or with a lazy one not built yet
+    std::size_t index = 0;
+    std::size_t bloom = 0;
+  };
+
+  struct MemoryUsage {
+    std::size_t total() const {
+      auto ret = rows + defaultLookup + spatial + rowIds + other;
+      for (auto &part : parts) {
+        ret += part.index + part.bloom;
+      }
+      return ret;
+    }
+
+    // The entries, and the memory owned by their parts
+    std::size_t rows = 0;
+    // The set owning the entries, when that isn't the index of a part
+    std::size_t defaultLookup = 0;
+    std::vector<PartMemory> parts;
+    std::size_t spatial = 0;
+    // The row ids the bitmap indexes refer to
+    std::size_t rowIds = 0;
+    // Listeners and metrics
+    std::size_t other = 0;
+  };
+
+  namespace Custom {
+    template<typename C, typename Traits, typename Alloc>
+    struct HeapBytes<std::basic_string<C, Traits, Alloc>> {
+      std::size_t operator()(std::basic_string<C, Traits, Alloc> const &value) const {
+        // Short strings are kept within the string itself
+        auto const data = reinterpret_cast<char const *>(value.data());
+        auto const self = reinterpret_cast<char const *>(&value);
+        if (std::less_equal<char const *>{}(self, data) && std::less<char const *>{}(data, self + sizeof(value))) {
+          return 0;
+        }
+        return (value.capacity() + 1) * sizeof(C);
+      }
+    };
+
+    template<typename T, typename Alloc>
+    struct HeapBytes<std::vector<T, Alloc>> {
+      std::size_t operator()(std::vector<T, Alloc> const &value) const {
+        auto ret = value.capacity() * sizeof(T);
+        for (auto &elem : value) {
+          ret += HeapBytes<T>{}(elem);
+        }
+        return ret;
+      }
+    };
+  }
+
+  namespace Detail {
+    // std::allocator, but keeping count of the bytes it has handed out.
+    // Copies, including those rebound to node types, share the count, while
+    // a copied container starts one of its own.
+    template<typename T>
+    struct CountingAllocator {
+      using value_type = T;
+      using propagate_on_container_copy_assignment = std::true_type;
+      using propagate_on_container_move_assignment = std::true_type;
+      using propagate_on_container_swap = std::true_type;
+
+      CountingAllocator() : bytes{ std::make_shared<std::size_t>(0) } { }
+      // No move, so moved from containers keep a count to allocate into
+      CountingAllocator(CountingAllocator const &) = default;
+
+      template<typename U>
+      CountingAllocator(CountingAllocator<U> const &other) : bytes{ other.bytes } { }
+
+      T *allocate(std::size_t n) {
+        auto ret = std::allocator<T>{}.allocate(n);
+        *bytes += n * sizeof(T);
+        return ret;
+      }
+
+      void deallocate(T *ptr, std::size_t n) {
+        *bytes -= n * sizeof(T);
+        std::allocator<T>{}.deallocate(ptr, n);
+      }
+
+      CountingAllocator select_on_container_copy_construction() const {
+        return {};
+      }
+
+      std::size_t allocated() const {
+        return *bytes;
+      }
+
+      template<typename U>
+      bool operator==(CountingAllocator<U> const &other) const {
+        return bytes == other.bytes;
+      }
+
+      template<typename U>
+      bool operator!=(CountingAllocator<U> const &other) const {
+        return bytes != other.bytes;
+      }
+
+    private:
+      template<typename U>
+      friend struct CountingAllocator;
+
+      std::shared_ptr<std::size_t> bytes;
+    };
+
+    template<typename Entry, std::size_t ...Is>
+    std::size_t heapBytes(Entry const &entry, std::index_sequence<Is...>) {
+      return (std::size_t{ 0 } + ... +
+        Custom::HeapBytes<std::decay_t<std::tuple_element_t<Is, Entry>>>{}(std::get<Is>(entry)));
+    }
+
+    // The memory the parts of entry own
+    template<typename Entry>
+    std::size_t heapBytes(Entry const &entry) {
+      return heapBytes(entry, std::make_index_sequence<std::tuple_size_v<Entry>>{});
+    }
+  }
+}
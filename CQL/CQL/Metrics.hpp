@@ -0,0 +1,172 @@
+#pragma once
+
+#include "Bits.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <array>
+
+namespace CQL {
+  // Operation latencies in power of two buckets: bucket b counts the
+  // operations that took less than 2^b but at least 2^(b - 1) nanoseconds
+  struct LatencyHistogram {
+    static constexpr std::size_t buckets = 64;
+
+    std::uint64_t count() const {
+      std::uint64_t ret = 0;
+      for (auto c : counts) {
+        ret += c;
+      }
+      return ret;
+    }
+
+    // An upper bound in nanoseconds on the q:th quantile, 0 <= q <= 1
+    std::uint64_t quantile(double q) const {
+      auto const total = count();
+      if (!total) {
+        return 0;
+      }
+
+      auto const target = static_cast<std::uint64_t>(q * static_cast<double>(total));
+      std::uint64_t seen = 0;
+      for (std::size_t b = 0; b < buckets; ++b) {
+        if ((seen += counts[b]) > target || seen == total) {
+          return b == buckets - 1 ? ~std::uint64_t{ 0 } : std::uint64_t{ 1 } << b;
+        }
+      }
+      return 0;
+    }
+
+    std::array<std::uint64_t, buckets> counts{};
+  };
+
+  struct OperationMetrics {
+    std::uint64_t count = 0;
+    LatencyHistogram latency;
+  };
+
+  struct PartMetrics {
+    OperationMetrics lookups, ranges, updates;
+    // Made by the index of the part during lookups and range scans
+    std::uint64_t comparisons = 0;
+    // The most comparisons a single lookup needed, about the index depth
+    std::uint64_t deepestLookup = 0;
+  };
+
+  // A snapshot of the metrics of a table, see Table::metrics()
+  struct TableMetrics {
+    OperationMetrics emplaces, erases;
+    // Emplaces refused by an enforced uniqueness
+    std::uint64_t rejectedInserts = 0;
+    std::uint64_t rows = 0;
+    std::vector<PartMetrics> parts;
+  };
+
+  // Counters are updated with relaxed atomics, so another thread can take
+  // a snapshot at any time without stopping the one writing to the table
+  namespace Detail {
+    // Comparisons made by the indexes on this thread, counted only by the
+    // tables keeping metrics
+    inline std::uint64_t &comparisons() {
+      thread_local std::uint64_t count = 0;
+      return count;
+    }
+
+    inline void add(std::atomic<std::uint64_t> &counter, std::uint64_t n = 1) {
+      counter.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    inline std::uint64_t read(std::atomic<std::uint64_t> const &counter) {
+      return counter.load(std::memory_order_relaxed);
+    }
+
+    struct OperationCounters {
+      void record(std::chrono::steady_clock::duration elapsed) {
+        auto const ns = static_cast<std::uint64_t>(std::max<std::int64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), 0));
+        auto const bucket = ns ? 64 - countLeadingZeros(ns) : 0;
+        add(count);
+        add(latency[std::min(bucket, LatencyHistogram::buckets - 1)]);
+      }
+
+      OperationMetrics snapshot() const {
+        // Read in the opposite order of record(), so a snapshot taken while
+        // operations run never holds more latencies than operations
+        OperationMetrics ret;
+        for (std::size_t b = 0; b < LatencyHistogram::buckets; ++b) {
+          ret.latency.counts[b] = read(latency[b]);
+        }
+        ret.count = read(count);
+        return ret;
+      }
+
+      std::atomic<std::uint64_t> count{ 0 };
+      std::array<std::atomic<std::uint64_t>, LatencyHistogram::buckets> latency{};
+    };
+
+    struct PartCounters {
+      void addComparisons(std::uint64_t n, bool lookup) {
+        add(comparisons, n);
+        for (auto deepest = read(deepestLookup); lookup && n > deepest;) {
+          if (deepestLookup.compare_exchange_weak(deepest, n, std::memory_order_relaxed)) {
+            break;
+          }
+        }
+      }
+
+      OperationCounters lookups, ranges, updates;
+      std::atomic<std::uint64_t> comparisons{ 0 }, deepestLookup{ 0 };
+    };
+
+    struct Counters {
+      explicit Counters(std::size_t parts) : parts(parts) { }
+
+      TableMetrics snapshot() const {
+        TableMetrics ret;
+        ret.emplaces = emplaces.snapshot();
+        ret.erases = erases.snapshot();
+        ret.rejectedInserts = read(rejectedInserts);
+        ret.rows = read(rows);
+        for (auto &part : parts) {
+          ret.parts.push_back({ part.lookups.snapshot(), part.ranges.snapshot(), part.updates.snapshot(),
+                                read(part.comparisons), read(part.deepestLookup) });
+        }
+        return ret;
+      }
+
+      OperationCounters emplaces, erases;
+      std::atomic<std::uint64_t> rejectedInserts{ 0 }, rows{ 0 };
+      std::vector<PartCounters> parts;
+    };
+
+    // Records how long the enclosing scope takes into op, and the
+    // comparisons made meanwhile into part, if any
+    struct Measure {
+      Measure(OperationCounters &op, PartCounters *part = nullptr, bool lookup = false) :
+        op{ op }, part{ part }, lookup{ lookup } { }
+
+      Measure(Measure const &) = delete;
+
+      ~Measure() {
+        op.record(std::chrono::steady_clock::now() - start);
+        if (part) {
+          part->addComparisons(comparisons() - startComparisons, lookup);
+        }
+      }
+
+    private:
+      OperationCounters &op;
+      PartCounters *part;
+      bool lookup;
+      std::uint64_t startComparisons = comparisons();
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    };
+
+    // Stands in for Measure in tables without metrics
+    struct NoMeasure { };
+  }
+}
@@ -0,0 +1,440 @@
+#pragma once
+
+#include <type_traits>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace CQL {
+  // An ordered set where every node knows the size of its subtree.
+  // Behaves like std::set/std::multiset for everything Table needs, and
+  // additionally answers nth(k), rank(key) and iterator arithmetic in O(log n).
+  // Implemented as a treap, so node addresses (and iterators) stay stable.
+  template<typename T, typename Compare, bool Multi>
+  struct OrderStatisticSet {
+  private:
+    struct Node {
+      template<typename ...Args>
+      Node(std::uint32_t priority, Args &&...args) :
+        value(std::forward<Args>(args)...), priority{ priority } { }
+
+      T value;
+      Node *parent = nullptr, *left = nullptr, *right = nullptr;
+      std::size_t count = 1;
+      std::uint32_t const priority;
+    };
+
+  public:
+    using value_type = T;
+    using key_compare = Compare;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+
+    struct iterator {
+      using iterator_category = std::bidirectional_iterator_tag;
+      using value_type = T;
+      using difference_type = std::ptrdiff_t;
+      using pointer = T const *;
+      using reference = T const &;
+      using is_order_statistic = void;
+
+      iterator() = default;
+
+      reference operator*() const { return node->value; }
+      pointer operator->() const { return &node->value; }
+
+      iterator &operator++() {
+        node = successor(node);
+        return *this;
+      }
+
+      iterator operator++(int) {
+        auto ret = *this;
+        ++*this;
+        return ret;
+      }
+
+      iterator &operator--() {
+        node = node ? predecessor(node) : rightmost(set->root);
+        return *this;
+      }
+
+      iterator operator--(int) {
+        auto ret = *this;
+        --*this;
+        return ret;
+      }
+
+      iterator &operator+=(difference_type n) {
+        node = set->select(static_cast<std::size_t>(static_cast<difference_type>(index()) + n));
+        return *this;
+      }
+
+      iterator &operator-=(difference_type n) {
+        return *this += -n;
+      }
+
+      iterator operator+(difference_type n) const {
+        auto ret = *this;
+        return ret += n;
+      }
+
+      iterator operator-(difference_type n) const {
+        auto ret = *this;
+        return ret -= n;
+      }
+
+      difference_type operator-(iterator const &other) const {
+        return static_cast<difference_type>(index()) - static_cast<difference_type>(other.index());
+      }
+
+      bool operator==(iterator const &other) const { return node == other.node; }
+      bool operator!=(iterator const &other) const { return node != other.node; }
+
+      // Position of this iterator within the set, size() for end()
+      std::size_t index() const {
+        return node ? set->rankOf(node) : set->size();
+      }
+
+    private:
+      friend struct OrderStatisticSet;
+
+      iterator(Node *node, OrderStatisticSet const *set) : node{ node }, set{ set } { }
+
+      Node *node = nullptr;
+      OrderStatisticSet const *set = nullptr;
+    };
+
+    using const_iterator = iterator;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = reverse_iterator;
+
+    struct node_type {
+      T &value() { return val; }
+
+    private:
+      friend struct OrderStatisticSet;
+      explicit node_type(T &&val) : val{ std::move(val) } { }
+      T val;
+    };
+
+    OrderStatisticSet() = default;
+    OrderStatisticSet(OrderStatisticSet const &) = delete;
+    OrderStatisticSet &operator=(OrderStatisticSet const &) = delete;
+
+    OrderStatisticSet(OrderStatisticSet &&other) noexcept :
+      root{ std::exchange(other.root, nullptr) }, seed{ other.seed } { }
+
+    OrderStatisticSet &operator=(OrderStatisticSet &&other) noexcept {
+      if (this != &other) {
+        clear();
+        root = std::exchange(other.root, nullptr);
+        seed = other.seed;
+      }
+      return *this;
+    }
+
+    ~OrderStatisticSet() { clear(); }
+
+    iterator begin() const { return { leftmost(root), this }; }
+    iterator end() const { return { nullptr, this }; }
+    reverse_iterator rbegin() const { return reverse_iterator{ end() }; }
+    reverse_iterator rend() const { return reverse_iterator{ begin() }; }
+
+    std::size_t size() const { return subtreeSize(root); }
+    bool empty() const { return !root; }
+
+    // The bytes of the nodes
+    std::size_t memoryUsage() const { return size() * sizeof(Node); }
+
+    void clear() {
+      destroy(root);
+      root = nullptr;
+    }
+
+    template<typename ...Args>
+    auto emplace(Args &&...args) {
+      auto node = new Node(nextPriority(), std::forward<Args>(args)...);
+
+      Node *parent = nullptr;
+      bool left = false;
+      for (auto cur = root; cur;) {
+        parent = cur;
+        if (comp(node->value, cur->value)) {
+          left = true;
+          cur = cur->left;
+        }
+        else if (!Multi && !comp(cur->value, node->value)) {
+          delete node;
+          if constexpr(Multi) {
+            return iterator{ cur, this };
+          }
+          else {
+            return std::make_pair(iterator{ cur, this }, false);
+          }
+        }
+        else {
+          left = false;
+          cur = cur->right;
+        }
+      }
+
+      node->parent = parent;
+      if (!parent) {
+        root = node;
+      }
+      else {
+        (left ? parent->left : parent->right) = node;
+        for (auto p = parent; p; p = p->parent) {
+          ++p->count;
+        }
+      }
+
+      while (node->parent && node->priority > node->parent->priority) {
+        rotateUp(node);
+      }
+
+      if constexpr(Multi) {
+        return iterator{ node, this };
+      }
+      else {
+        return std::make_pair(iterator{ node, this }, true);
+      }
+    }
+
+    iterator erase(iterator it) {
+      auto next = successor(it.node);
+      delete unlink(it.node);
+      return { next, this };
+    }
+
+    node_type extract(iterator it) {
+      auto node = unlink(it.node);
+      node_type ret{ std::move(node->value) };
+      delete node;
+      return ret;
+    }
+
+    template<typename K>
+    iterator lower_bound(K const &key) const {
+      Node *ret = nullptr;
+      for (auto cur = root; cur;) {
+        if (!comp(cur->value, key)) {
+          ret = cur;
+          cur = cur->left;
+        }
+        else {
+          cur = cur->right;
+        }
+      }
+      return { ret, this };
+    }
+
+    template<typename K>
+    iterator upper_bound(K const &key) const {
+      Node *ret = nullptr;
+      for (auto cur = root; cur;) {
+        if (comp(key, cur->value)) {
+          ret = cur;
+          cur = cur->left;
+        }
+        else {
+          cur = cur->right;
+        }
+      }
+      return { ret, this };
+    }
+
+    template<typename K>
+    std::pair<iterator, iterator> equal_range(K const &key) const {
+      return { lower_bound(key), upper_bound(key) };
+    }
+
+    template<typename K>
+    iterator find(K const &key) const {
+      auto it = lower_bound(key);
+      if (it != end() && comp(key, *it)) {
+        return end();
+      }
+      return it;
+    }
+
+    template<typename K>
+    std::size_t count(K const &key) const {
+      return rank(upper_bound(key)) - rank(lower_bound(key));
+    }
+
+    // The k:th smallest element, end() if k >= size()
+    iterator nth(std::size_t k) const {
+      return { select(k), this };
+    }
+
+    // The number of elements strictly less than key
+    template<typename K>
+    std::size_t rank(K const &key) const {
+      std::size_t ret = 0;
+      for (auto cur = root; cur;) {
+        if (comp(cur->value, key)) {
+          ret += subtreeSize(cur->left) + 1;
+          cur = cur->right;
+        }
+        else {
+          cur = cur->left;
+        }
+      }
+      return ret;
+    }
+
+    std::size_t rank(iterator const &it) const {
+      return it.index();
+    }
+
+  private:
+    static std::size_t subtreeSize(Node const *node) {
+      return node ? node->count : 0;
+    }
+
+    static void recount(Node *node) {
+      node->count = 1 + subtreeSize(node->left) + subtreeSize(node->right);
+    }
+
+    static Node *leftmost(Node *node) {
+      while (node && node->left) node = node->left;
+      return node;
+    }
+
+    static Node *rightmost(Node *node) {
+      while (node && node->right) node = node->right;
+      return node;
+    }
+
+    static Node *successor(Node *node) {
+      if (node->right) {
+        return leftmost(node->right);
+      }
+      while (node->parent && node->parent->right == node) {
+        node = node->parent;
+      }
+      return node->parent;
+    }
+
+    static Node *predecessor(Node *node) {
+      if (node->left) {
+        return rightmost(node->left);
+      }
+      while (node->parent && node->parent->left == node) {
+        node = node->parent;
+      }
+      return node->parent;
+    }
+
+    static void destroy(Node *node) {
+      if (node) {
+        destroy(node->left);
+        destroy(node->right);
+        delete node;
+      }
+    }
+
+    std::size_t rankOf(Node const *node) const {
+      auto ret = subtreeSize(node->left);
+      for (; node->parent; node = node->parent) {
+        if (node->parent->right == node) {
+          ret += subtreeSize(node->parent->left) + 1;
+        }
+      }
+      return ret;
+    }
+
+    Node *select(std::size_t k) const {
+      for (auto cur = root; cur;) {
+        auto const l = subtreeSize(cur->left);
+        if (k < l) {
+          cur = cur->left;
+        }
+        else if (k == l) {
+          return cur;
+        }
+        else {
+          k -= l + 1;
+          cur = cur->right;
+        }
+      }
+      return nullptr;
+    }
+
+    void replaceChild(Node *parent, Node *oldChild, Node *newChild) {
+      if (!parent) {
+        root = newChild;
+      }
+      else if (parent->left == oldChild) {
+        parent->left = newChild;
+      }
+      else {
+        parent->right = newChild;
+      }
+      if (newChild) {
+        newChild->parent = parent;
+      }
+    }
+
+    // Rotates node above its parent, keeping subtree counts intact
+    void rotateUp(Node *node) {
+      auto parent = node->parent;
+      replaceChild(parent->parent, parent, node);
+      if (parent->left == node) {
+        parent->left = node->right;
+        if (node->right) node->right->parent = parent;
+        node->right = parent;
+      }
+      else {
+        parent->right = node->left;
+        if (node->left) node->left->parent = parent;
+        node->left = parent;
+      }
+      parent->parent = node;
+      recount(parent);
+      recount(node);
+    }
+
+    // Detaches node from the tree without freeing it
+    Node *unlink(Node *node) {
+      while (node->left && node->right) {
+        rotateUp(node->left->priority > node->right->priority ? node->left : node->right);
+      }
+
+      for (auto p = node->parent; p; p = p->parent) {
+        --p->count;
+      }
+
+      replaceChild(node->parent, node, node->left ? node->left : node->right);
+      return node;
+    }
+
+    std::uint32_t nextPriority() {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      return seed;
+    }
+
+    Node *root = nullptr;
+    std::uint32_t seed = 2463534242u;
+    Compare comp{};
+  };
+
+  namespace Detail {
+    template<typename It, typename = void>
+    struct isOrderStatisticIterator_ : std::false_type { };
+
+    template<typename It>
+    struct isOrderStatisticIterator_<It, std::void_t<typename It::is_order_statistic>> : std::true_type { };
+
+    template<typename It>
+    struct isOrderStatisticIterator_<std::reverse_iterator<It>> : isOrderStatisticIterator_<It> { };
+
+    template<typename It>
+    constexpr bool isOrderStatisticIterator = isOrderStatisticIterator_<It>();
+  }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace CQL {
+  // What one node of a query expression did during a run of the query,
+  // see Table::profile(). Rows flow from the children up to their parent.
+  struct QueryProfile {
+    std::string toString() const {
+      std::ostringstream os;
+      print(os, 0);
+      return os.str();
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, QueryProfile const &profile) {
+      profile.print(os, 0);
+      return os;
+    }
+
+    std::string node;
+    // Rows the node got from its children, and rows it passed on
+    std::uint64_t rowsIn = 0, rowsOut = 0;
+    // Entries the node read out of an index
+    std::uint64_t indexEntries = 0;
+    std::uint64_t predicateCalls = 0;
+    // Spent in the node and its children, not in what the rows went on to
+    std::chrono::nanoseconds time{ 0 };
+    std::vector<QueryProfile> children;
+
+  private:
+    void print(std::ostream &os, std::size_t depth) const {
+      os << std::string(depth * 2, ' ') << node << ": " << rowsOut << " rows out";
+      if (rowsIn) {
+        os << " of " << rowsIn << " in";
+      }
+      if (indexEntries) {
+        os << ", " << indexEntries << " index entries";
+      }
+      if (predicateCalls) {
+        os << ", " << predicateCalls << " predicate calls";
+      }
+      os << ", " << std::fixed << std::setprecision(3)
+         << std::chrono::duration<double, std::micro>(time).count() << " us\n";
+      for (auto &child : children) {
+        child.print(os, depth + 1);
+      }
+    }
+  };
+
+  namespace Detail {
+    // Adds the time from its construction to its destruction to profile,
+    // except for the time spent handing rows on with yield()
+    struct Stopwatch {
+      explicit Stopwatch(QueryProfile &profile) : profile{ profile } { }
+
+      Stopwatch(Stopwatch const &) = delete;
+
+      ~Stopwatch() {
+        profile.time += std::chrono::steady_clock::now() - start;
+      }
+
+      template<typename F, typename ...Ts>
+      void yield(F &functor, Ts const &...row) {
+        profile.time += std::chrono::steady_clock::now() - start;
+        ++profile.rowsOut;
+        functor(row...);
+        start = std::chrono::steady_clock::now();
+      }
+
+    private:
+      QueryProfile &profile;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    };
+
+    // Evaluates predicate on value, counted and timed in profile
+    template<typename Pred, typename T>
+    bool test(QueryProfile &profile, Pred &predicate, T const &value) {
+      Stopwatch watch{ profile };
+      ++profile.predicateCalls;
+      bool const pass = predicate(value);
+      profile.rowsOut += pass;
+      return pass;
+    }
+  }
+}
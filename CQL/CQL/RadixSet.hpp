@@ -0,0 +1,468 @@
+#pragma once
+
+#include "Memory.hpp"
+
+#include <string_view>
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
+#include <utility>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace CQL {
+  // An ordered set of values with string keys, stored as a path compressed
+  // radix tree. Every node holds the part of the key it adds to its parent,
+  // so a prefix shared by many keys is stored and compared only once.
+  // Compare::key(value) gives the key of a value, anything convertible to
+  // std::string_view can be used to probe it without allocating.
+  // The values themselves are kept in one sorted linked list, so iterators
+  // stay valid until the value they point to is erased.
+  template<typename T, typename Compare, bool Multi>
+  struct RadixSet {
+  private:
+    struct Node;
+
+    struct Leaf {
+      template<typename ...Args>
+      Leaf(Args &&...args) : value(std::forward<Args>(args)...) { }
+
+      T value;
+      Leaf *prev = nullptr, *next = nullptr;
+      Node *node = nullptr;
+    };
+
+    struct Node {
+      std::string label;
+      Node *parent = nullptr;
+      std::vector<std::unique_ptr<Node>> children; // Sorted by first byte
+      Leaf *head = nullptr, *tail = nullptr;       // Values with exactly this key
+    };
+
+  public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+
+    struct iterator {
+      using iterator_category = std::bidirectional_iterator_tag;
+      using value_type = T;
+      using difference_type = std::ptrdiff_t;
+      using pointer = T const *;
+      using reference = T const &;
+
+      iterator() = default;
+
+      reference operator*() const { return leaf->value; }
+      pointer operator->() const { return &leaf->value; }
+
+      iterator &operator++() {
+        leaf = leaf->next;
+        return *this;
+      }
+
+      iterator operator++(int) {
+        auto ret = *this;
+        ++*this;
+        return ret;
+      }
+
+      iterator &operator--() {
+        leaf = leaf ? leaf->prev : set->tail;
+        return *this;
+      }
+
+      iterator operator--(int) {
+        auto ret = *this;
+        --*this;
+        return ret;
+      }
+
+      bool operator==(iterator const &other) const { return leaf == other.leaf; }
+      bool operator!=(iterator const &other) const { return leaf != other.leaf; }
+
+    private:
+      friend struct RadixSet;
+
+      iterator(Leaf *leaf, RadixSet const *set) : leaf{ leaf }, set{ set } { }
+
+      Leaf *leaf = nullptr;
+      RadixSet const *set = nullptr;
+    };
+
+    using const_iterator = iterator;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = reverse_iterator;
+
+    struct node_type {
+      T &value() { return val; }
+
+    private:
+      friend struct RadixSet;
+      explicit node_type(T &&val) : val{ std::move(val) } { }
+      T val;
+    };
+
+    RadixSet() = default;
+    RadixSet(RadixSet const &) = delete;
+    RadixSet &operator=(RadixSet const &) = delete;
+
+    RadixSet(RadixSet &&other) noexcept :
+      root{ std::move(other.root) },
+      head{ std::exchange(other.head, nullptr) },
+      tail{ std::exchange(other.tail, nullptr) },
+      entries{ std::exchange(other.entries, 0) } { }
+
+    RadixSet &operator=(RadixSet &&other) noexcept {
+      if (this != &other) {
+        clear();
+        root = std::move(other.root);
+        head = std::exchange(other.head, nullptr);
+        tail = std::exchange(other.tail, nullptr);
+        entries = std::exchange(other.entries, 0);
+      }
+      return *this;
+    }
+
+    ~RadixSet() { clear(); }
+
+    iterator begin() const { return { head, this }; }
+    iterator end() const { return { nullptr, this }; }
+    reverse_iterator rbegin() const { return reverse_iterator{ end() }; }
+    reverse_iterator rend() const { return reverse_iterator{ begin() }; }
+
+    std::size_t size() const { return entries; }
+    bool empty() const { return !entries; }
+
+    // The bytes of the leaves and of the tree above them
+    std::size_t memoryUsage() const {
+      return entries * sizeof(Leaf) + treeBytes(root.get());
+    }
+
+    void clear() {
+      while (head) {
+        delete std::exchange(head, head->next);
+      }
+      tail = nullptr;
+      entries = 0;
+      root.reset();
+    }
+
+    template<typename ...Args>
+    auto emplace(Args &&...args) {
+      auto leaf = std::make_unique<Leaf>(std::forward<Args>(args)...);
+      auto node = insertNode(std::string_view{ Compare::key(leaf->value) });
+
+      if constexpr(!Multi) {
+        if (node->head) {
+          return std::make_pair(iterator{ node->head, this }, false);
+        }
+      }
+
+      auto ret = leaf.release();
+      link(ret, node);
+      if constexpr(Multi) {
+        return iterator{ ret, this };
+      }
+      else {
+        return std::make_pair(iterator{ ret, this }, true);
+      }
+    }
+
+    iterator erase(iterator it) {
+      auto next = it.leaf->next;
+      delete unlink(it.leaf);
+      return { next, this };
+    }
+
+    node_type extract(iterator it) {
+      auto leaf = unlink(it.leaf);
+      node_type ret{ std::move(leaf->value) };
+      delete leaf;
+      return ret;
+    }
+
+    template<typename K>
+    iterator find(K const &key) const {
+      auto node = findNode(keyOf(key));
+      return { node ? node->head : nullptr, this };
+    }
+
+    template<typename K>
+    std::size_t count(K const &key) const {
+      auto[lo, hi] = equal_range(key);
+      return static_cast<std::size_t>(std::distance(lo, hi));
+    }
+
+    template<typename K>
+    iterator lower_bound(K const &key) const {
+      return { bound(keyOf(key), false), this };
+    }
+
+    template<typename K>
+    iterator upper_bound(K const &key) const {
+      return { bound(keyOf(key), true), this };
+    }
+
+    template<typename K>
+    std::pair<iterator, iterator> equal_range(K const &key) const {
+      if (auto node = findNode(keyOf(key)); node && node->head) {
+        return { iterator{ node->head, this }, iterator{ node->tail->next, this } };
+      }
+      auto it = lower_bound(key);
+      return { it, it };
+    }
+
+    // All values whose key starts with prefix, found with a single descent
+    std::pair<iterator, iterator> equal_prefix(std::string_view prefix) const {
+      auto node = root.get();
+      while (node && !prefix.empty()) {
+        auto child = childAt(node, prefix.front());
+        if (child == node->children.end()) {
+          return { end(), end() };
+        }
+
+        auto const &label = (*child)->label;
+        auto const m = commonPrefix(label, prefix);
+        if (m < label.size() && m < prefix.size()) {
+          return { end(), end() };
+        }
+        node = child->get();
+        prefix.remove_prefix(m);
+      }
+
+      if (!node || empty()) {
+        return { end(), end() };
+      }
+      return { iterator{ firstIn(node), this }, iterator{ lastIn(node)->next, this } };
+    }
+
+  private:
+    template<typename K>
+    static std::string_view keyOf(K const &key) {
+      return std::string_view{ Compare::key(key) };
+    }
+
+    static std::size_t commonPrefix(std::string_view lhs, std::string_view rhs) {
+      auto const n = std::min(lhs.size(), rhs.size());
+      std::size_t i = 0;
+      while (i < n && lhs[i] == rhs[i]) ++i;
+      return i;
+    }
+
+    // Keys are ordered like std::string, byte by byte as unsigned char
+    static bool byteLess(char lhs, char rhs) {
+      return static_cast<unsigned char>(lhs) < static_cast<unsigned char>(rhs);
+    }
+
+    // The first child of node whose edge starts at or after byte c
+    template<typename N>
+    static auto lowerChild(N *node, char c) {
+      return std::lower_bound(node->children.begin(), node->children.end(), c,
+                              [](auto const &child, char ch) { return byteLess(child->label.front(), ch); });
+    }
+
+    static auto childAt(Node const *node, char c) {
+      auto it = lowerChild(node, c);
+      return it != node->children.end() && (*it)->label.front() == c ? it : node->children.end();
+    }
+
+    static auto childIndex(Node *parent, Node const *child) {
+      return lowerChild(parent, child->label.front());
+    }
+
+    // The last value in the subtree of node
+    static Leaf *lastIn(Node const *node) {
+      while (!node->children.empty()) {
+        node = node->children.back().get();
+      }
+      return node->tail;
+    }
+
+    // The last value ordered before everything in the subtree of node
+    static Leaf *before(Node const *node) {
+      for (; node->parent; node = node->parent) {
+        auto parent = node->parent;
+        if (auto it = childIndex(parent, node); it != parent->children.begin()) {
+          return lastIn(std::prev(it)->get());
+        }
+        if (parent->tail) {
+          return parent->tail;
+        }
+      }
+      return nullptr;
+    }
+
+    // The first value in the subtree of node, or the first one after it
+    Leaf *firstIn(Node const *node) const {
+      auto prev = before(node);
+      return prev ? prev->next : head;
+    }
+
+    Node const *findNode(std::string_view key) const {
+      auto node = root.get();
+      while (node && !key.empty()) {
+        auto child = childAt(node, key.front());
+        if (child == node->children.end()) {
+          return nullptr;
+        }
+
+        auto const &label = (*child)->label;
+        if (key.substr(0, label.size()) != label) {
+          return nullptr;
+        }
+        node = child->get();
+        key.remove_prefix(label.size());
+      }
+      return node;
+    }
+
+    // The first value with a key not less than (or greater than, if
+    // upper) key, walking the tree byte by byte instead of comparing keys
+    Leaf *bound(std::string_view key, bool upper) const {
+      auto node = root.get();
+      if (!node) {
+        return nullptr;
+      }
+
+      while (!key.empty()) {
+        auto it = lowerChild(node, key.front());
+        if (it == node->children.end()) {
+          auto last = lastIn(node);
+          return last ? last->next : firstIn(node);
+        }
+
+        auto const child = it->get();
+        auto const &label = child->label;
+        auto const m = commonPrefix(label, key);
+        if (m == label.size()) {
+          node = child;
+          key.remove_prefix(m);
+        }
+        else if (m == key.size() || byteLess(key[m], label[m])) {
+          return firstIn(child);
+        }
+        else {
+          return lastIn(child)->next;
+        }
+      }
+
+      if (upper && node->tail) {
+        return node->tail->next;
+      }
+      return firstIn(node);
+    }
+
+    Node *insertNode(std::string_view key) {
+      if (!root) {
+        root = std::make_unique<Node>();
+      }
+
+      auto node = root.get();
+      while (!key.empty()) {
+        auto it = lowerChild(node, key.front());
+        if (it == node->children.end() || (*it)->label.front() != key.front()) {
+          return addChild(node, it, key);
+        }
+
+        auto const child = it->get();
+        auto const m = commonPrefix(child->label, key);
+        if (m < child->label.size()) {
+          // Split the edge, keeping child (and the values pointing at it) in place
+          auto mid = std::make_unique<Node>();
+          mid->label = child->label.substr(0, m);
+          mid->parent = node;
+          child->label.erase(0, m);
+          child->parent = mid.get();
+          mid->children.emplace_back(std::move(*it));
+          *it = std::move(mid);
+        }
+
+        node = it->get();
+        key.remove_prefix(m);
+      }
+      return node;
+    }
+
+    template<typename It>
+    static Node *addChild(Node *parent, It pos, std::string_view label) {
+      auto child = std::make_unique<Node>();
+      child->label = std::string{ label };
+      child->parent = parent;
+      return parent->children.insert(pos, std::move(child))->get();
+    }
+
+    void link(Leaf *leaf, Node *node) {
+      leaf->node = node;
+      leaf->prev = node->tail ? node->tail : before(node);
+      leaf->next = leaf->prev ? leaf->prev->next : head;
+      (leaf->prev ? leaf->prev->next : head) = leaf;
+      (leaf->next ? leaf->next->prev : tail) = leaf;
+
+      if (!node->head) {
+        node->head = leaf;
+      }
+      node->tail = leaf;
+      ++entries;
+    }
+
+    // Detaches leaf from the list and the tree without freeing it, then
+    // removes the nodes it leaves without purpose
+    Leaf *unlink(Leaf *leaf) {
+      auto node = leaf->node;
+      if (node->head == leaf && node->tail == leaf) {
+        node->head = node->tail = nullptr;
+      }
+      else if (node->head == leaf) {
+        node->head = leaf->next;
+      }
+      else if (node->tail == leaf) {
+        node->tail = leaf->prev;
+      }
+
+      (leaf->prev ? leaf->prev->next : head) = leaf->next;
+      (leaf->next ? leaf->next->prev : tail) = leaf->prev;
+      --entries;
+
+      prune(node);
+      return leaf;
+    }
+
+    void prune(Node *node) {
+      if (node->head || !node->parent) {
+        return;
+      }
+
+      auto parent = node->parent;
+      if (node->children.empty()) {
+        parent->children.erase(childIndex(parent, node));
+        prune(parent);
+      }
+      else if (node->children.size() == 1) {
+        // Merge the only child into the edge above it
+        auto child = std::move(node->children.front());
+        child->label.insert(0, node->label);
+        child->parent = parent;
+        *childIndex(parent, node) = std::move(child);
+      }
+    }
+
+    static std::size_t treeBytes(Node const *node) {
+      if (!node) {
+        return 0;
+      }
+
+      auto ret = sizeof(Node) + Custom::HeapBytes<std::string>{}(node->label)
+               + node->children.capacity() * sizeof(std::unique_ptr<Node>);
+      for (auto &child : node->children) {
+        ret += treeBytes(child.get());
+      }
+      return ret;
+    }
+
+    std::unique_ptr<Node> root;
+    Leaf *head = nullptr, *tail = nullptr;
+    std::size_t entries = 0;
+  };
+}
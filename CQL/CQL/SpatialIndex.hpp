@@ -0,0 +1,225 @@
+#pragma once
+
+#include "Memory.hpp"
+
+#include <type_traits>
+#include <functional>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <tuple>
+#include <set>
+
+namespace CQL {
+  // Orders entries along a Z-order (Morton) curve over parts X and Y, which
+  // keeps entries that are close in the plane mostly close in the index.
+  // Box queries walk the curve from the lower left to the upper right
+  // corner of the box, jumping over every stretch of the curve that lies
+  // outside of it (the BIGMIN algorithm by Tropf and Herzog).
+  // Coordinates of any arithmetic type are mapped to 32 bits per axis while
+  // keeping their order, so wider types share curve positions and entries
+  // are always checked against their exact coordinates.
+  template<typename Entry, std::size_t X, std::size_t Y>
+  struct SpatialIndex {
+    using XType = std::decay_t<std::tuple_element_t<X, Entry>>;
+    using YType = std::decay_t<std::tuple_element_t<Y, Entry>>;
+
+    static_assert(std::is_arithmetic_v<XType> && std::is_arithmetic_v<YType>,
+                  "Spatial lookups need two arithmetic parts");
+
+    void insert(Entry const *entry) {
+      entries.emplace(zOf(*entry), entry);
+    }
+
+    void erase(Entry const *entry) {
+      entries.erase({ zOf(*entry), entry });
+    }
+
+    void clear() {
+      entries.clear();
+    }
+
+    std::size_t size() const {
+      return entries.size();
+    }
+
+    std::size_t memoryUsage() const {
+      return entries.get_allocator().allocated();
+    }
+
+    // Calls functor with every entry with x0 <= x <= x1 and y0 <= y <= y1
+    template<typename F>
+    void forEachInBox(XType x0, YType y0, XType x1, YType y1, F &&functor) const {
+      if (x1 < x0 || y1 < y0) {
+        return;
+      }
+
+      auto const ox0 = ordered(x0), ox1 = ordered(x1);
+      auto const oy0 = ordered(y0), oy1 = ordered(y1);
+      auto const zmin = interleave(ox0, oy0), zmax = interleave(ox1, oy1);
+
+      for (auto it = entries.lower_bound({ zmin, nullptr }); it != entries.end() && it->first <= zmax;) {
+        auto const &entry = *it->second;
+        auto const x = std::get<X>(entry);
+        auto const y = std::get<Y>(entry);
+        auto const ox = ordered(x), oy = ordered(y);
+
+        if (ox0 <= ox && ox <= ox1 && oy0 <= oy && oy <= oy1) {
+          if (x0 <= x && x <= x1 && y0 <= y && y <= y1) {
+            functor(entry);
+          }
+          ++it;
+        }
+        else {
+          it = entries.lower_bound({ bigmin(it->first, zmin, zmax), nullptr });
+        }
+      }
+    }
+
+    // The k entries closest to (x, y) by euclidean distance, nearest first.
+    // The k entries next to (x, y) on the curve bound the distance to the
+    // k:th nearest one, and a single box query of that size finds them all.
+    std::vector<Entry const *> nearest(double x, double y, std::size_t k) const {
+      std::vector<Entry const *> ret;
+      k = std::min(k, entries.size());
+      if (!k) {
+        return ret;
+      }
+
+      auto const z = interleave(ordered(clamp<XType>(x)), ordered(clamp<YType>(y)));
+      auto const mid = entries.lower_bound({ z, nullptr });
+      auto lo = mid, hi = mid;
+      double farthest = 0;
+      for (std::size_t found = 0; found < k; ++found) {
+        auto const takeHi = hi != entries.end() && (lo == entries.begin() || found % 2 == 0);
+        auto const &entry = *(takeHi ? hi++ : --lo)->second;
+        farthest = std::max(farthest, distance(entry, x, y));
+      }
+      // distance() is squared, the box needs the distance itself
+      auto const radius = std::sqrt(farthest);
+
+      auto const bx0 = clamp<XType>(x - radius, true), bx1 = clamp<XType>(x + radius, false);
+      auto const by0 = clamp<YType>(y - radius, true), by1 = clamp<YType>(y + radius, false);
+      forEachInBox(bx0, by0, bx1, by1, [&](Entry const &entry) {
+        ret.emplace_back(&entry);
+      });
+
+      auto const closer = [&](Entry const *lhs, Entry const *rhs) {
+        return distance(*lhs, x, y) < distance(*rhs, x, y);
+      };
+      k = std::min(k, ret.size());
+      std::partial_sort(ret.begin(), ret.begin() + static_cast<std::ptrdiff_t>(k), ret.end(), closer);
+      ret.resize(k);
+      return ret;
+    }
+
+    // The squared euclidean distance from entry to (x, y)
+    static double distance(Entry const &entry, double x, double y) {
+      auto const dx = static_cast<double>(std::get<X>(entry)) - x;
+      auto const dy = static_cast<double>(std::get<Y>(entry)) - y;
+      return dx * dx + dy * dy;
+    }
+
+  private:
+    // Maps v to 32 bits, keeping the order (but not always distinctness)
+    template<typename T>
+    static std::uint32_t ordered(T v) {
+      if constexpr(std::is_floating_point_v<T>) {
+        double d = v == 0 ? 0.0 : static_cast<double>(v);
+        std::uint64_t bits;
+        std::memcpy(&bits, &d, sizeof bits);
+        bits = bits >> 63 ? ~bits : bits | (std::uint64_t{ 1 } << 63);
+        return static_cast<std::uint32_t>(bits >> 32);
+      }
+      else if constexpr(sizeof(T) <= 4) {
+        if constexpr(std::is_signed_v<T>) {
+          return static_cast<std::uint32_t>(static_cast<std::int32_t>(v)) ^ 0x80000000u;
+        }
+        else {
+          return static_cast<std::uint32_t>(v);
+        }
+      }
+      else if constexpr(std::is_signed_v<T>) {
+        return static_cast<std::uint32_t>((static_cast<std::uint64_t>(v) ^ (std::uint64_t{ 1 } << 63)) >> 32);
+      }
+      else {
+        return static_cast<std::uint32_t>(static_cast<std::uint64_t>(v) >> 32);
+      }
+    }
+
+    // The closest value of T to v, rounded inwards for box bounds
+    template<typename T>
+    static T clamp(double v, bool lower = true) {
+      if constexpr(std::is_floating_point_v<T>) {
+        return static_cast<T>(v);
+      }
+      else {
+        v = lower ? std::ceil(v) : std::floor(v);
+        if (!(v > static_cast<double>(std::numeric_limits<T>::lowest()))) {
+          return std::numeric_limits<T>::lowest();
+        }
+        if (!(v < static_cast<double>(std::numeric_limits<T>::max()))) {
+          return std::numeric_limits<T>::max();
+        }
+        return static_cast<T>(v);
+      }
+    }
+
+    static std::uint64_t spread(std::uint32_t v) {
+      std::uint64_t x = v;
+      x = (x | x << 16) & 0x0000FFFF0000FFFFull;
+      x = (x | x << 8)  & 0x00FF00FF00FF00FFull;
+      x = (x | x << 4)  & 0x0F0F0F0F0F0F0F0Full;
+      x = (x | x << 2)  & 0x3333333333333333ull;
+      x = (x | x << 1)  & 0x5555555555555555ull;
+      return x;
+    }
+
+    static std::uint64_t interleave(std::uint32_t x, std::uint32_t y) {
+      return spread(x) | spread(y) << 1;
+    }
+
+    static std::uint64_t zOf(Entry const &entry) {
+      return interleave(ordered(std::get<X>(entry)), ordered(std::get<Y>(entry)));
+    }
+
+    // The smallest position on the curve after z that lies inside the box
+    // spanned by zmin and zmax, for a z inside [zmin, zmax] but outside the box
+    static std::uint64_t bigmin(std::uint64_t z, std::uint64_t zmin, std::uint64_t zmax) {
+      std::uint64_t ret = 0;
+      for (int bit = 63; bit >= 0; --bit) {
+        auto const mask = std::uint64_t{ 1 } << bit;
+        // The lower bits along the same axis as this one
+        auto const below = (bit % 2 ? 0xAAAAAAAAAAAAAAAAull : 0x5555555555555555ull) & (mask - 1);
+        auto const load1000 = [&](std::uint64_t v) { return (v | mask) & ~below; };
+        auto const load0111 = [&](std::uint64_t v) { return (v & ~mask) | below; };
+
+        switch ((z & mask ? 4 : 0) | (zmin & mask ? 2 : 0) | (zmax & mask ? 1 : 0)) {
+          case 1:
+            ret = load1000(zmin);
+            zmax = load0111(zmax);
+            break;
+          case 3:
+            return zmin;
+          case 4:
+            return ret;
+          case 5:
+            zmin = load1000(zmin);
+            break;
+          default:
+            break;
+        }
+      }
+      return ret;
+    }
+
+    using Position = std::pair<std::uint64_t, Entry const *>;
+
+    std::set<Position, std::less<Position>, Detail::CountingAllocator<Position>> entries;
+  };
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include "FlatHashMap.hpp"
+
+#include <unordered_set>
+#include <type_traits>
+#include <cstddef>
+#include <utility>
+#include <tuple>
+
+namespace CQL {
+  template<typename Entry>
+  struct Table;
+
+  // What happened to an entry, as told to the listeners of a table
+  enum class Change {
+    Insert,
+    Update,
+    Erase,
+  };
+
+  namespace Detail {
+    template<typename Acc, typename Entry, typename = void>
+    constexpr bool canRemove = false;
+
+    template<typename Acc, typename Entry>
+    constexpr bool canRemove<Acc, Entry,
+      std::void_t<decltype(std::declval<Acc &>().remove(std::declval<Entry const &>()))>> = true;
+
+    // Listens to a table for as long as it lives
+    template<typename Entry>
+    struct Subscription {
+      template<typename F>
+      Subscription(Table<Entry> &table, F &&listener) :
+        table{ table }, id{ table.subscribe(std::forward<F>(listener)) } { }
+
+      Subscription(Subscription const &) = delete;
+      Subscription &operator=(Subscription const &) = delete;
+
+      ~Subscription() {
+        table.unsubscribe(id);
+      }
+
+    private:
+      Table<Entry> &table;
+      std::size_t const id;
+    };
+  }
+
+  // Views are query results kept up to date as the table changes, so that
+  // reading them doesn't run the query again. They can't be moved, and
+  // neither can their table while they are alive.
+
+  // The entries of a table passing a predicate, in no particular order
+  template<typename Entry, typename Pred>
+  struct FilterView {
+    FilterView(Table<Entry> &table, Pred predicate) :
+      predicate{ std::move(predicate) },
+      subscription{ table, [this](Change change, Entry const &entry, Entry const *) {
+        if (change != Change::Erase && this->predicate(entry)) {
+          rows.emplace(&entry);
+        }
+        else {
+          rows.erase(&entry);
+        }
+      } } {
+      for (auto &entry : table) {
+        if (this->predicate(entry)) {
+          rows.emplace(&entry);
+        }
+      }
+    }
+
+    std::size_t size() const {
+      return rows.size();
+    }
+
+    bool contains(Entry const *entry) const {
+      return rows.count(entry);
+    }
+
+    template<typename F>
+    void forEach(F functor) const {
+      for (auto row : rows) {
+        functor(*row);
+      }
+    }
+
+    template<typename F>
+    auto operator>>=(F functor) const { return forEach(functor); }
+
+  private:
+    Pred predicate;
+    std::unordered_set<Entry const *> rows;
+    Detail::Subscription<Entry> subscription;
+  };
+
+  // The number of entries of a table passing a predicate
+  template<typename Entry, typename Pred>
+  struct CountView {
+    static_assert(std::is_copy_constructible_v<Entry>,
+                  "Count views need to see entries from before their updates");
+
+    CountView(Table<Entry> &table, Pred predicate) :
+      predicate{ std::move(predicate) },
+      subscription{ table, [this](Change change, Entry const &entry, Entry const *before) {
+        if (change == Change::Update) {
+          n -= this->predicate(*before);
+        }
+        if (change == Change::Erase) {
+          n -= this->predicate(entry);
+        }
+        else {
+          n += this->predicate(entry);
+        }
+      } } {
+      for (auto &entry : table) {
+        n += this->predicate(entry);
+      }
+    }
+
+    std::size_t count() const {
+      return n;
+    }
+
+  private:
+    Pred predicate;
+    std::size_t n = 0;
+    Detail::Subscription<Entry> subscription;
+  };
+
+  // Aggregates of the entries of a table passing a predicate, per distinct
+  // value of part N, like groupBy<N>(Aggs...) on a query. Only aggregates
+  // that can take entries out again work here, like Count, Sum and Avg.
+  template<typename Entry, std::size_t N, typename Pred, typename ...Aggs>
+  struct GroupByView {
+    static_assert(std::is_copy_constructible_v<Entry>,
+                  "Group by views need to see entries from before their updates");
+    static_assert((... && Detail::canRemove<typename Aggs::template Accumulator<Entry>, Entry>),
+                  "Group by views only work with aggregates that can remove entries");
+
+    using Key = std::decay_t<std::tuple_element_t<N, Entry>>;
+
+    GroupByView(Table<Entry> &table, Pred predicate) :
+      predicate{ std::move(predicate) },
+      subscription{ table, [this](Change change, Entry const &entry, Entry const *before) {
+        if (change == Change::Update && this->predicate(*before)) {
+          remove(*before);
+        }
+        if (this->predicate(entry)) {
+          if (change == Change::Erase) {
+            remove(entry);
+          }
+          else {
+            add(entry);
+          }
+        }
+      } } {
+      for (auto &entry : table) {
+        if (this->predicate(entry)) {
+          add(entry);
+        }
+      }
+    }
+
+    // The number of groups
+    std::size_t size() const {
+      return groups.size();
+    }
+
+    // Calls functor(key, results...) for every group, in no particular order
+    template<typename F>
+    void forEach(F functor) const {
+      groups.forEach([&](Key const &key, Group const &group) {
+        std::apply([&](auto const &...acc) { functor(key, acc.result()...); }, group.accs);
+      });
+    }
+
+    template<typename F>
+    auto operator>>=(F functor) const { return forEach(functor); }
+
+  private:
+    using Accumulators = std::tuple<typename Aggs::template Accumulator<Entry>...>;
+
+    struct Group {
+      std::size_t entries = 0;
+      Accumulators accs;
+    };
+
+    void add(Entry const &entry) {
+      auto &group = groups[std::get<N>(entry)];
+      ++group.entries;
+      std::apply([&](auto &...acc) { (acc.add(entry), ...); }, group.accs);
+    }
+
+    void remove(Entry const &entry) {
+      auto group = groups.find(std::get<N>(entry));
+      if (!--group->entries) {
+        groups.erase(std::get<N>(entry));
+      }
+      else {
+        std::apply([&](auto &...acc) { (acc.remove(entry), ...); }, group->accs);
+      }
+    }
+
+    Pred predicate;
+    Detail::FlatHashMap<Key, Group> groups;
+    Detail::Subscription<Entry> subscription;
+  };
+
+  template<typename Entry, typename Pred>
+  auto filterView(Table<Entry> &table, Pred &&predicate) {
+    return FilterView<Entry, std::decay_t<Pred>>{ table, std::forward<Pred>(predicate) };
+  }
+
+  template<typename Entry, typename Pred>
+  auto countView(Table<Entry> &table, Pred &&predicate) {
+    return CountView<Entry, std::decay_t<Pred>>{ table, std::forward<Pred>(predicate) };
+  }
+
+  template<std::size_t N, typename Entry, typename Pred, typename ...Aggs>
+  auto groupByView(Table<Entry> &table, Pred &&predicate, Aggs...) {
+    return GroupByView<Entry, N, std::decay_t<Pred>, Aggs...>{ table, std::forward<Pred>(predicate) };
+  }
+}
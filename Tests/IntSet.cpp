@@ -1,7 +1,33 @@
+#include "CQL/Custom.hpp"
+
+#include <tuple>
+
+// id, time, value
+using Reading = std::tuple<int, long, short>;
+
+namespace CQL::Custom {
+  template<>
+  struct Index<Reading, 1> {
+    constexpr Indexing operator()() const {
+      return Indexing::Lazy;
+    }
+  };
+
+  template<>
+  struct Index<Reading, 2> {
+    constexpr Indexing operator()() const {
+      return Indexing::None;
+    }
+  };
+}
+
 #include "CQL.hpp"
 
 #include "gtest/gtest.h"
 
+#include <random>
+#include <set>
+
 TEST(Emplace, IntSet) {
   CQL::Table<std::tuple<int>> db;
   auto const a = db.emplace(5);
@@ -390,3 +416,227 @@ TEST(Swap, IntSet) {
   
   EXPECT_EQ(db.size(), 100);
 }
+
+TEST(Nth, IntSet) {
+  CQL::Table<std::tuple<int>> db;
+
+  for (int i = 9; i >= 0; --i) {
+    db.emplace(i * 2);
+  }
+
+  EXPECT_EQ(std::get<0>(*db.nth<0>(0)), 0);
+  EXPECT_EQ(std::get<0>(*db.nth<0>(7)), 14);
+  EXPECT_EQ(db.nth<0>(10), nullptr);
+  EXPECT_EQ(db.rank<0>(7), 4);
+  EXPECT_EQ(std::get<0>(*(db.vbegin<0>() + 3)), 6);
+}
+
+TEST(Equal, IntSet) {
+  CQL::Table<std::tuple<int>> db;
+
+  for (int i = 0; i < 10; ++i) {
+    db.emplace(i % 3);
+  }
+
+  std::size_t count = 0;
+
+  db.equal<0>(1) >>= [&count](auto const &val) {
+    EXPECT_EQ(std::get<0>(val), 1);
+    ++count;
+  };
+
+  EXPECT_EQ(count, 3);
+}
+
+TEST(In, IntSet) {
+  CQL::Table<std::tuple<int>> db;
+
+  for (int i = 0; i < 100; ++i) {
+    db.emplace(i / 2);
+  }
+
+  std::vector<int> vals;
+
+  db.in<0>(40, 3, 17, 3, 1000) >>= [&vals](auto const &val) {
+    vals.emplace_back(std::get<0>(val));
+  };
+
+  auto const ans = std::vector<int>{ 3, 3, 17, 17, 40, 40 };
+
+  EXPECT_EQ(vals, ans);
+
+  std::vector<int> const keys{ 49, 0, 25 };
+  vals.clear();
+
+  db.in<0>(keys) && db.pred([](auto const &val) {
+    return std::get<0>(val) != 25;
+  }) >>= [&vals](auto const &val) {
+    vals.emplace_back(std::get<0>(val));
+  };
+
+  auto const ans2 = std::vector<int>{ 0, 0, 49, 49 };
+
+  EXPECT_EQ(vals, ans2);
+}
+
+TEST(LookupMany, IntSet) {
+  CQL::Table<std::tuple<int>> db;
+
+  for (int i = 0; i < 1000; ++i) {
+    db.emplace(i * 3);
+  }
+
+  std::vector<int> keys{ 300, 7, 2997, 0, 1500, 3000, 301, 300 };
+  auto const found = db.lookupMany<0>(keys);
+
+  ASSERT_EQ(found.size(), keys.size());
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    if (keys[i] % 3 == 0 && keys[i] < 3000) {
+      ASSERT_NE(found[i], nullptr);
+      EXPECT_EQ(std::get<0>(*found[i]), keys[i]);
+    }
+    else {
+      EXPECT_EQ(found[i], nullptr);
+    }
+  }
+}
+
+TEST(Bitmap, IntSet) {
+  CQL::Bitmap bitmap, other;
+  std::set<std::uint32_t> ans, otherAns;
+  std::mt19937 rng{ 5 };
+
+  // Dense enough in the first container to turn it into a bitmap
+  for (int i = 0; i < 20000; ++i) {
+    auto const val = rng() % 3 ? rng() % 30000 : rng();
+    EXPECT_EQ(bitmap.add(val), ans.insert(val).second);
+    if (rng() % 4 == 0) {
+      auto const gone = rng() % 30000;
+      EXPECT_EQ(bitmap.remove(gone), ans.erase(gone) == 1);
+    }
+    auto const o = rng() % 60000;
+    other.add(o);
+    otherAns.insert(o);
+  }
+
+  std::vector<std::uint32_t> values;
+  bitmap.forEach([&](std::uint32_t v) { values.emplace_back(v); });
+  EXPECT_EQ(values, std::vector<std::uint32_t>(ans.begin(), ans.end()));
+  EXPECT_EQ(bitmap.size(), ans.size());
+
+  for (int i = 0; i < 1000; ++i) {
+    auto const val = rng() % 40000;
+    auto const next = ans.lower_bound(val);
+    EXPECT_EQ(bitmap.next(val), next == ans.end() ? CQL::Bitmap::npos : *next);
+    auto const prev = ans.upper_bound(val);
+    EXPECT_EQ(bitmap.prev(val), prev == ans.begin() ? CQL::Bitmap::npos : *std::prev(prev));
+  }
+
+  std::vector<std::uint32_t> both, either;
+  std::set_intersection(ans.begin(), ans.end(), otherAns.begin(), otherAns.end(), std::back_inserter(both));
+  std::set_union(ans.begin(), ans.end(), otherAns.begin(), otherAns.end(), std::back_inserter(either));
+
+  values.clear();
+  (bitmap & other).forEach([&](std::uint32_t v) { values.emplace_back(v); });
+  EXPECT_EQ(values, both);
+
+  values.clear();
+  (bitmap | other).forEach([&](std::uint32_t v) { values.emplace_back(v); });
+  EXPECT_EQ(values, either);
+
+  std::vector<std::uint32_t> onlyLeft;
+  std::set_difference(ans.begin(), ans.end(), otherAns.begin(), otherAns.end(), std::back_inserter(onlyLeft));
+  values.clear();
+  (bitmap - other).forEach([&](std::uint32_t v) { values.emplace_back(v); });
+  EXPECT_EQ(values, onlyLeft);
+  EXPECT_TRUE((bitmap - bitmap).empty());
+}
+
+TEST(LazyAndNoIndex, IntSet) {
+  CQL::Table<Reading> db;
+  std::vector<Reading const *> readings;
+  for (int i = 0; i < 200; ++i) {
+    readings.emplace_back(db.emplace(i, static_cast<long>(i * 7 % 50), static_cast<short>(i % 5)));
+  }
+  db.erase(readings[10]);
+  db.update<1>(readings[20], 1000L);
+  db.update<2>(readings[30], short{ 9 });
+
+  auto count = [](auto &&expr) {
+    std::size_t ret = 0;
+    expr >>= [&](Reading const &) { ++ret; };
+    return ret;
+  };
+
+  auto brute = [&](auto &&pred) {
+    std::size_t ret = 0;
+    for (auto &r : db) {
+      ret += pred(r);
+    }
+    return ret;
+  };
+
+  // Scans, as part 2 has no index
+  EXPECT_EQ(count(db.equal<2>(short{ 3 })), brute([](Reading const &r) { return std::get<2>(r) == 3; }));
+  EXPECT_EQ(count(db.in<2>(short{ 1 }, short{ 9 })), brute([](Reading const &r) { return std::get<2>(r) == 1 || std::get<2>(r) == 9; }));
+  EXPECT_EQ(std::get<0>(*db.lookup<2>(short{ 9 })), 30);
+
+  // The first query builds the lazy index, later changes keep it up to date
+  EXPECT_EQ(count(db.range<1>(10L, 20L)), brute([](Reading const &r) { return 10 <= std::get<1>(r) && std::get<1>(r) <= 20; }));
+  db.update<1>(readings[40], 15L);
+  db.update<2>(readings[41], short{ 7 });
+  db.erase(readings[50]);
+  db.emplace(500, 12L, short{ 0 });
+  EXPECT_EQ(count(db.range<1>(10L, 20L)), brute([](Reading const &r) { return 10 <= std::get<1>(r) && std::get<1>(r) <= 20; }));
+  EXPECT_EQ(std::get<0>(*db.lookup<1>(1000L)), 20);
+
+  std::vector<long> times;
+  for (auto it = db.vbegin<1>(); it != db.vend<1>(); ++it) {
+    times.emplace_back(std::get<1>(*it));
+  }
+  EXPECT_EQ(times.size(), db.size());
+  EXPECT_TRUE(std::is_sorted(times.begin(), times.end()));
+
+  db.clear();
+  EXPECT_EQ(count(db.range<1>(0L, 2000L)), 0);
+  db.emplace(1, 5L, short{ 1 });
+  EXPECT_EQ(count(db.range<1>(0L, 2000L)), 1);
+}
+
+TEST(BuildIndex, IntSet) {
+  CQL::Table<Reading> db;
+  for (int i = 0; i < 100; ++i) {
+    db.emplace(i, static_cast<long>(i % 10), short{ 0 });
+  }
+  EXPECT_EQ(db.memoryUsage().parts[1].index, 0u);
+
+  // Built up front, so the const queries below only read the table
+  db.buildIndex<1>();
+  auto const built = db.memoryUsage().parts[1].index;
+  EXPECT_GT(built, 0u);
+
+  auto const &view = db;
+  EXPECT_EQ(std::get<1>(*view.vbegin<1>()), 0L);
+  EXPECT_EQ(std::get<1>(*view.nth<1>(99)), 9L);
+  EXPECT_EQ(db.memoryUsage().parts[1].index, built);
+}
+
+TEST(Cursor, IntSet) {
+  CQL::Table<std::tuple<int>> db;
+  std::vector<std::tuple<int> const *> rows;
+  for (int i = 0; i < 100; ++i) {
+    rows.emplace_back(db.emplace(i));
+  }
+
+  // Walked in the default lookup, which orders by address here
+  std::multiset<int> seen;
+  auto evens = db.cursor(db.all() && db.pred([](std::tuple<int> const &t) { return std::get<0>(t) % 2 == 0; }));
+  ASSERT_TRUE(evens.next(30, [&](std::tuple<int> const &t) { seen.emplace(std::get<0>(t)); }));
+  auto const first = seen.size();
+  EXPECT_EQ(first, 15u);
+
+  db.erase(rows[98]);
+  while (evens.next(30, [&](std::tuple<int> const &t) { seen.emplace(std::get<0>(t)); }));
+  EXPECT_EQ(seen.size(), 50u - (seen.count(98) ? 0 : 1));
+  EXPECT_EQ(std::set<int>(seen.begin(), seen.end()).size(), seen.size());
+}
@@ -4,6 +4,48 @@
 
 #include "gtest/gtest.h"
 
+#include <stdexcept>
+#include <random>
+
+// A Point that a test can give its own customizations, without changing
+// the indexes every other Point table gets
+template<typename Tag>
+struct TaggedPoint : Point {
+  using Point::Point;
+};
+
+template<typename Tag> struct std::tuple_size<TaggedPoint<Tag>> : std::tuple_size<Point> { };
+template<std::size_t Ind, typename Tag> struct std::tuple_element<Ind, TaggedPoint<Tag>> : std::tuple_element<Ind, Point> { };
+
+// Ys in a bitmap index
+using BitmapPoint = TaggedPoint<struct Bitmap>;
+
+// In a spatial index over both coordinates
+using SpatialPoint = TaggedPoint<struct Spatial>;
+
+namespace CQL::Custom {
+  template<>
+  struct Index<BitmapPoint, 1> {
+    constexpr Indexing operator()() const {
+      return Indexing::Bitmap;
+    }
+  };
+
+  template<>
+  struct SpatialLookup<SpatialPoint> {
+    constexpr std::pair<std::size_t, std::size_t> operator()() const {
+      return { 0, 1 };
+    }
+  };
+
+  template<>
+  struct SpatialLookup<std::pair<double, double>> {
+    constexpr std::pair<std::size_t, std::size_t> operator()() const {
+      return { 0, 1 };
+    }
+  };
+}
+
 TEST(Range, Point) {
   CQL::Table<Point> db;
 
@@ -90,3 +132,358 @@ TEST(ComplexQuery, Point) {
 
   EXPECT_EQ(points, ans);
 }
+
+namespace {
+  // An aggregate failing on the entries with x == X
+  template<int X>
+  struct FailAt {
+    template<typename Entry>
+    struct Accumulator {
+      void add(Entry const &entry) {
+        if (entry.first == X) {
+          throw std::runtime_error{ "aggregate failed" };
+        }
+      }
+      void merge(Accumulator const &) { }
+      int result() const { return 0; }
+    };
+  };
+}
+
+TEST(GroupBy, Point) {
+  CQL::Table<Point> db;
+
+  for (int x = 0; x < 300; ++x) {
+    for (int y = 0; y < 300; ++y) {
+      db.emplace(x, y);
+    }
+  }
+
+  auto const check = [](auto &&groupBy) {
+    std::vector<std::tuple<int, std::size_t, int>> groups;
+
+    groupBy >>= [&](int y, std::size_t count, int sum) {
+      groups.emplace_back(y, count, sum);
+    };
+
+    std::sort(groups.begin(), groups.end());
+
+    EXPECT_EQ(groups.size(), 300);
+    for (int y = 0; y < 300 && y < static_cast<int>(groups.size()); ++y) {
+      EXPECT_EQ(groups[y], std::make_tuple(y, std::size_t{ 300 }, 299 * 300 / 2));
+    }
+  };
+
+  check(db.range<0>(0, 299).groupBy<1>(CQL::Count{}, CQL::Sum<0>{}));
+  check(db.range<0>(0, 299).groupBy<1>(CQL::Count{}, CQL::Sum<0>{}).parallel(4));
+  check(db.range<1>(0, 299).groupBy<1>(CQL::Count{}, CQL::Sum<0>{}));
+
+  // Failures on the calling thread and on the others leave no thread running
+  auto const run = [](auto &&groupBy) { groupBy >>= [](int, int) { }; };
+  EXPECT_THROW(run(db.range<0>(0, 299).groupBy<1>(FailAt<0>{}).parallel(4)), std::runtime_error);
+  EXPECT_THROW(run(db.range<0>(0, 299).groupBy<1>(FailAt<299>{}).parallel(4)), std::runtime_error);
+}
+
+TEST(Columns, Point) {
+  CQL::Table<Point> db;
+
+  for (int x = -15; x < 15; ++x) {
+    for (int y = -15; y < 15; ++y) {
+      db.emplace(x, y);
+    }
+  }
+
+  using CQL::col;
+
+  auto const snapshot = db.columns<0, 1>();
+  auto const check = [&](auto const &pred) {
+    std::vector<Point> expected, points;
+
+    db.all() && db.pred([&](Point const &p) { return pred(p); }) >>= [&](Point const &entry) {
+      expected.emplace_back(entry);
+    };
+
+    snapshot.where(pred) >>= [&](Point const &entry) {
+      points.emplace_back(entry);
+    };
+
+    std::sort(expected.begin(), expected.end());
+    std::sort(points.begin(), points.end());
+
+    EXPECT_FALSE(expected.empty());
+    EXPECT_EQ(points, expected);
+  };
+
+  check(col<0>() > 5);
+  check(col<0>() >= 5 && col<1>() < -3);
+  check(col<0>() == col<1>() || 3 <= col<1>());
+  check(!(col<0>() != 0));
+  check(col<0>() + col<1>() * 2 <= 4);
+  check(col<1>() > 2.5);
+}
+
+TEST(ColumnPredicate, Point) {
+  CQL::Table<Point> db;
+
+  for (int x = -1; x <= 1; ++x) {
+    for (int y = -1; y <= 1; ++y) {
+      db.emplace(x, y);
+    }
+  }
+
+  using CQL::col;
+
+  std::vector<Point> points;
+
+  db.range<0>(0, 1) && db.pred(col<0>() == col<1>()) >>= [&](Point const &entry) {
+    points.emplace_back(entry);
+  };
+
+  auto const ans = std::vector<Point>{ Point(0, 0), Point(1, 1) };
+
+  EXPECT_EQ(points, ans);
+}
+
+TEST(BitmapIndex, Point) {
+  CQL::Table<BitmapPoint> db;
+  std::vector<BitmapPoint const *> points;
+  std::mt19937 rng{ 3 };
+
+  for (int i = 0; i < 3000; ++i) {
+    if (points.empty() || rng() % 4) {
+      points.emplace_back(db.emplace(static_cast<int>(rng() % 50), static_cast<int>(rng() % 8)));
+    }
+    else if (rng() % 2) {
+      auto const pos = rng() % points.size();
+      db.erase(points[pos]);
+      points.erase(points.begin() + pos);
+    }
+    else {
+      db.update<1>(points[rng() % points.size()], static_cast<int>(rng() % 8));
+    }
+  }
+
+  // Erasing through an iterator has to free the row id as well
+  for (auto it = db.begin(); it != db.end();) {
+    if ((*it).first % 7 == 0) {
+      points.erase(std::find(points.begin(), points.end(), &*it));
+      it = db.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+
+  auto collect = [](auto &&expr) {
+    std::vector<BitmapPoint const *> ret;
+    expr >>= [&](BitmapPoint const &p) { ret.emplace_back(&p); };
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  };
+
+  auto brute = [&](auto &&pred) {
+    std::vector<BitmapPoint const *> ret;
+    std::copy_if(points.begin(), points.end(), std::back_inserter(ret), [&](BitmapPoint const *p) { return pred(*p); });
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  };
+
+  EXPECT_EQ(collect(db.equal<1>(3)), brute([](BitmapPoint const &p) { return p.second == 3; }));
+  EXPECT_EQ(collect(db.range<1>(2, 5)), brute([](BitmapPoint const &p) { return 2 <= p.second && p.second <= 5; }));
+  EXPECT_EQ(collect(db.in<1>(1, 6)), brute([](BitmapPoint const &p) { return p.second == 1 || p.second == 6; }));
+  EXPECT_EQ(collect(db.range<1>(2, 5) && db.range<1>(4, 7)), brute([](BitmapPoint const &p) { return 4 <= p.second && p.second <= 5; }));
+  EXPECT_EQ(collect(db.equal<1>(0) || db.equal<1>(7)), brute([](BitmapPoint const &p) { return p.second == 0 || p.second == 7; }));
+  EXPECT_EQ(collect(db.range<0>(10, 20) && db.equal<1>(2)), brute([](BitmapPoint const &p) { return 10 <= p.first && p.first <= 20 && p.second == 2; }));
+  EXPECT_EQ(collect(db.equal<1>(2) && db.range<0>(10, 20)), brute([](BitmapPoint const &p) { return 10 <= p.first && p.first <= 20 && p.second == 2; }));
+  EXPECT_EQ((db.equal<1>(1) && db.equal<1>(2)).count(), 0);
+  EXPECT_EQ(collect(db.notEqual<1>(3)), brute([](BitmapPoint const &p) { return p.second != 3; }));
+  EXPECT_EQ(collect(db.range<1>(2, 5) - db.equal<1>(4)), brute([](BitmapPoint const &p) { return 2 <= p.second && p.second <= 5 && p.second != 4; }));
+  EXPECT_EQ(collect(!!db.equal<1>(3)), collect(db.equal<1>(3)));
+
+  std::vector<int> ys, reversed;
+  for (auto it = db.vbegin<1>(); it != db.vend<1>(); ++it) {
+    ys.emplace_back((*it).second);
+  }
+  for (auto it = db.rvbegin<1>(); it != db.rvend<1>(); ++it) {
+    reversed.emplace_back((*it).second);
+  }
+  EXPECT_EQ(ys.size(), points.size());
+  EXPECT_TRUE(std::is_sorted(ys.begin(), ys.end()));
+  EXPECT_GT(db.memoryUsage().rowIds, 0u);
+  EXPECT_EQ(reversed, std::vector<int>(ys.rbegin(), ys.rend()));
+}
+
+TEST(Negation, Point) {
+  CQL::Table<Point> db;
+  for (int x = 0; x < 10; ++x) {
+    for (int y = 0; y < 4; ++y) {
+      db.emplace(x, y);
+    }
+  }
+
+  auto collect = [](auto &&expr) {
+    std::vector<Point> ret;
+    expr >>= [&](Point const &p) { ret.emplace_back(p); };
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  };
+
+  auto brute = [&](auto &&pred) {
+    std::vector<Point> ret;
+    for (auto &p : db) {
+      if (pred(p)) {
+        ret.emplace_back(p);
+      }
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  };
+
+  EXPECT_EQ(collect(!db.range<0>(3, 6)), brute([](Point const &p) { return p.first < 3 || 6 < p.first; }));
+  EXPECT_EQ(collect(db.notEqual<0>(0)), brute([](Point const &p) { return p.first != 0; }));
+  EXPECT_EQ(collect(db.notEqual<0>(42)).size(), db.size());
+  // An empty range leaves the whole table
+  EXPECT_EQ(collect(!db.range<0>(6, 3)).size(), db.size());
+  EXPECT_EQ(collect(!!db.range<0>(3, 6)), collect(db.range<0>(3, 6)));
+
+  // The rest is negated by testing each entry
+  auto onDiagonal = db.pred([](Point const &p) { return p.first == p.second; });
+  EXPECT_EQ(collect(db.range<0>(0, 3) && !onDiagonal), brute([](Point const &p) { return p.first <= 3 && p.first != p.second; }));
+  EXPECT_EQ(collect(db.range<0>(0, 3) && !!onDiagonal), brute([](Point const &p) { return p.first <= 3 && p.first == p.second; }));
+
+  // and can be walked on their own as well
+  EXPECT_EQ(collect(!(db.range<0>(1, 2) || db.range<0>(3, 3))), brute([](Point const &p) { return p.first < 1 || 3 < p.first; }));
+  EXPECT_EQ(collect(!db.in<0>(1, 4)), brute([](Point const &p) { return p.first != 1 && p.first != 4; }));
+  EXPECT_EQ(collect(!onDiagonal), brute([](Point const &p) { return p.first != p.second; }));
+  EXPECT_EQ(collect(!(db.range<0>(1, 2) || db.range<0>(3, 3)) && !onDiagonal), brute([](Point const &p) {
+    return (p.first < 1 || 3 < p.first) && p.first != p.second;
+  }));
+  EXPECT_EQ(collect(!!(db.range<0>(1, 2) || db.range<0>(3, 3))), collect(db.range<0>(1, 3)));
+
+  // Differences, walking the left hand side
+  EXPECT_EQ(collect(db.range<0>(2, 7) - db.range<0>(4, 5)), brute([](Point const &p) { return (2 <= p.first && p.first <= 3) || (6 <= p.first && p.first <= 7); }));
+  EXPECT_EQ(collect(db.range<0>(2, 3) - (db.range<0>(0, 2) || db.equal<1>(1))), brute([](Point const &p) { return p.first == 3 && p.second != 1; }));
+  EXPECT_EQ(collect(db.all() - db.equal<1>(0)), brute([](Point const &p) { return p.second != 0; }));
+}
+
+TEST(Spatial, Point) {
+  CQL::Table<SpatialPoint> db;
+  std::vector<SpatialPoint const *> points;
+  std::mt19937 rng{ 5 };
+
+  auto coord = [&] { return static_cast<int>(rng() % 2001) - 1000; };
+
+  for (int i = 0; i < 4000; ++i) {
+    if (points.empty() || rng() % 4) {
+      points.emplace_back(db.emplace(coord(), coord()));
+    }
+    else if (rng() % 2) {
+      auto const pos = rng() % points.size();
+      db.erase(points[pos]);
+      points.erase(points.begin() + pos);
+    }
+    else if (rng() % 2) {
+      db.update<0>(points[rng() % points.size()], coord());
+    }
+    else {
+      db.update<1>(points[rng() % points.size()], coord());
+    }
+  }
+
+  // Erasing through an iterator has to leave the spatial index as well
+  for (auto it = db.begin(); it != db.end();) {
+    if ((*it).first % 7 == 0) {
+      points.erase(std::find(points.begin(), points.end(), &*it));
+      it = db.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+
+  auto collect = [](auto &&expr) {
+    std::vector<SpatialPoint const *> ret;
+    expr >>= [&](SpatialPoint const &p) { ret.emplace_back(&p); };
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  };
+
+  for (int q = 0; q < 50; ++q) {
+    auto x0 = coord(), x1 = coord(), y0 = coord(), y1 = coord();
+    if (x1 < x0) std::swap(x0, x1);
+    if (y1 < y0) std::swap(y0, y1);
+
+    std::vector<SpatialPoint const *> ans;
+    std::copy_if(points.begin(), points.end(), std::back_inserter(ans), [&](SpatialPoint const *p) {
+      return x0 <= p->first && p->first <= x1 && y0 <= p->second && p->second <= y1;
+    });
+    std::sort(ans.begin(), ans.end());
+    EXPECT_EQ(collect(db.box(x0, y0, x1, y1)), ans);
+    EXPECT_EQ(collect(db.box(x0, y0, x1, y1) && db.range<1>(y0, y1)), ans);
+
+    ans.clear();
+    std::copy_if(points.begin(), points.end(), std::back_inserter(ans), [&](SpatialPoint const *p) {
+      return p->first < x0 || x1 < p->first || p->second < y0 || y1 < p->second;
+    });
+    std::sort(ans.begin(), ans.end());
+    EXPECT_EQ(collect(!db.box(x0, y0, x1, y1)), ans);
+  }
+
+  auto dist = [](SpatialPoint const *p, double x, double y) {
+    return (p->first - x) * (p->first - x) + (p->second - y) * (p->second - y);
+  };
+
+  for (int q = 0; q < 50; ++q) {
+    double const x = coord() * 1.5, y = coord() * 0.5;
+    std::size_t const k = rng() % 20;
+
+    std::vector<double> found, ans;
+    db.nearest(x, y, k) >>= [&](SpatialPoint const &p) { found.emplace_back(dist(&p, x, y)); };
+    for (auto p : points) {
+      ans.emplace_back(dist(p, x, y));
+    }
+    std::sort(ans.begin(), ans.end());
+    ans.resize(k);
+    EXPECT_EQ(found, ans);
+  }
+
+  EXPECT_EQ(db.nearest(0, 0, points.size() + 5).count(), points.size());
+  db.clear();
+  EXPECT_EQ(collect(db.box(-1000, -1000, 1000, 1000)), std::vector<SpatialPoint const *>{});
+  EXPECT_EQ(db.nearest(0, 0, 3).count(), 0);
+}
+
+TEST(NearestFractional, Point) {
+  CQL::Table<std::pair<double, double>> db;
+  std::vector<std::pair<double, double> const *> points;
+  std::mt19937 rng{ 7 };
+
+  auto coord = [&] { return static_cast<double>(rng() % 2001) / 1000 - 1; };
+
+  points.emplace_back(db.emplace(0.3, 0.0));
+  points.emplace_back(db.emplace(0.5, 0.5));
+  EXPECT_EQ(db.nearest(0.0, 0.0, 1).count(), 1);
+  EXPECT_EQ(db.nearest(0.0, 0.0, 2).count(), 2);
+
+  for (int i = 0; i < 500; ++i) {
+    points.emplace_back(db.emplace(coord(), coord()));
+  }
+
+  auto dist = [](std::pair<double, double> const &p, double x, double y) {
+    return (p.first - x) * (p.first - x) + (p.second - y) * (p.second - y);
+  };
+
+  for (int q = 0; q < 50; ++q) {
+    double const x = coord(), y = coord();
+    std::size_t const k = rng() % 20;
+
+    std::vector<double> found, ans;
+    db.nearest(x, y, k) >>= [&](auto const &p) { found.emplace_back(dist(p, x, y)); };
+    for (auto p : points) {
+      ans.emplace_back(dist(*p, x, y));
+    }
+    std::sort(ans.begin(), ans.end());
+    ans.resize(k);
+    EXPECT_EQ(found, ans);
+  }
+}
@@ -3,6 +3,94 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <sstream>
+#include <random>
+#include <memory>
+#include <map>
+#include <set>
+
+// A SimpleUser that a test can give its own customizations, without
+// changing the indexes every other SimpleUser table gets
+template<typename Tag>
+struct TaggedUser : SimpleUser {
+  using SimpleUser::SimpleUser;
+};
+
+template<typename Tag> struct std::tuple_size<TaggedUser<Tag>> : std::tuple_size<SimpleUser> { };
+template<std::size_t Ind, typename Tag> struct std::tuple_element<Ind, TaggedUser<Tag>> : std::tuple_element<Ind, SimpleUser> { };
+
+// Ages in an order statistic index
+using RankedUser = TaggedUser<struct Ranked>;
+
+// Names in a radix tree
+using RadixUser = TaggedUser<struct Radix>;
+
+// Ids and names behind bloom filters
+using BloomUser = TaggedUser<struct Bloom>;
+
+namespace CQL::Custom {
+  template<>
+  struct Unique<RankedUser, 0> {
+    constexpr Uniqueness operator()() const {
+      return Uniqueness::EnforceUnique;
+    }
+  };
+
+  template<>
+  struct Index<RankedUser, 2> {
+    constexpr Indexing operator()() const {
+      return Indexing::OrderStatistic;
+    }
+  };
+
+  template<>
+  struct DefaultLookup<RankedUser> {
+    constexpr std::size_t operator()() const { return 0; }
+  };
+
+  template<>
+  struct Unique<RadixUser, 0> {
+    constexpr Uniqueness operator()() const {
+      return Uniqueness::EnforceUnique;
+    }
+  };
+
+  template<>
+  struct Index<RadixUser, 1> {
+    constexpr Indexing operator()() const {
+      return Indexing::Radix;
+    }
+  };
+
+  template<>
+  struct DefaultLookup<RadixUser> {
+    constexpr std::size_t operator()() const { return 0; }
+  };
+
+  template<>
+  struct Unique<BloomUser, 0> {
+    constexpr Uniqueness operator()() const {
+      return Uniqueness::EnforceUnique;
+    }
+  };
+
+  template<>
+  struct Bloom<BloomUser, 0> {
+    constexpr bool operator()() const { return true; }
+  };
+
+  template<>
+  struct Bloom<BloomUser, 1> {
+    constexpr bool operator()() const { return true; }
+  };
+
+  template<>
+  struct DefaultLookup<BloomUser> {
+    constexpr std::size_t operator()() const { return 0; }
+  };
+}
+
 TEST(Emplace, SimpleUser) {
   CQL::Table<SimpleUser> db;
   auto a = db.emplace("Alice", 5);
@@ -207,3 +295,884 @@ TEST(TableSerializationToVector, SimpleUser) {
     EXPECT_TRUE(result[i].operator==(v[i]));
   }
 }
+
+TEST(Nth, SimpleUser) {
+  CQL::Table<RankedUser> db;
+
+  for (int i = 0; i < 100; ++i) {
+    db.emplace("User", (i * 37) % 100);
+  }
+
+  for (std::size_t k = 0; k < 100; ++k) {
+    auto const e = db.nth<2>(k);
+    EXPECT_NE(e, nullptr);
+    EXPECT_EQ(std::get<2>(*e), static_cast<int>(k));
+  }
+
+  EXPECT_EQ(db.nth<2>(100), nullptr);
+}
+
+TEST(Rank, SimpleUser) {
+  CQL::Table<RankedUser> db;
+
+  db.emplace("Alice", 5);
+  db.emplace("Bob", 55);
+  db.emplace("Chris", 8);
+  db.emplace("Daniel", 8);
+
+  EXPECT_EQ(db.rank<2>(0), 0);
+  EXPECT_EQ(db.rank<2>(5), 0);
+  EXPECT_EQ(db.rank<2>(8), 1);
+  EXPECT_EQ(db.rank<2>(9), 3);
+  EXPECT_EQ(db.rank<2>(100), 4);
+}
+
+TEST(Percentile, SimpleUser) {
+  CQL::Table<RankedUser> db;
+
+  EXPECT_EQ(db.percentile<2>(0.5), nullptr);
+
+  for (int i = 1; i <= 101; ++i) {
+    db.emplace("User", i);
+  }
+
+  EXPECT_EQ(std::get<2>(*db.percentile<2>(0.0)), 1);
+  EXPECT_EQ(std::get<2>(*db.percentile<2>(0.5)), 51);
+  EXPECT_EQ(std::get<2>(*db.percentile<2>(0.9)), 91);
+  EXPECT_EQ(std::get<2>(*db.percentile<2>(1.0)), 101);
+}
+
+TEST(IteratorAdvance, SimpleUser) {
+  CQL::Table<RankedUser> db;
+
+  for (int i = 0; i < 1000; ++i) {
+    db.emplace("User", i);
+  }
+
+  auto it = db.vbegin<2>() + 500;
+  EXPECT_EQ(std::get<2>(*it), 500);
+
+  it += 250;
+  EXPECT_EQ(std::get<2>(*it), 750);
+
+  it -= 700;
+  EXPECT_EQ(std::get<2>(*it), 50);
+
+  EXPECT_EQ(db.vbegin<2>() + 1000, db.vend<2>());
+  EXPECT_EQ(std::get<2>(*(db.rvbegin<2>() + 10)), 989);
+}
+
+TEST(NthAfterErase, SimpleUser) {
+  CQL::Table<RankedUser> db;
+
+  std::vector<RankedUser const *> users;
+  for (int i = 0; i < 10; ++i) {
+    users.emplace_back(db.emplace("User", i));
+  }
+
+  db.erase(users[3]);
+  db.update<2>(users[5], 42);
+
+  std::vector<int> ages;
+  for (std::size_t k = 0; k < db.size(); ++k) {
+    ages.emplace_back(std::get<2>(*db.nth<2>(k)));
+  }
+
+  std::vector<int> const ans{ 0, 1, 2, 4, 6, 7, 8, 9, 42 };
+
+  EXPECT_EQ(ages, ans);
+  EXPECT_EQ(db.rank<2>(42), 8);
+}
+
+TEST(GroupBy, SimpleUser) {
+  CQL::Table<SimpleUser> db;
+
+  db.emplace("Alice", 30);
+  db.emplace("Bob", 20);
+  db.emplace("Chris", 30);
+  db.emplace("Daniel", 40);
+  db.emplace("Erik", 20);
+  db.emplace("Fiona", 30);
+
+  std::vector<std::pair<int, std::size_t>> groups;
+
+  db.all().groupBy<2>(CQL::Count{}) >>= [&](int age, std::size_t count) {
+    groups.emplace_back(age, count);
+  };
+
+  std::vector<std::pair<int, std::size_t>> const ans{ { 20, 2 }, { 30, 3 }, { 40, 1 } };
+
+  EXPECT_EQ(groups, ans);
+}
+
+TEST(GroupByHashed, SimpleUser) {
+  CQL::Table<SimpleUser> db;
+
+  db.emplace(0, "Alice", 30);
+  db.emplace(1, "Bob", 20);
+  db.emplace(2, "Alice", 50);
+  db.emplace(3, "Daniel", 40);
+  db.emplace(4, "Bob", 10);
+
+  std::vector<std::tuple<std::string, std::size_t, int, int, double>> groups;
+
+  db.range<0>(0, 3).groupBy<1>(CQL::Count{}, CQL::Min<2>{}, CQL::Max<2>{}, CQL::Avg<2>{})
+    >>= [&](std::string const &name, std::size_t count, int min, int max, double avg) {
+    groups.emplace_back(name, count, min, max, avg);
+  };
+
+  std::sort(groups.begin(), groups.end());
+
+  std::vector<std::tuple<std::string, std::size_t, int, int, double>> const ans{
+    { "Alice", 2, 30, 50, 40.0 }, { "Bob", 1, 20, 20, 20.0 }, { "Daniel", 1, 40, 40, 40.0 }
+  };
+
+  EXPECT_EQ(groups, ans);
+}
+
+TEST(Join, SimpleUser) {
+  CQL::Table<SimpleUser> users;
+  CQL::Table<std::tuple<int, int>> orders; // User id, amount
+
+  users.emplace(0, "Alice", 30);
+  users.emplace(1, "Bob", 20);
+  users.emplace(2, "Chris", 40);
+
+  orders.emplace(0, 100);
+  orders.emplace(2, 5);
+  orders.emplace(0, 7);
+  orders.emplace(7, 1);
+
+  using Row = std::tuple<std::string, int>;
+  std::vector<Row> const ans{ { "Alice", 7 }, { "Alice", 100 }, { "Chris", 5 } };
+
+  auto const check = [&](auto &&join) {
+    std::vector<Row> rows;
+    join >>= [&](SimpleUser const &user, std::tuple<int, int> const &order) {
+      rows.emplace_back(user.name, std::get<1>(order));
+    };
+    std::sort(rows.begin(), rows.end());
+    EXPECT_EQ(rows, ans);
+  };
+
+  check(CQL::join<0, 0>(users.all(), orders));
+  check(CQL::join<0, 0>(users.range<2>(0, 100), orders));
+  check(CQL::join<0, 0, CQL::JoinStrategy::Hash>(users.all(), orders));
+  check(CQL::join<0, 0, CQL::JoinStrategy::IndexNestedLoop>(users.all(), orders));
+
+  std::vector<std::string> names;
+  CQL::join<0, 0>(orders.range<1>(50, 1000), users) >>= [&](auto const &, SimpleUser const &user) {
+    names.emplace_back(user.name);
+  };
+
+  EXPECT_EQ(names, std::vector<std::string>{ "Alice" });
+
+  for (int i = 3; i < 100; ++i) {
+    orders.emplace(i, i);
+  }
+  users.emplace(50, "Daniel", 10);
+  users.emplace(99, "Erik", 10);
+
+  std::vector<int> amounts;
+  CQL::join<0, 0, CQL::JoinStrategy::Merge>(users.range<0>(40, 100), orders) >>= [&](auto const &, auto const &order) {
+    amounts.emplace_back(std::get<1>(order));
+  };
+
+  EXPECT_EQ(amounts, (std::vector<int>{ 50, 99 }));
+}
+
+TEST(Prefix, SimpleUser) {
+  CQL::Table<RadixUser> db;
+  for (auto name : { "Al", "Alice", "Alfred", "Alice", "Bob", "Albert", "A", "Ali", "Bo", "" }) {
+    db.emplace(name, 20);
+  }
+
+  std::vector<std::string> names;
+  db.prefix<1>("Al") >>= [&](RadixUser const &user) {
+    names.emplace_back(user.name);
+  };
+
+  EXPECT_EQ(names, (std::vector<std::string>{ "Al", "Albert", "Alfred", "Ali", "Alice", "Alice" }));
+
+  EXPECT_EQ(db.lookup<1>(std::string_view{ "Alfred" })->name, "Alfred");
+  EXPECT_EQ(db.lookup<1>(std::string_view{ "Alf" }), nullptr);
+
+  std::size_t count = 0;
+  db.prefix<1>("Alix") >>= [&](auto const &) { ++count; };
+  db.prefix<1>("C") >>= [&](auto const &) { ++count; };
+  EXPECT_EQ(count, 0);
+
+  db.prefix<1>("") >>= [&](auto const &) { ++count; };
+  EXPECT_EQ(count, db.size());
+
+  names.clear();
+  db.prefix<1>("B") && db.pred([](RadixUser const &user) { return user.name.size() > 2; }) >>= [&](RadixUser const &user) {
+    names.emplace_back(user.name);
+  };
+  EXPECT_EQ(names, std::vector<std::string>{ "Bob" });
+}
+
+TEST(RadixIndex, SimpleUser) {
+  CQL::Table<RadixUser> db;
+  std::multiset<std::string> ans;
+  std::vector<RadixUser const *> users;
+
+  std::mt19937 rng{ 1 };
+  auto randomName = [&]() {
+    std::string name;
+    for (auto len = rng() % 6; len--;) {
+      name += "abc\xff"[rng() % 4];
+    }
+    return name;
+  };
+
+  for (int i = 0; i < 2000; ++i) {
+    if (users.empty() || rng() % 3) {
+      auto name = randomName();
+      ans.emplace(name);
+      users.emplace_back(db.emplace(std::string{ name }, i));
+    }
+    else {
+      auto const pos = rng() % users.size();
+      ans.erase(ans.find(users[pos]->name));
+      db.erase(users[pos]);
+      users.erase(users.begin() + pos);
+    }
+
+    if (i % 100 == 0) {
+      std::vector<std::string> names;
+      for (auto it = db.vbegin<1>(); it != db.vend<1>(); ++it) {
+        names.emplace_back((*it).name);
+      }
+      EXPECT_EQ(names, std::vector<std::string>(ans.begin(), ans.end()));
+
+      auto const lo = randomName(), hi = randomName();
+      std::size_t inRange = 0;
+      db.range<1>(lo, hi) >>= [&](auto const &) { ++inRange; };
+      auto const expected = hi < lo ? 0 : std::distance(ans.lower_bound(lo), ans.upper_bound(hi));
+      EXPECT_EQ(inRange, static_cast<std::size_t>(expected));
+    }
+  }
+
+  std::vector<std::string> reversed;
+  for (auto it = db.rvbegin<1>(); it != db.rvend<1>(); ++it) {
+    reversed.emplace_back((*it).name);
+  }
+  EXPECT_EQ(reversed, std::vector<std::string>(ans.rbegin(), ans.rend()));
+
+  auto const full = db.memoryUsage().parts[1].index;
+  for (auto user : users) {
+    db.erase(user);
+  }
+  // The radix tree keeps its root node
+  EXPECT_GT(db.memoryUsage().parts[1].index, 0u);
+  EXPECT_LT(db.memoryUsage().parts[1].index, full);
+}
+
+TEST(BloomLookup, SimpleUser) {
+  CQL::Table<BloomUser> db;
+  EXPECT_GT(db.memoryUsage().parts[0].bloom, 0u);
+  EXPECT_EQ(db.memoryUsage().parts[2].bloom, 0u);
+
+  std::vector<BloomUser const *> users;
+  for (int i = 0; i < 1000; ++i) {
+    users.emplace_back(db.emplace(i, "User" + std::to_string(i), i % 90));
+  }
+
+  for (int i = 0; i < 2000; ++i) {
+    EXPECT_EQ(db.lookup<0>(i) != nullptr, i < 1000);
+    EXPECT_EQ(db.lookup<1>("User" + std::to_string(i)) != nullptr, i < 1000);
+  }
+
+  // Enough erases to make the filters rebuild themselves, half of them
+  // through an iterator
+  for (int i = 0; i < 500; i += 2) {
+    db.erase(users[i]);
+  }
+  for (auto it = db.begin(); it != db.end();) {
+    if ((*it).id % 2 == 0) {
+      it = db.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+  db.update<1>(users[1], "Renamed");
+
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(db.lookup<0>(i) != nullptr, i % 2 == 1);
+    EXPECT_EQ(db.lookup<1>(std::string_view{ "User" + std::to_string(i) }) != nullptr, i % 2 == 1 && i != 1);
+  }
+  EXPECT_EQ(db.lookup<1>("Renamed"), users[1]);
+
+  // The filter on the id keeps rejecting duplicates without false negatives
+  EXPECT_EQ(db.emplace(3, "Duplicate", 1), nullptr);
+  EXPECT_NE(db.emplace(4, "Reused", 1), nullptr);
+
+  db.clear();
+  EXPECT_EQ(db.lookup<0>(3), nullptr);
+  EXPECT_NE(db.emplace(3, "Again", 1), nullptr);
+  EXPECT_NE(db.lookup<0>(3), nullptr);
+}
+
+TEST(Views, SimpleUser) {
+  CQL::Table<SimpleUser> db;
+  std::vector<SimpleUser const *> users;
+  std::vector<std::pair<CQL::Change, int>> changes;
+  std::mt19937 rng{ 11 };
+
+  auto const adult = [](SimpleUser const &u) { return u.age >= 18; };
+  auto const adults = CQL::filterView(db, adult);
+  auto const adultCount = CQL::countView(db, adult);
+  auto const byName = CQL::groupByView<1>(db, adult, CQL::Count{}, CQL::Sum<2>{});
+  auto const id = db.subscribe([&](CQL::Change change, SimpleUser const &u, SimpleUser const *before) {
+    EXPECT_EQ(change == CQL::Change::Update, before != nullptr);
+    changes.emplace_back(change, u.id);
+  });
+
+  for (int i = 0; i < 2000; ++i) {
+    auto const op = rng() % 5;
+    if (users.empty() || op < 2) {
+      users.emplace_back(db.emplace(i, "User" + std::to_string(rng() % 10), static_cast<int>(rng() % 40)));
+    }
+    else if (op == 2) {
+      auto const pos = rng() % users.size();
+      db.erase(users[pos]);
+      users.erase(users.begin() + pos);
+    }
+    else if (op == 3) {
+      db.update<2>(users[rng() % users.size()], static_cast<int>(rng() % 40));
+    }
+    else {
+      std::string name = "User" + std::to_string(rng() % 10);
+      db.swap<1>(users[rng() % users.size()], name);
+    }
+  }
+
+  // Erasing through an iterator is seen by the views as well
+  std::size_t erasedThrough = 0;
+  for (auto it = db.begin(); it != db.end();) {
+    if ((*it).id % 5 == 0) {
+      users.erase(std::find(users.begin(), users.end(), &*it));
+      it = db.erase(it);
+      ++erasedThrough;
+    }
+    else {
+      ++it;
+    }
+  }
+  EXPECT_NE(erasedThrough, 0u);
+
+  std::size_t expectedCount = 0;
+  std::map<std::string, std::pair<std::size_t, int>> expectedGroups;
+  for (auto u : users) {
+    EXPECT_EQ(adults.contains(u), adult(*u));
+    if (adult(*u)) {
+      ++expectedCount;
+      auto &group = expectedGroups[u->name];
+      ++group.first;
+      group.second += u->age;
+    }
+  }
+  EXPECT_EQ(adults.size(), expectedCount);
+  EXPECT_EQ(adultCount.count(), expectedCount);
+
+  std::map<std::string, std::pair<std::size_t, int>> groups;
+  byName >>= [&](std::string const &name, std::size_t count, int sum) {
+    groups[name] = { count, sum };
+  };
+  EXPECT_EQ(groups, expectedGroups);
+  EXPECT_EQ(changes.size(), 2000u + erasedThrough);
+
+  db.unsubscribe(id);
+  db.clear();
+  EXPECT_EQ(changes.size(), 2000u + erasedThrough);
+  EXPECT_EQ(adults.size(), 0u);
+  EXPECT_EQ(adultCount.count(), 0u);
+  EXPECT_EQ(byName.size(), 0u);
+}
+
+TEST(SubscribeFromListener, SimpleUser) {
+  CQL::Table<SimpleUser> db;
+  std::vector<std::string> calls;
+
+  // A one-shot listener, unsubscribing itself
+  std::size_t once = 0;
+  once = db.subscribe([&](CQL::Change, SimpleUser const &u, SimpleUser const *) {
+    calls.emplace_back("once " + u.name);
+    db.unsubscribe(once);
+  });
+
+  // A listener subscribing another, which only hears of later changes
+  bool subscribed = false;
+  db.subscribe([&](CQL::Change, SimpleUser const &u, SimpleUser const *) {
+    calls.emplace_back("first " + u.name);
+    if (!subscribed) {
+      subscribed = true;
+      db.subscribe([&](CQL::Change, SimpleUser const &u, SimpleUser const *) {
+        calls.emplace_back("later " + u.name);
+      });
+    }
+  });
+
+  // A view dropped by a listener called before it
+  std::unique_ptr<CQL::FilterView<SimpleUser, bool (*)(SimpleUser const &)>> adults;
+  std::size_t dropper = 0;
+  dropper = db.subscribe([&](CQL::Change, SimpleUser const &, SimpleUser const *) {
+    adults.reset();
+    db.unsubscribe(dropper);
+  });
+  adults = std::make_unique<CQL::FilterView<SimpleUser, bool (*)(SimpleUser const &)>>(db,
+    [](SimpleUser const &u) { return u.age >= 18; });
+
+  db.emplace(0, "A", 20);
+  db.emplace(1, "B", 30);
+  EXPECT_EQ(calls, (std::vector<std::string>{ "once A", "first A", "first B", "later B" }));
+  EXPECT_EQ(adults, nullptr);
+}
+
+TEST(UpdateRow, SimpleUser) {
+  CQL::Table<SimpleUser> db;
+  auto const alice = db.emplace(1, "Alice", 30);
+  auto const bob = db.emplace(2, "Bob", 40);
+  std::size_t updates = 0;
+  db.subscribe([&](CQL::Change change, SimpleUser const &, SimpleUser const *) {
+    updates += change == CQL::Change::Update;
+  });
+
+  // Taking Bob's id fails as a whole
+  EXPECT_FALSE(db.updateRow(alice, SimpleUser(2, "Alicia", 31)));
+  EXPECT_EQ(*alice, SimpleUser(1, "Alice", 30));
+  EXPECT_EQ(updates, 0u);
+
+  EXPECT_TRUE(db.updateRow(alice, SimpleUser(3, "Alicia", 31)));
+  EXPECT_EQ(db.lookup<0>(3), alice);
+  EXPECT_EQ(db.lookup<0>(1), nullptr);
+  EXPECT_EQ(db.lookup<1>("Alicia"), alice);
+  EXPECT_EQ(db.lookup<1>("Alice"), nullptr);
+  EXPECT_EQ(db.rank<2>(40), 1u);
+
+  EXPECT_TRUE(db.modify(bob, [](SimpleUser &u) { u.age = 20; u.name = "Bobby"; }));
+  EXPECT_EQ(db.lookup<1>("Bobby"), bob);
+  EXPECT_EQ(db.nth<2>(0), bob);
+  EXPECT_EQ(db.lookup<0>(2), bob);
+  EXPECT_EQ(updates, 2u);
+
+  // Keeping a unique value doesn't count as taking it
+  EXPECT_TRUE(db.modify(bob, [](SimpleUser &u) { u.age = 21; }));
+  EXPECT_TRUE(db.update<0>(bob, 2));
+  EXPECT_FALSE(db.update<0>(bob, 3));
+  EXPECT_TRUE(db.update<0>(bob, 4));
+  EXPECT_EQ(db.lookup<0>(4), bob);
+
+  std::vector<std::string> names;
+  for (auto it = db.vbegin<1>(); it != db.vend<1>(); ++it) {
+    names.emplace_back((*it).name);
+  }
+  EXPECT_EQ(names, (std::vector<std::string>{ "Alicia", "Bobby" }));
+  EXPECT_EQ(db.size(), 2u);
+}
+
+TEST(Transaction, SimpleUser) {
+  CQL::Table<SimpleUser> db;
+  auto const alice = db.emplace(1, "Alice", 30);
+  auto const bob = db.emplace(2, "Bob", 40);
+  std::map<CQL::Change, int> changes;
+  db.subscribe([&](CQL::Change change, SimpleUser const &, SimpleUser const *) {
+    ++changes[change];
+  });
+
+  {
+    auto tx = db.transaction();
+    tx.emplace(5, "Eve", 25);
+    tx.emplace(3, "Chris", 50);
+    tx.update<2>(alice, 31);
+    EXPECT_EQ(tx.size(), 3u);
+    EXPECT_TRUE(tx.commit());
+    EXPECT_EQ(tx.size(), 0u);
+  }
+  EXPECT_EQ(db.size(), 4u);
+  EXPECT_EQ(db.lookup<0>(5)->name, "Eve");
+  EXPECT_EQ(db.lookup<1>("Chris")->id, 3);
+  EXPECT_EQ(alice->age, 31);
+  EXPECT_EQ(db.nth<2>(0)->name, "Eve");
+  EXPECT_EQ(db.rank<2>(50), 3u);
+  EXPECT_EQ(changes[CQL::Change::Insert], 2);
+  EXPECT_EQ(changes[CQL::Change::Update], 1);
+
+  // Clashing with a row the batch doesn't touch applies nothing
+  {
+    auto tx = db.transaction();
+    tx.erase(bob);
+    tx.emplace(6, "Frank", 60);
+    tx.emplace(1, "Alicia", 20);
+    EXPECT_FALSE(tx.commit());
+  }
+  EXPECT_EQ(db.size(), 4u);
+  EXPECT_EQ(db.lookup<0>(2), bob);
+  EXPECT_EQ(db.lookup<0>(6), nullptr);
+
+  // And so does clashing within the batch
+  {
+    auto tx = db.transaction();
+    tx.emplace(7, "Gina", 20);
+    tx.update<0>(bob, 7);
+    EXPECT_FALSE(tx.commit());
+  }
+  EXPECT_EQ(bob->id, 2);
+
+  // Rows may trade unique values, and erased rows free theirs
+  {
+    auto tx = db.transaction();
+    tx.update<0>(alice, 2);
+    tx.update<0>(bob, 1);
+    tx.erase(db.lookup<0>(5));
+    tx.emplace(5, "Eva", 26);
+    EXPECT_TRUE(tx.commit());
+  }
+  EXPECT_EQ(db.lookup<0>(2), alice);
+  EXPECT_EQ(db.lookup<0>(1), bob);
+  EXPECT_EQ(db.lookup<0>(5)->name, "Eva");
+  EXPECT_EQ(db.lookup<1>("Eve"), nullptr);
+  EXPECT_EQ(changes[CQL::Change::Erase], 1);
+
+  // Uncommitted writes are dropped
+  {
+    auto tx = db.transaction();
+    tx.erase(alice);
+    tx.emplace(8, "Hank", 80);
+  }
+  {
+    auto tx = db.transaction();
+    tx.update<1>(bob, "Robert");
+    tx.rollback();
+    EXPECT_TRUE(tx.commit());
+  }
+  EXPECT_EQ(db.size(), 4u);
+  EXPECT_EQ(bob->name, "Bob");
+
+  std::vector<int> ids;
+  for (auto &user : db) {
+    ids.emplace_back(user.id);
+  }
+  EXPECT_EQ(ids, (std::vector<int>{ 1, 2, 3, 5 }));
+}
+
+TEST(MemoryUsage, SimpleUser) {
+  CQL::Table<SimpleUser> db;
+  auto empty = db.memoryUsage();
+  EXPECT_EQ(empty.rows, 0u);
+  ASSERT_EQ(empty.parts.size(), 3u);
+  for (auto &part : empty.parts) {
+    EXPECT_EQ(part.index, 0u);
+    EXPECT_EQ(part.bloom, 0u);
+  }
+
+  std::vector<SimpleUser const *> users;
+  std::string const longName(100, 'x');
+  for (int i = 0; i < 100; ++i) {
+    users.emplace_back(db.emplace(i, longName + std::to_string(i), i % 10));
+  }
+
+  auto const usage = db.memoryUsage();
+  // Names this long are on the heap
+  EXPECT_GE(usage.rows, 100 * (sizeof(SimpleUser) + longName.size()));
+  // Part 0 is the default lookup, its set holds the rows
+  EXPECT_EQ(usage.defaultLookup, 0u);
+  EXPECT_GE(usage.parts[0].index, 100 * sizeof(std::unique_ptr<SimpleUser>));
+  EXPECT_EQ(usage.parts[0].index % 100, 0u);
+  EXPECT_GT(usage.parts[1].index, 0u);
+  EXPECT_GE(usage.parts[2].index, 100 * sizeof(SimpleUser *));
+  EXPECT_EQ(usage.total(), usage.rows + usage.other + usage.parts[0].index + usage.parts[1].index + usage.parts[2].index);
+
+  for (auto user : users) {
+    db.erase(user);
+  }
+  auto const erased = db.memoryUsage();
+  EXPECT_EQ(erased.rows, 0u);
+  EXPECT_EQ(erased.parts[0].index, 0u);
+  EXPECT_EQ(erased.parts[1].index, 0u);
+  EXPECT_EQ(erased.parts[2].index, 0u);
+}
+
+TEST(Profile, SimpleUser) {
+  CQL::Table<SimpleUser> db;
+  for (int i = 0; i < 100; ++i) {
+    db.emplace(i, "User" + std::to_string(i), i);
+  }
+
+  std::vector<int> ids;
+  auto const profile = db.profile((db.range<0>(0, 9) || db.range<2>(50, 60)) && db.pred([](SimpleUser const &u) {
+    return u.name.size() > 5;
+  }), [&](SimpleUser const &u) {
+    ids.emplace_back(u.id);
+  });
+  EXPECT_EQ(ids.size(), 11u);
+
+  EXPECT_EQ(profile.node, "FilteredRangeExpr");
+  EXPECT_EQ(profile.rowsIn, 21u);
+  EXPECT_EQ(profile.rowsOut, 11u);
+  ASSERT_EQ(profile.children.size(), 2u);
+
+  auto const &both = profile.children[0];
+  EXPECT_EQ(both.node, "RangeUnion");
+  EXPECT_EQ(both.rowsOut, 21u);
+  // Rows from the right are checked against the left range
+  EXPECT_EQ(both.predicateCalls, 11u);
+  ASSERT_EQ(both.children.size(), 2u);
+  EXPECT_EQ(both.children[0].node, "Range<0>");
+  EXPECT_EQ(both.children[0].indexEntries, 10u);
+  EXPECT_EQ(both.children[1].node, "Range<2>");
+  EXPECT_EQ(both.children[1].indexEntries, 11u);
+
+  auto const &filter = profile.children[1];
+  EXPECT_EQ(filter.node, "Predicate");
+  EXPECT_EQ(filter.predicateCalls, 21u);
+  EXPECT_EQ(filter.rowsOut, 11u);
+  EXPECT_LE(filter.time, profile.time);
+
+  auto const text = profile.toString();
+  EXPECT_NE(text.find("FilteredRangeExpr: 11 rows out of 21 in"), std::string::npos);
+  EXPECT_NE(text.find("    Range<2>: 11 rows out, 11 index entries"), std::string::npos);
+
+  // Conjunctions are profiled as the loop they run as, one child per operand
+  auto const even = db.pred([](SimpleUser const &u) { return u.id % 2 == 0; });
+  auto const narrowed = db.profile(db.range<0>(30, 60) && db.range<0>(20, 40) && even, [](SimpleUser const &) { });
+  EXPECT_EQ(narrowed.rowsIn, 11u);
+  EXPECT_EQ(narrowed.rowsOut, 6u);
+  ASSERT_EQ(narrowed.children.size(), 3u);
+  EXPECT_EQ(narrowed.children[0].node, "Range<0>");
+  EXPECT_EQ(narrowed.children[0].indexEntries, 11u);
+  EXPECT_EQ(narrowed.children[1].node, "Range<0>");
+  EXPECT_EQ(narrowed.children[1].predicateCalls, 0u);
+  EXPECT_EQ(narrowed.children[2].node, "Predicate");
+  EXPECT_EQ(narrowed.children[2].predicateCalls, 11u);
+
+  // An equality on a unique part drives the loop wherever it is written
+  auto const driven = db.profile(db.range<2>(0, 90) && db.equal<0>(42), [](SimpleUser const &) { });
+  EXPECT_EQ(driven.rowsOut, 1u);
+  ASSERT_EQ(driven.children.size(), 2u);
+  EXPECT_EQ(driven.children[0].indexEntries, 0u);
+  EXPECT_EQ(driven.children[0].predicateCalls, 1u);
+  EXPECT_EQ(driven.children[1].indexEntries, 1u);
+
+  auto const all = db.profile(db.all(), [](SimpleUser const &) { });
+  EXPECT_EQ(all.node, "EntireTable");
+  EXPECT_EQ(all.indexEntries, 100u);
+  EXPECT_TRUE(all.children.empty());
+}
+
+TEST(Conjunction, SimpleUser) {
+  CQL::Table<SimpleUser> db;
+  for (int i = 0; i < 100; ++i) {
+    db.emplace(i, "User" + std::to_string(i), i % 10);
+  }
+
+  std::size_t calls = 0;
+  auto const even = db.pred([&](SimpleUser const &u) {
+    ++calls;
+    return u.id % 2 == 0;
+  });
+
+  std::vector<int> ids;
+  auto const collect = [&](SimpleUser const &u) { ids.emplace_back(u.id); };
+
+  // Ranges over the same part narrow each other, so only ids 30 to 40 are read
+  db.range<0>(10, 40) && db.range<0>(30, 60) && even >>= collect;
+  EXPECT_EQ(ids, (std::vector<int>{ 30, 32, 34, 36, 38, 40 }));
+  EXPECT_EQ(calls, 11u);
+
+  // A single id drives the query, wherever it is in the conjunction
+  ids.clear();
+  calls = 0;
+  db.range<2>(0, 9) && even && db.range<0>(42, 42) >>= collect;
+  EXPECT_EQ(ids, std::vector<int>{ 42 });
+  EXPECT_EQ(calls, 1u);
+
+  ids.clear();
+  calls = 0;
+  db.range<0>(0, 10) && db.range<0>(20, 30) && even >>= collect;
+  EXPECT_TRUE(ids.empty());
+  EXPECT_EQ(calls, 0u);
+
+  ids.clear();
+  auto threes = db.range<2>(3, 3);
+  threes && db.range<0>(0, 49) >>= collect;
+  EXPECT_EQ(ids, (std::vector<int>{ 3, 13, 23, 33, 43 }));
+}
+
+TEST(Cursor, SimpleUser) {
+  CQL::Table<SimpleUser> db;
+  for (int i = 0; i < 100; ++i) {
+    db.emplace(i, "User" + std::to_string(i), i % 10);
+  }
+
+  std::vector<int> ids;
+  auto const collect = [&](SimpleUser const &u) { ids.emplace_back(u.id); };
+
+  // Walks ids 10 to 40 seven at a time, while the table changes in between
+  auto threes = db.cursor(db.range<0>(10, 40) && db.pred([](SimpleUser const &u) { return u.age == 3; }));
+  ASSERT_TRUE(threes.next(7, collect));
+  EXPECT_EQ(ids, std::vector<int>{ 13 });
+  db.erase(db.lookup<0>(23));
+  db.erase(db.lookup<0>(3));
+  db.emplace(3, "Behind", 3);
+  db.update<2>(db.lookup<0>(35), 3);
+
+  std::size_t steps = 1;
+  while (threes.next(7, collect)) {
+    ++steps;
+  }
+  EXPECT_EQ(ids, (std::vector<int>{ 13, 33, 35 }));
+  EXPECT_EQ(steps, 4u);
+  EXPECT_TRUE(threes.finished());
+  EXPECT_FALSE(threes.next(7, collect));
+
+  // Other queries walk the whole table
+  ids.clear();
+  auto all = db.cursor(db.range<2>(9, 9));
+  for (steps = 0; all.next(10, collect); ++steps);
+  EXPECT_EQ(ids.size(), 10u);
+  // 99 rows, the last of them in a step that runs out
+  EXPECT_EQ(steps, 9u);
+}
+
+#ifdef CQL_COROUTINES
+TEST(Batches, SimpleUser) {
+  CQL::Table<SimpleUser> db;
+  for (int i = 0; i < 4; ++i) {
+    db.emplace(i, "User" + std::to_string(i), i % 2);
+  }
+
+  std::vector<std::size_t> sizes;
+  for (auto &batch : db.batches(db.all(), 2)) {
+    sizes.emplace_back(batch.size());
+  }
+  EXPECT_EQ(sizes, (std::vector<std::size_t>{ 2, 2 }));
+
+  // Batches without a match are left out, and the table may change between
+  // two of them
+  std::vector<int> ids;
+  for (auto &batch : db.batches(db.range<0>(0, 3) && db.pred([](SimpleUser const &u) { return u.age == 0; }), 1)) {
+    ASSERT_EQ(batch.size(), 1u);
+    ids.emplace_back(batch[0]->id);
+    if (ids.size() == 1) {
+      db.erase(db.lookup<0>(2));
+      db.update<2>(db.lookup<0>(3), 0);
+    }
+  }
+  EXPECT_EQ(ids, (std::vector<int>{ 0, 3 }));
+}
+#endif
+
+TEST(Checkpoint, SimpleUser) {
+  CQL::Table<SimpleUser> db;
+  for (int i = 0; i < 1000; ++i) {
+    db.emplace(i, "User" + std::to_string(i), i % 90);
+  }
+
+  auto contents = [](CQL::Table<SimpleUser> const &table) {
+    std::vector<SimpleUser> ret;
+    for (auto &user : table) {
+      ret.emplace_back(user);
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  };
+
+  CQL::Checkpointer<SimpleUser> checkpoints{ db };
+  std::stringstream base, first, second;
+  checkpoints.writeBase(base);
+  EXPECT_EQ(checkpoints.dirtyRows(), 0u);
+
+  db.update<2>(db.lookup<0>(3), 30);
+  db.erase(db.lookup<0>(4));
+  db.emplace(1000, "New", 1);
+  db.update<1>(db.lookup<0>(1000), std::string{ "Newer" });
+  // Moved to another id, which erases the old one
+  db.update<0>(db.lookup<0>(5), 2000);
+  EXPECT_EQ(checkpoints.dirtyRows(), 3u);
+  EXPECT_EQ(checkpoints.erasedRows(), 2u);
+  checkpoints.writeDelta(first);
+  EXPECT_LT(first.str().size() * 20, base.str().size());
+  auto const afterFirst = contents(db);
+
+  db.erase(db.lookup<0>(1000));
+  db.emplace(4, "Back", 4);
+  db.update<2>(db.lookup<0>(3), 31);
+  // Erasing through an iterator leaves a tombstone as well
+  auto seventh = db.begin() + 7;
+  db.erase(seventh);
+  EXPECT_EQ(checkpoints.erasedRows(), 2u);
+  checkpoints.writeDelta(second);
+
+  {
+    auto restored = CQL::deserialize<CQL::Table<SimpleUser>>(base);
+    base.seekg(0);
+    ASSERT_TRUE(CQL::applyDelta(restored, first));
+    first.seekg(0);
+    EXPECT_EQ(contents(restored), afterFirst);
+  }
+
+  std::stringstream compacted;
+  ASSERT_TRUE(CQL::compact<SimpleUser>(base, { &first, &second }, compacted));
+  auto const restored = CQL::deserialize<CQL::Table<SimpleUser>>(compacted);
+  EXPECT_EQ(contents(restored), contents(db));
+}
+
+TEST(ColumnTable, SimpleUser) {
+  using CQL::col;
+  CQL::ColumnTable<SimpleUser> db;
+  std::vector<CQL::ColumnTable<SimpleUser>::RowId> ids;
+  for (int i = 0; i < 100; ++i) {
+    ids.emplace_back(db.emplace(i, "User" + std::to_string(i), i % 50));
+  }
+  EXPECT_EQ(db.size(), 100u);
+  EXPECT_EQ(db.emplace(5, "Duplicate", 1), db.npos);
+
+  auto const found = db.lookup<1>("User42");
+  ASSERT_NE(found, db.npos);
+  auto const [id, name, age] = db.row(found);
+  EXPECT_EQ(id, 42);
+  EXPECT_EQ(name, "User42");
+  EXPECT_EQ(age, 42);
+  EXPECT_EQ(db.row(found).entry(), SimpleUser(42, "User42", 42));
+
+  std::multiset<int> ages;
+  db.range<2>(10, 12) >>= [&](CQL::ColumnRow<SimpleUser> const &row) {
+    ages.emplace(row.get<2>());
+  };
+  EXPECT_EQ(ages, (std::multiset<int>{ 10, 10, 11, 11, 12, 12 }));
+  EXPECT_EQ(db.where(col<2>() < 10 && col<0>() >= 50).count(), 10u);
+
+  // Erased rows drop out of every index and query, and their ids come back
+  for (int i = 0; i < 50; ++i) {
+    EXPECT_TRUE(db.erase(ids[static_cast<std::size_t>(i)]));
+  }
+  EXPECT_FALSE(db.erase(ids[0]));
+  EXPECT_FALSE(db.update<2>(ids[1], 77));
+  EXPECT_EQ(db.size(), 50u);
+  EXPECT_EQ(db.lookup<2>(77), db.npos);
+  EXPECT_EQ(db.lookup<0>(5), db.npos);
+  EXPECT_EQ(db.where(col<2>() < 10).count(), 10u);
+  auto const reused = db.emplace(5, "Again", 7);
+  EXPECT_LT(reused, 50u);
+  EXPECT_EQ(db.lookup<0>(5), reused);
+
+  EXPECT_TRUE(db.update<2>(reused, 99));
+  EXPECT_FALSE(db.update<0>(reused, 60));
+  EXPECT_EQ(db.lookup<2>(99), reused);
+
+  auto const [count, total, oldest] = db.aggregate(CQL::Count{}, CQL::Sum<2>{}, CQL::Max<2>{});
+  EXPECT_EQ(count, 51u);
+  EXPECT_EQ(total, 49 * 50 / 2 + 99);
+  EXPECT_EQ(oldest, 99);
+
+  int sum = 0;
+  db.forEachValue<0>([&](int value) { sum += value; });
+  EXPECT_EQ(sum, (50 + 99) * 50 / 2 + 5);
+
+  std::size_t rows = 0;
+  db.all() >>= [&](CQL::ColumnRow<SimpleUser> const &) { ++rows; };
+  EXPECT_EQ(rows, 51u);
+}
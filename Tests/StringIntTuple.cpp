@@ -1,7 +1,57 @@
+#include "CQL/Custom.hpp"
+
+#include <string>
+#include <tuple>
+
+// name, last seen, active
+using Session = std::tuple<std::string, int, bool>;
+
+// id, name
+using Player = std::tuple<int, std::string>;
+
+// key, value, expires at
+using CacheEntry = std::tuple<std::string, std::string, long>;
+
+namespace CQL::Custom {
+  template<>
+  struct IndexFilter<Session, 1> {
+    bool operator()(Session const &session) const {
+      return std::get<2>(session);
+    }
+  };
+
+  template<>
+  struct Unique<Player, 0> {
+    constexpr Uniqueness operator()() const {
+      return Uniqueness::EnforceUnique;
+    }
+  };
+
+  template<>
+  struct Metrics<Player> {
+    constexpr bool operator()() const { return true; }
+  };
+
+  template<>
+  struct Unique<CacheEntry, 0> {
+    constexpr Uniqueness operator()() const {
+      return Uniqueness::EnforceUnique;
+    }
+  };
+
+  template<>
+  struct Expiry<CacheEntry> {
+    constexpr std::size_t operator()() const { return 2; }
+  };
+}
+
 #include "CQL.hpp"
 
 #include "gtest/gtest.h"
 
+#include <atomic>
+#include <thread>
+
 TEST(Lookup, StringIntTuple) {
   CQL::Table<std::tuple<std::string, int>> db;
   db.emplace("Alice", 5);
@@ -67,3 +117,267 @@ TEST(RangeEmpty, StringIntTuple) {
 
   EXPECT_EQ(names, ans);
 }
+
+TEST(In, StringIntTuple) {
+  CQL::Table<std::tuple<std::string, int>> db;
+
+  db.emplace("Alice", 5);
+  db.emplace("Bob", 55);
+  db.emplace("Bert", 78);
+  db.emplace("Bob", 33);
+
+  std::vector<int> ages;
+
+  db.in<0>("Bob", "Calle", "Alice") >>= [&](auto const &entry) {
+    ages.emplace_back(std::get<1>(entry));
+  };
+
+  std::sort(ages.begin(), ages.end());
+
+  std::vector<int> const ans{ 5, 33, 55 };
+
+  EXPECT_EQ(ages, ans);
+}
+
+TEST(Prefix, StringIntTuple) {
+  CQL::Table<std::tuple<std::string, int>> db;
+
+  db.emplace("Alice", 5);
+  db.emplace("Bob", 55);
+  db.emplace("Bert", 78);
+  db.emplace("Albert", 33);
+
+  std::vector<int> ages;
+  db.prefix<0>("Al") >>= [&](auto const &entry) {
+    ages.emplace_back(std::get<1>(entry));
+  };
+
+  std::vector<int> const ans{ 33, 5 };
+
+  EXPECT_EQ(ages, ans);
+}
+
+namespace {
+  struct Country;
+  using CountryTable = CQL::Table<std::tuple<CQL::DictString<Country>, int>>;
+}
+
+TEST(DictString, StringIntTuple) {
+  CountryTable db;
+
+  // Inserted out of order so the dictionary has to fit codes in between
+  for (auto country : { "SE", "US", "DE", "SE", "FI", "NO", "US", "DK", "SE", "AT" }) {
+    db.emplace(country, 0);
+  }
+
+  auto const se = db.lookup<0>("SE");
+  EXPECT_NE(se, nullptr);
+  EXPECT_EQ(std::get<0>(*se).str(), "SE");
+  EXPECT_EQ(db.lookup<0>(std::string_view{ "GB" }), nullptr);
+
+  std::vector<std::string> countries;
+  db.range<0>("DE", "NO") >>= [&](auto const &entry) {
+    countries.emplace_back(std::get<0>(entry).str());
+  };
+
+  EXPECT_EQ(countries, (std::vector<std::string>{ "DE", "DK", "FI", "NO" }));
+
+  std::vector<std::pair<std::string, std::size_t>> groups;
+  db.all().groupBy<0>(CQL::Count{}) >>= [&](auto const &country, std::size_t count) {
+    groups.emplace_back(country.str(), count);
+  };
+  std::sort(groups.begin(), groups.end());
+
+  EXPECT_EQ(groups.front(), std::make_pair(std::string{ "AT" }, std::size_t{ 1 }));
+  EXPECT_EQ(groups.back(), std::make_pair(std::string{ "US" }, std::size_t{ 2 }));
+
+  CQL::DictString<Country> const a{ "A" }, b{ "B" }, ab{ "AB" };
+  EXPECT_LT(a, ab);
+  EXPECT_LT(ab, b);
+  EXPECT_EQ(a, "A");
+  EXPECT_EQ(a, CQL::DictString<Country>{ std::string{ "A" } });
+
+  // Always appending after the last string runs out of room between order
+  // keys, which has to keep the order intact
+  std::vector<CQL::DictString<Country>> codes;
+  for (int i = 0; i < 200; ++i) {
+    codes.emplace_back("Z" + std::to_string(1000 + i));
+  }
+  EXPECT_TRUE(std::is_sorted(codes.begin(), codes.end()));
+  EXPECT_LT(b, codes.front());
+}
+
+TEST(DictStringSerialization, StringIntTuple) {
+  CountryTable db;
+  for (int i = 0; i < 100; ++i) {
+    db.emplace(i % 3 ? "Sweden" : "Finland", i);
+  }
+
+  std::stringstream ss;
+  CQL::serialize(ss, db);
+
+  // Each country name is only written the first time it shows up
+  EXPECT_LT(ss.str().size(), 100 * (sizeof(std::uint32_t) + sizeof(int)) + 100);
+
+  auto const result = CQL::deserialize<CountryTable>(ss);
+
+  EXPECT_EQ(result.size(), db.size());
+  std::size_t sweden = 0;
+  for (auto &entry : result) {
+    EXPECT_EQ(std::get<0>(entry), std::get<1>(entry) % 3 ? "Sweden" : "Finland");
+    sweden += std::get<0>(entry) == "Sweden";
+  }
+  EXPECT_EQ(sweden, 66);
+}
+
+TEST(PartialIndex, StringIntTuple) {
+  CQL::Table<Session> db;
+  std::vector<Session const *> sessions;
+  for (int i = 0; i < 100; ++i) {
+    sessions.emplace_back(db.emplace(std::to_string(i), i % 10, i % 3 == 0));
+  }
+
+  auto collect = [](auto &&expr) {
+    std::vector<std::string> ret;
+    expr >>= [&](Session const &s) { ret.emplace_back(std::get<0>(s)); };
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  };
+
+  auto brute = [&](auto &&pred) {
+    std::vector<std::string> ret;
+    for (auto &s : db) {
+      if (pred(s)) {
+        ret.emplace_back(std::get<0>(s));
+      }
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  };
+
+  auto check = [&] {
+    EXPECT_EQ(collect(db.partial<1>()), brute([](Session const &s) { return std::get<2>(s); }));
+    EXPECT_EQ(collect(db.partial<1>(2, 5)), brute([](Session const &s) {
+      return std::get<2>(s) && 2 <= std::get<1>(s) && std::get<1>(s) <= 5;
+    }));
+    EXPECT_EQ(collect(db.range<1>(2, 5)), brute([](Session const &s) { return 2 <= std::get<1>(s) && std::get<1>(s) <= 5; }));
+    EXPECT_EQ(collect(db.in<1>(1, 7)), brute([](Session const &s) { return std::get<1>(s) == 1 || std::get<1>(s) == 7; }));
+    EXPECT_EQ(collect(db.range<0>("2", "4") && db.partial<1>(0, 9)), brute([](Session const &s) {
+      return std::get<2>(s) && "2" <= std::get<0>(s) && std::get<0>(s) <= "4";
+    }));
+    EXPECT_EQ(collect(!db.partial<1>()), brute([](Session const &s) { return !std::get<2>(s); }));
+    // Ranges over a filtered index only hold the entries passing the filter
+    auto const outsidePartial = brute([](Session const &s) {
+      return !(std::get<2>(s) && 2 <= std::get<1>(s) && std::get<1>(s) <= 5);
+    });
+    EXPECT_EQ(collect(!db.partial<1>(2, 5)), outsidePartial);
+    EXPECT_EQ(collect(db.all() - db.partial<1>(2, 5)), outsidePartial);
+    EXPECT_EQ(collect(!db.range<1>(2, 5)), brute([](Session const &s) { return std::get<1>(s) < 2 || 5 < std::get<1>(s); }));
+    EXPECT_EQ(collect(!db.prefix<0>("2")), brute([](Session const &s) { return std::get<0>(s)[0] != '2'; }));
+
+    std::vector<int> seen;
+    for (auto it = db.vbegin<1>(); it != db.vend<1>(); ++it) {
+      EXPECT_TRUE(std::get<2>(*it));
+      seen.emplace_back(std::get<1>(*it));
+    }
+    EXPECT_TRUE(std::is_sorted(seen.begin(), seen.end()));
+  };
+
+  check();
+  EXPECT_EQ(db.lookup<1>(4), db.lookup<0>("4"));
+
+  db.update<2>(sessions[1], true);
+  db.update<2>(sessions[3], false);
+  db.update<1>(sessions[6], 42);
+  db.update<1>(sessions[7], 43);
+  db.erase(sessions[9]);
+  check();
+  EXPECT_EQ(collect(db.partial<1>(40, 50)), std::vector<std::string>{ "6" });
+  EXPECT_EQ(collect(db.range<1>(40, 50)), (std::vector<std::string>{ "6", "7" }));
+}
+
+TEST(Metrics, StringIntTuple) {
+  CQL::Table<Player> db;
+  std::atomic<bool> done{ false };
+  std::thread monitor([&]() {
+    while (!done) {
+      auto const metrics = db.metrics();
+      EXPECT_LE(metrics.emplaces.latency.count(), metrics.emplaces.count + 1);
+    }
+  });
+
+  for (int i = 0; i < 100; ++i) {
+    db.emplace(i, "player" + std::to_string(i));
+  }
+  EXPECT_EQ(db.emplace(5, "again"), nullptr);
+  done = true;
+  monitor.join();
+
+  EXPECT_NE(db.lookup<0>(42), nullptr);
+  EXPECT_EQ(db.lookup<0>(420), nullptr);
+  EXPECT_NE(db.lookup<1>("player7"), nullptr);
+
+  std::size_t found = 0;
+  db.range<0>(10, 19) >>= [&](Player const &) { ++found; };
+  EXPECT_EQ(found, 10u);
+
+  EXPECT_TRUE(db.update<1>(db.lookup<0>(3), "renamed"));
+  db.erase(db.lookup<0>(4));
+  db.extract(db.lookup<0>(6));
+  auto first = db.vbegin<0>();
+  db.erase(first);
+
+  auto const metrics = db.metrics();
+  EXPECT_EQ(metrics.emplaces.count, 101u);
+  EXPECT_EQ(metrics.emplaces.latency.count(), 101u);
+  EXPECT_GE(metrics.emplaces.latency.quantile(1), metrics.emplaces.latency.quantile(0.5));
+  EXPECT_EQ(metrics.rejectedInserts, 1u);
+  EXPECT_EQ(metrics.erases.count, 3u);
+  EXPECT_EQ(metrics.rows, 97u);
+
+  ASSERT_EQ(metrics.parts.size(), 2u);
+  EXPECT_EQ(metrics.parts[0].lookups.count, 5u);
+  EXPECT_EQ(metrics.parts[0].ranges.count, 1u);
+  EXPECT_EQ(metrics.parts[1].lookups.count, 1u);
+  EXPECT_EQ(metrics.parts[1].updates.count, 1u);
+  // A lookup in a tree of 100 entries takes a handful of comparisons
+  EXPECT_GE(metrics.parts[0].deepestLookup, 3u);
+  EXPECT_LE(metrics.parts[0].deepestLookup, 20u);
+  EXPECT_GE(metrics.parts[0].comparisons, metrics.parts[0].deepestLookup);
+
+  db.clear();
+  EXPECT_EQ(db.metrics().rows, 0u);
+}
+
+TEST(Expire, StringIntTuple) {
+  CQL::Table<CacheEntry> cache;
+  for (long i = 0; i < 100; ++i) {
+    cache.emplace("key" + std::to_string(i), "value", i / 10);
+  }
+
+  std::vector<long> erased;
+  cache.subscribe([&](CQL::Change change, CacheEntry const &entry, CacheEntry const *) {
+    if (change == CQL::Change::Erase) {
+      erased.emplace_back(std::get<2>(entry));
+    }
+  });
+
+  EXPECT_EQ(cache.expire(-1L), 0u);
+  EXPECT_EQ(cache.expire(2L), 30u);
+  EXPECT_EQ(cache.size(), 70u);
+  EXPECT_TRUE(std::is_sorted(erased.begin(), erased.end()));
+  EXPECT_EQ(erased.back(), 2);
+  EXPECT_EQ(cache.lookup<0>("key29"), nullptr);
+  EXPECT_NE(cache.lookup<0>("key30"), nullptr);
+
+  // Pushing a deadline back keeps the entry around
+  cache.update<2>(cache.lookup<0>("key30"), 100L);
+  EXPECT_EQ(cache.expire(3L), 9u);
+  EXPECT_NE(cache.lookup<0>("key30"), nullptr);
+
+  // Unique keys free up as their entries expire
+  EXPECT_EQ(cache.emplace("key95", "again", 20L), nullptr);
+  EXPECT_EQ(cache.expire(9L), 60u);
+  EXPECT_NE(cache.emplace("key95", "again", 20L), nullptr);
+  EXPECT_EQ(cache.size(), 2u);
+}